@@ -7,11 +7,34 @@
 #define DEVICE_NAME "gpio_dev"
 #define CLASS_NAME "gpio_class"
 
+/* One minor per Device Tree node: /dev/gpio_dev, /dev/gpio_dev1, ... */
+#define GPIO_MAX_DEVICES 8
+
 /* IOCTL commands */
 #define GPIO_IOCTL_SET_VALUE    _IOW('g', 1, int)
 #define GPIO_IOCTL_GET_VALUE    _IOR('g', 2, int)
 #define GPIO_IOCTL_SET_DIRECTION _IOW('g', 3, int)
 #define GPIO_IOCTL_GET_DIRECTION _IOR('g', 4, int)
+#define GPIO_IOCTL_SET_COUNTER  _IOW('g', 5, int)
+#define GPIO_IOCTL_GET_COUNTER  _IOR('g', 6, struct gpio_counter_info)
+#define GPIO_IOCTL_SET_REFLEX   _IOW('g', 7, struct gpio_reflex)
+#define GPIO_IOCTL_GET_REFLEX   _IOR('g', 8, struct gpio_reflex)
+#define GPIO_IOCTL_GET_STATE    _IOWR('g', 9, struct gpio_state)
+#define GPIO_IOCTL_RUN_OPS      _IOWR('g', 10, struct gpio_op_list)
+#define GPIO_IOCTL_SET_READ_MODE _IOW('g', 11, int)
+#define GPIO_IOCTL_SET_LINE_MASK _IOW('g', 12, __u32)
+#define GPIO_IOCTL_GET_EVENT_STATS _IOR('g', 13, struct gpio_event_stats)
+#define GPIO_IOCTL_SET_READ_TIMEOUT _IOW('g', 14, int)
+#define GPIO_IOCTL_SET_EDGES    _IOW('g', 15, int)
+#define GPIO_IOCTL_SET_WAKEUP   _IOW('g', 16, struct gpio_wakeup)
+#define GPIO_IOCTL_GET_CPU_STATS _IOWR('g', 17, struct gpio_cpu_stats_list)
+#define GPIO_IOCTL_SET_GESTURE  _IOW('g', 18, struct gpio_gesture)
+#define GPIO_IOCTL_GET_GESTURE  _IOR('g', 19, struct gpio_gesture)
+#define GPIO_IOCTL_SET_FILTER   _IOW('g', 20, struct gpio_filter)
+#define GPIO_IOCTL_SET_EVENTFD  _IOW('g', 21, struct gpio_eventfd)
+#define GPIO_IOCTL_SCHEDULE     _IOWR('g', 22, struct gpio_timed_list)
+#define GPIO_IOCTL_GET_TIMED    _IOWR('g', 23, struct gpio_timed_list)
+#define GPIO_IOCTL_WATCH_LEVEL  _IOW('g', 24, int)
 
 /* GPIO Direction */
 #define GPIO_DIRECTION_INPUT    0
@@ -21,13 +44,460 @@
 #define GPIO_VALUE_LOW          0
 #define GPIO_VALUE_HIGH         1
 
+/* Edge selectors (same bits as IRQ_TYPE_EDGE_*) */
+#define GPIO_EDGE_RISING        1
+#define GPIO_EDGE_FALLING       2
+#define GPIO_EDGE_BOTH          3
+
+/* Reflex actions applied to the target line from the IRQ handler */
+#define GPIO_REFLEX_NONE        0
+#define GPIO_REFLEX_SET         1
+#define GPIO_REFLEX_CLEAR       2
+#define GPIO_REFLEX_TOGGLE      3
+#define GPIO_REFLEX_PULSE       4
+
+/*
+ * Reflex rule: on an edge of this line, drive target_line (the minor of
+ * another gpio_dev node). Set action to GPIO_REFLEX_NONE to remove it.
+ */
+#define GPIO_REFLEX_MAX_PULSE_US 1000000
+
+struct gpio_reflex {
+    __s32 target_line;
+    __u32 action;
+    __u32 edge;
+    __u32 pulse_us;             /* High time for GPIO_REFLEX_PULSE */
+};
+
+/*
+ * Gesture layer: debounces the line and records button gestures instead
+ * of raw edges. Thresholds in ms; 0 disables the gesture it controls.
+ */
+#define GPIO_GESTURE_ENABLE     (1 << 0)
+#define GPIO_GESTURE_ACTIVE_LOW (1 << 1)    /* Pressed reads 0 */
+#define GPIO_GESTURE_MAX_MS     60000
+
+#define GPIO_GESTURE_DEBOUNCE_MS        20
+#define GPIO_GESTURE_LONG_PRESS_MS      800
+#define GPIO_GESTURE_DOUBLE_CLICK_MS    300
+
+struct gpio_gesture {
+    __u32 flags;                /* GPIO_GESTURE_* */
+    __u32 debounce_ms;          /* Level must be stable this long */
+    __u32 long_press_ms;
+    __u32 repeat_ms;
+    __u32 double_click_ms;      /* Max time between the two presses */
+    __u32 reserved;
+};
+
+/*
+ * Edge notification through an eventfd: the driver's edge path adds 1 per
+ * matching edge, so one read() of the eventfd returns the edges since the
+ * last read. Each file holds at most one registration per edge type; a
+ * new one replaces it and fd = -1 removes it. Closing the file drops them.
+ */
+#define GPIO_EVENTFD_MAX        8       /* Registrations per line */
+
+struct gpio_eventfd {
+    __s32 fd;                   /* eventfd, or -1 to unregister */
+    __u32 edges;                /* GPIO_EDGE_* that signal it */
+};
+
+/*
+ * Full line state for GPIO_IOCTL_GET_STATE. Set size to sizeof(struct
+ * gpio_state) before the call; the driver copies min(size, its own size)
+ * bytes and returns that amount in size. New fields are only appended.
+ */
+#define GPIO_STATE_VERSION      1
+#define GPIO_STATE_SIZE_VER1    64
+
+#define GPIO_STATE_HAS_IRQ      (1 << 0)
+#define GPIO_STATE_COUNTER      (1 << 1)
+#define GPIO_STATE_REFLEX       (1 << 2)
+#define GPIO_STATE_EXPANDER     (1 << 3)    /* Sleeping line: shadowed, coalesced writes */
+#define GPIO_STATE_POLLED       (1 << 4)    /* No IRQ: edges come from the poll timer */
+#define GPIO_STATE_GESTURE      (1 << 5)
+
+struct gpio_state {
+    __u32 size;
+    __u32 version;
+    __s32 line;                 /* Minor number */
+    __u32 gpio;                 /* GPIO number */
+    __u32 value;
+    __u32 direction;
+    __u32 trigger;              /* GPIO_EDGE_* the IRQ fires on, 0 = no IRQ */
+    __u32 flags;                /* GPIO_STATE_* */
+    __u64 edges;
+    __u64 rising;
+    __u64 falling;
+    __u64 last_edge_ns;         /* ktime_get_ns() of the latest edge */
+};
+
+/* Batched operations for GPIO_IOCTL_RUN_OPS */
+#define GPIO_OP_SET             1   /* Drive arg (0/1) */
+#define GPIO_OP_GET             2   /* Sample into result */
+#define GPIO_OP_WAIT_LEVEL      3   /* Wait up to ns for level arg */
+#define GPIO_OP_DELAY_NS        4   /* Wait ns */
+#define GPIO_OP_TOGGLE          5   /* Invert the output */
+
+#define GPIO_OPS_MAX            256
+#define GPIO_OPS_ATOMIC         (1 << 0)    /* Run with preemption disabled */
+#define GPIO_OPS_ATOMIC_MAX_NS  100000      /* Delay + wait budget when atomic */
+#define GPIO_OPS_MAX_NS         1000000000ULL /* Delay + wait budget otherwise */
+
+struct gpio_op {
+    __u16 code;                 /* GPIO_OP_* */
+    __u16 reserved;
+    __s32 arg;
+    __u64 ns;
+    __s32 result;               /* Out: sampled level, or -ETIMEDOUT */
+    __u32 reserved2;
+    __u64 timestamp_ns;         /* Out: ktime_get_ns() when the op completed */
+};
+
+struct gpio_op_list {
+    __u64 ops;                  /* User pointer to struct gpio_op[count] */
+    __u32 count;
+    __u32 flags;                /* GPIO_OPS_* */
+    __u32 completed;            /* Out: ops executed */
+    __s32 error;                /* Out: 0 or -errno of the op that stopped the list */
+    __u64 duration_ns;          /* Out: time from first to last op */
+};
+
+/*
+ * Timed output: GPIO_IOCTL_SCHEDULE queues level changes at absolute
+ * CLOCK_MONOTONIC times (ktime_get_ns(), clock_gettime(CLOCK_MONOTONIC));
+ * an hrtimer per line applies them and records when. Each change gets
+ * an id. With GPIO_TIMED_WAIT the call returns once all its changes have
+ * fired; otherwise GPIO_IOCTL_GET_TIMED looks results up by id. A line
+ * queues up to GPIO_TIMED_MAX changes across all files, and closing a
+ * file cancels its pending ones. Changes due at the same time apply in
+ * id order. Sleeping (expander) lines are refused.
+ */
+#define GPIO_TIMED_MAX          32      /* Pending changes per line */
+#define GPIO_TIMED_HISTORY      64      /* Results kept per line */
+#define GPIO_TIMED_WAIT         (1 << 0)
+
+struct gpio_timed {
+    __u64 at_ns;                /* CLOCK_MONOTONIC deadline, < 2^63; past ones fire at once */
+    __s32 value;
+    __s32 result;               /* Out: 0 fired, -EINPROGRESS, -ECANCELED, -EACCES
+                                   (no longer an output), -ENOENT (unknown id) */
+    __u64 id;                   /* Out of SCHEDULE, in to GET_TIMED */
+    __u64 fired_ns;             /* Out: ktime_get_ns() right after the line was driven */
+};
+
+struct gpio_timed_list {
+    __u64 changes;              /* User pointer to struct gpio_timed[count] */
+    __u32 count;                /* At most GPIO_TIMED_MAX */
+    __u32 flags;                /* GPIO_TIMED_* (SCHEDULE only) */
+};
+
+/* What read() returns on a file */
+#define GPIO_READ_VALUE         0   /* 1 byte: current level (default) */
+#define GPIO_READ_EVENTS        1   /* struct gpio_event records */
+#define GPIO_READ_BITMAP        2   /* Planar bitmaps of the line mask, see below */
+
+/*
+ * GPIO_READ_BITMAP: read() samples every line of the file's line mask
+ * back to back and returns one plane per line, lowest minor first. Each
+ * plane holds count / lines bytes, rounded down to a multiple of 8 and at
+ * most GPIO_BITMAP_MAX_SAMPLES / 8; sample k is bit k % 8 of byte k / 8.
+ */
+#define GPIO_BITMAP_MAX_SAMPLES 65536
+#define GPIO_BITMAP_CHUNK       64  /* Samples per locked burst, one u64 per plane */
+
+#define GPIO_EVENT_RISING       1
+#define GPIO_EVENT_FALLING      2
+
+/* Gesture events, replacing raw edges on a line with gestures enabled */
+#define GPIO_EVENT_PRESS        3
+#define GPIO_EVENT_RELEASE      4   /* duration_ns: how long it was held */
+#define GPIO_EVENT_LONG_PRESS   5   /* Held for long_press_ms */
+#define GPIO_EVENT_REPEAT       6   /* Every repeat_ms after LONG_PRESS */
+#define GPIO_EVENT_DOUBLE_CLICK 7   /* Instead of PRESS; duration_ns: since the first press */
+
+/* Event read timeout in ms: block forever (default) or return at once */
+#define GPIO_TIMEOUT_INFINITE   (-1)
+#define GPIO_TIMEOUT_NONE       0
+
+/*
+ * Batched wakeup for event readers: a sleeping reader (read or poll) is
+ * woken once watermark events are pending, or max_latency_us after the
+ * first of them arrived, whichever comes first. 0 latency = no timer.
+ */
+#define GPIO_WAKEUP_MAX_LATENCY_US  10000000    /* 10 s */
+
+struct gpio_wakeup {
+    __u32 watermark;            /* Events, 1 (default) .. GPIO_EVENT_RING_SIZE */
+    __u32 max_latency_us;
+};
+
+/* Edge history per CPU, shared by all readers (power of two) */
+#define GPIO_EVENT_RING_SIZE    1024
+
+/* Edge record returned by read() in GPIO_READ_EVENTS mode */
+struct gpio_event {
+    __u64 timestamp_ns;         /* ktime_get_ns() in the IRQ handler */
+    __u64 duration_ns;          /* Time since the previous edge on this line */
+    __u32 seqno;                /* Sequence number on the recording CPU */
+    __u32 lost;                 /* Events this reader missed just before this one */
+    __u16 line;                 /* Minor number of the source line */
+    __u16 type;                 /* GPIO_EVENT_* */
+    __u16 flags;                /* GPIO_EVENT_FLAG_* */
+    __u16 cpu;                  /* CPU that handled the IRQ */
+};
+
+/*
+ * Edge seen by the poll timer: timestamp_ns is when the new level was
+ * sampled, the edge itself happened within the preceding poll interval
+ */
+#define GPIO_EVENT_FLAG_POLLED  (1 << 0)
+
+/*
+ * Per-file event filter: a classic BPF program (struct sock_filter from
+ * <linux/filter.h>) run on each event before it counts for the file, so
+ * rejected events cost the reader no wakeup and no copy. BPF_ABS loads read
+ * struct gpio_filter_ctx in host byte order; a non-zero return keeps the
+ * event. Jumps go forward only. Scratch memory M[] keeps its contents from
+ * event to event (cleared on attach), so programs can count. count = 0
+ * detaches; attaching or detaching discards unread events.
+ */
+#define GPIO_FILTER_MAX_INSNS   64
+#define GPIO_FILTER_MEMWORDS    16
+
+struct gpio_filter {
+    __u64 insns;                /* User pointer to struct sock_filter[count] */
+    __u32 count;
+    __u32 reserved;
+};
+
+/* What a filter program loads from */
+struct gpio_filter_ctx {
+    struct gpio_event event;    /* lost is always 0 */
+    __u32 duration_us;          /* event.duration_ns / 1000, saturated */
+    __u32 reserved;
+};
+
+struct gpio_event_stats {
+    __u64 delivered;            /* Events read by this file */
+    __u64 overruns;             /* Events this file lost to ring wrap-around */
+    __u64 pending;              /* Events past this file's cursors (all lines) */
+    __u64 total;                /* Events recorded by the driver */
+};
+
+/* One CPU's share of the edge history, as seen by the calling file */
+struct gpio_cpu_stats {
+    __u32 cpu;
+    __u32 reserved;
+    __u64 recorded;             /* Events this CPU's IRQs recorded */
+    __u64 dropped;              /* Of those, overwritten before this file read them */
+};
+
+struct gpio_cpu_stats_list {
+    __u64 stats;                /* User pointer to struct gpio_cpu_stats[count] */
+    __u32 count;                /* In: capacity, out: possible CPUs */
+    __u32 reserved;
+};
+
+/* Counter mode: EWMA weight is 1/2^GPIO_COUNTER_EWMA_SHIFT per edge */
+#define GPIO_COUNTER_EWMA_SHIFT 3
+
+/* Counter snapshot returned by GPIO_IOCTL_GET_COUNTER */
+struct gpio_counter_info {
+    __u32 enabled;
+    __u32 reserved;
+    __u64 edges;                /* Rising + falling since counter was enabled */
+    __u64 rising;
+    __u64 falling;
+    __u64 last_edge_ns;         /* ktime_get_ns() of the latest edge */
+    __u64 period_ns;            /* Rolling average rising-to-rising time */
+    __u64 high_ns;              /* Rolling average rising-to-falling time */
+    __u64 frequency_millihz;    /* 1e12 / period_ns, 0 when the signal stopped */
+    __u32 duty_permille;        /* 1000 * high_ns / period_ns */
+    __u32 reserved2;
+};
+
+/*
+ * Read-only page exported through mmap(). The driver bumps seq to an odd
+ * value before updating and to the next even value afterwards; readers
+ * retry until they see the same even seq on both sides of their copy.
+ */
+#define GPIO_SHARED_STATE_VERSION 1
+
+struct gpio_shared_state {
+    __u32 seq;
+    __u32 version;
+    __u32 value;
+    __u32 direction;
+    __u32 counter_enabled;
+    __u32 reserved;
+    __u64 edges;
+    __u64 rising;
+    __u64 falling;
+    __u64 last_edge_ns;
+    __u64 period_ns;
+    __u64 high_ns;
+};
+
+/*
+ * One CPU's edge history: written only by its own CPU with interrupts
+ * off, read locklessly (head is published with release semantics)
+ */
+struct gpio_event_ring {
+    u64 head;                   /* Position of the next event */
+    wait_queue_head_t wait;     /* Wake entries of the files in event mode */
+    struct work_struct wake_work;   /* Runs their wake functions, see gpio_ring_wake */
+    struct gpio_event events[GPIO_EVENT_RING_SIZE];
+};
+
+struct gpio_file;
+struct gpio_filter_prog;
+struct eventfd_ctx;
+
+/* eventfd registered on a line by an open file */
+struct gpio_eventfd_reg {
+    struct eventfd_ctx *ctx;    /* NULL = free slot */
+    u32 edges;                  /* GPIO_EDGE_* */
+    struct gpio_file *owner;
+};
+
+/* Timed output change queued on a line; id 0 = free slot */
+struct gpio_timed_slot {
+    u64 id;
+    u64 at_ns;
+    int value;
+    struct gpio_file *owner;
+};
+
+/* Outcome of a timed change, kept at timed_done[id % GPIO_TIMED_HISTORY] */
+struct gpio_timed_done {
+    u64 id;
+    u64 fired_ns;
+    int result;
+};
+
+/* Fast samples a polled line stays at poll_min_us after an edge */
+#define GPIO_POLL_HOLD_SAMPLES  100
+
+/* A file's position in one CPU's ring */
+struct gpio_file_cpu {
+    u64 cursor;                 /* Next event position to deliver */
+    u64 dropped;                /* Overruns on this ring */
+    int peeked;                 /* peek holds the event at cursor */
+    struct gpio_event peek;
+    wait_queue_entry_t wake_entry;
+    struct gpio_file *file;
+
+    /* Events before judged are counted; with a filter, verdict bit per slot */
+    u64 judged;
+    u64 judge_end;              /* Head the current judge pass stops at */
+    DECLARE_BITMAP(verdict, GPIO_EVENT_RING_SIZE);
+};
+
 /* Device private structure */
 struct gpio_device {
+    int minor;
+    int irq;
+    unsigned int trigger;       /* Current IRQ_TYPE_EDGE_* of irq */
+    unsigned int event_edges;   /* GPIO_EDGE_* recorded as events */
+    struct device_node *node;
     int gpio_number;
     int direction;
     int value;
     struct cdev cdev;
     struct device *device;
+    u64 probe_ns;               /* Probe duration, see probe_time_us */
+
+    /* Held by probe and by each open file, see gpio_device_free */
+    struct kref ref;
+    int removed;                /* Unbound; under gpio_mutex, file ops fail */
+
+    /* Line on a sleeping (I2C/SPI) expander: shadowed, coalesced writes */
+    int cansleep;
+    int input_cache;            /* Input reads served from the IRQ-sampled level */
+    int level_watchers;         /* Files holding GPIO_IOCTL_WATCH_LEVEL; under gpio_mutex */
+
+    /* Counter mode, updated from the IRQ handler under lock */
+    spinlock_t lock;
+    int counter_enabled;
+    u64 edges;
+    u64 rising;
+    u64 falling;
+    u64 last_edge_ns;
+    u64 last_rise_ns;
+    u64 period_ns;
+    u64 high_ns;
+
+    /* Page shared read-only with userspace; mappings hold their own references */
+    struct gpio_shared_state *shared;
+    struct page *shared_page;
+
+    /* Reflex rule (source side); reflex_np is the unresolved DT target */
+    struct gpio_reflex reflex;
+    struct device_node *reflex_np;
+
+    /* Ends a reflex pulse on this line (target side) */
+    struct hrtimer pulse_timer;
+
+    /* Edge detection for lines without an IRQ, see gpio_poll_update */
+    int polling;
+    int poll_level;             /* Level at the previous sample */
+    u64 poll_edge_ns;           /* Last level change seen by the poller */
+    u64 poll_ns;                /* Current sampling interval */
+    struct hrtimer poll_timer;
+    struct work_struct poll_work;   /* Samples sleeping lines */
+
+    /* Gesture layer, see gpio_gesture_settle; under lock */
+    struct gpio_gesture gesture;
+    int raw_level;              /* Level of the latest edge */
+    int bouncing;               /* Debounce timer running */
+    u64 bounce_ns;              /* First edge of the current bounce burst */
+    int pressed;                /* Debounced state */
+    int held;                   /* LONG_PRESS reported for this press */
+    int click_armed;            /* Last press was a short PRESS */
+    u64 press_ns;
+    struct hrtimer debounce_timer;
+    struct hrtimer hold_timer;  /* LONG_PRESS, then REPEAT */
+
+    /* Signalled from the edge path under lock, see gpio_set_eventfd */
+    struct gpio_eventfd_reg eventfds[GPIO_EVENTFD_MAX];
+    u32 eventfd_edges;          /* Union of eventfds[].edges */
+
+    /* Timed output, see gpio_timed_fire; under lock */
+    struct gpio_timed_slot timed[GPIO_TIMED_MAX];
+    struct gpio_timed_done timed_done[GPIO_TIMED_HISTORY];
+    u64 timed_ids;              /* Last id handed out */
+    struct hrtimer timed_timer; /* Armed for the earliest pending change */
+    wait_queue_head_t timed_wait;   /* GPIO_TIMED_WAIT callers */
+};
+
+/* Per-open-file state: each reader has its own cursor into the history */
+struct gpio_file {
+    struct gpio_device *dev;
+    int read_mode;              /* GPIO_READ_* */
+    int timeout_ms;             /* Event read timeout, GPIO_TIMEOUT_* or ms */
+    u32 line_mask;              /* Bit per minor; default is the opened line */
+    int watch_level;            /* Counted in dev->level_watchers */
+    struct gpio_file_cpu *cpus; /* Per possible CPU, merged by timestamp */
+    struct mutex read_lock;     /* Serialises readers of this file */
+    u64 unreported;             /* Overruns not yet attached to an event */
+    u64 delivered;
+    u64 overruns;
+
+    /* Batched wakeup, see struct gpio_wakeup */
+    u32 watermark;
+    u64 max_latency_ns;
+    atomic_t pending;           /* Matching events not yet read */
+    int expired;                /* Latency timer fired since the last drain */
+    struct hrtimer latency_timer;
+    wait_queue_head_t wait;     /* read() and poll() sleep here */
+
+    /* Event filter, see struct gpio_filter; run under filter_lock */
+    struct gpio_filter_prog *filter;
+    struct mutex filter_lock;
+    u32 filter_mem[GPIO_FILTER_MEMWORDS];
+    struct work_struct judge_work;  /* Counts and judges new events, see gpio_file_judge */
 };
 
 #endif /* __GPIO_DRIVER_H__ */
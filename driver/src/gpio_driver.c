@@ -22,9 +22,23 @@
 #include <linux/interrupt.h>
 #include <linux/spinlock.h>
 #include <linux/mutex.h>
+#include <linux/kref.h>
 #include <linux/slab.h>
 #include <linux/wait.h>
+#include <linux/mm.h>
+#include <linux/ktime.h>
+#include <linux/hrtimer.h>
+#include <linux/bitops.h>
+#include <linux/overflow.h>
+#include <linux/delay.h>
+#include <linux/preempt.h>
+#include <linux/poll.h>
+#include <linux/jiffies.h>
+#include <linux/filter.h>
+#include <linux/eventfd.h>
+#include <linux/uio.h>
 #include <asm/uaccess.h>
+#include <asm/div64.h>
 
 #include "../include/gpio_driver.h"
 
@@ -35,86 +49,2647 @@ MODULE_LICENSE("GPL v2");
 MODULE_VERSION("1.0.0");
 
 /* Global variables */
-static dev_t gpio_device_num;                    /* Device number (major, minor) */
-static struct cdev *gpio_cdev;                   /* Character device structure */
+static dev_t gpio_device_num;                    /* First device number (major, minor 0) */
 static struct class *gpio_class;                 /* Device class */
-static struct device *gpio_device;               /* Device structure */
-static struct gpio_device *gpio_dev_data;        /* Driver private data */
 static DEFINE_MUTEX(gpio_mutex);                 /* Mutex for device access */
 
+/* Probed devices by minor; the lock is taken from IRQ context */
+static struct gpio_device *gpio_devices[GPIO_MAX_DEVICES];
+static DEFINE_SPINLOCK(gpio_devices_lock);
+
+/* Event-mode files whose line mask covers each minor; under gpio_mutex */
+static int gpio_pollers[GPIO_MAX_DEVICES];
+static DECLARE_BITMAP(gpio_minors, GPIO_MAX_DEVICES);
+
+/* Device Tree names for reflex rules (index = value) */
+static const char * const gpio_reflex_actions[] = { "none", "set", "clear", "toggle", "pulse" };
+static const char * const gpio_reflex_edges[] = { "none", "rising", "falling", "both" };
+
 /* GPIO-specific variables */
 static int gpio_number = 21;                     /* Default GPIO number (GPIO21 = BCM21 on RPi) */
-static int gpio_irq = -1;                        /* IRQ number for GPIO */
-static bool interrupt_triggered = false;         /* Interrupt flag */
-static wait_queue_head_t gpio_wait_queue;        /* Wait queue for blocking reads */
+
+/* Edge history, one ring per possible CPU; files keep a cursor into each */
+static struct gpio_event_ring **gpio_event_rings;
+
+static u64 gpio_init_ns;                         /* Module init duration */
+
+/* Sleeping (expander) outputs with a write pending, flushed together */
+static unsigned long gpio_dirty;                 /* Bit per minor */
+static unsigned long gpio_flush_armed;           /* Bit 0: timer or worker pending */
+static int coalesce_us = 100;                    /* Window to gather writes */
+static struct hrtimer gpio_coalesce_timer;
+static void gpio_flush_writes(struct work_struct *work);
+static DECLARE_WORK(gpio_flush_work, gpio_flush_writes);
+
+/* Edge polling of lines without an IRQ, see gpio_poll_sample */
+static int poll_min_us = 100;                    /* Interval while the line is active */
+static int poll_max_us = 20000;                  /* Interval once it is idle */
 
 /* Module parameters */
 module_param(gpio_number, int, S_IRUGO | S_IWUSR);
 MODULE_PARM_DESC(gpio_number, "GPIO number to control (default: 21)");
+module_param(coalesce_us, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(coalesce_us, "Expander write coalescing window in us (default: 100, 0 = none)");
+module_param(poll_min_us, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(poll_min_us, "Edge polling interval of an active line without IRQ in us (default: 100)");
+module_param(poll_max_us, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(poll_max_us, "Edge polling interval of an idle line without IRQ in us (default: 20000)");
+
+/*
+ * Publish device state to the shared page
+ * Caller holds dev->lock
+ */
+static void gpio_publish_state(struct gpio_device *dev)
+{
+    struct gpio_shared_state *state = dev->shared;
+    
+    if (state == NULL) {
+        return;
+    }
+    
+    WRITE_ONCE(state->seq, state->seq + 1);
+    smp_wmb();
+    
+    state->value = dev->value;
+    state->direction = dev->direction;
+    state->counter_enabled = dev->counter_enabled;
+    state->edges = dev->edges;
+    state->rising = dev->rising;
+    state->falling = dev->falling;
+    state->last_edge_ns = dev->last_edge_ns;
+    state->period_ns = dev->period_ns;
+    state->high_ns = dev->high_ns;
+    
+    smp_wmb();
+    WRITE_ONCE(state->seq, state->seq + 1);
+}
+
+/*
+ * Publish device state from process context
+ */
+static void gpio_sync_state(struct gpio_device *dev)
+{
+    unsigned long flags;
+    
+    spin_lock_irqsave(&dev->lock, flags);
+    gpio_publish_state(dev);
+    spin_unlock_irqrestore(&dev->lock, flags);
+}
+
+/*
+ * Fold a new sample into a rolling average (no division, IRQ safe)
+ */
+static u64 gpio_ewma(u64 average, u64 sample)
+{
+    if (average == 0) {
+        return sample;
+    }
+    
+    return average + ((s64)(sample - average) >> GPIO_COUNTER_EWMA_SHIFT);
+}
+
+/*
+ * Account one edge; period and high time are only tracked in counter mode
+ * Caller holds dev->lock
+ */
+static void gpio_count_edge(struct gpio_device *dev, int level, u64 now)
+{
+    dev->edges++;
+    
+    if (level) {
+        dev->rising++;
+        if (dev->counter_enabled && dev->last_rise_ns != 0) {
+            dev->period_ns = gpio_ewma(dev->period_ns, now - dev->last_rise_ns);
+        }
+        dev->last_rise_ns = now;
+    } else {
+        dev->falling++;
+        if (dev->counter_enabled && dev->last_rise_ns != 0) {
+            dev->high_ns = gpio_ewma(dev->high_ns, now - dev->last_rise_ns);
+        }
+    }
+    
+    dev->last_edge_ns = now;
+    dev->value = level;
+}
+
+/*
+ * Expander lines: write coalescing
+ * Writes to a line that sleeps (I2C/SPI expander) only update the shadow
+ * (dev->value) and mark the line dirty. After coalesce_us the flush worker
+ * writes every dirty line in one gpiod_set_array_value_cansleep() call,
+ * which gpiolib turns into one transfer per expander.
+ */
+static void gpio_flush_writes(struct work_struct *work)
+{
+    struct gpio_desc *descs[GPIO_MAX_DEVICES];
+    DECLARE_BITMAP(values, GPIO_MAX_DEVICES);
+    struct gpio_device *dev;
+    unsigned long dirty;
+    unsigned long flags;
+    unsigned int n = 0;
+    int minor;
+    
+    /* Disarm first: a write that misses the xchg below re-arms */
+    clear_bit(0, &gpio_flush_armed);
+    smp_mb__after_atomic();
+    dirty = xchg(&gpio_dirty, 0);
+    bitmap_zero(values, GPIO_MAX_DEVICES);
+    
+    /* Removed lines are skipped; gpio_remove flushes before unpublishing */
+    spin_lock_irqsave(&gpio_devices_lock, flags);
+    for_each_set_bit(minor, &dirty, GPIO_MAX_DEVICES) {
+        dev = gpio_devices[minor];
+        if (dev == NULL) {
+            continue;
+        }
+        descs[n] = gpio_to_desc(dev->gpio_number);
+        if (READ_ONCE(dev->value)) {
+            __set_bit(n, values);
+        }
+        n++;
+    }
+    spin_unlock_irqrestore(&gpio_devices_lock, flags);
+    
+    if (n != 0) {
+        gpiod_set_array_value_cansleep(n, descs, NULL, values);
+    }
+}
+
+static enum hrtimer_restart gpio_coalesce_expired(struct hrtimer *timer)
+{
+    queue_work(system_highpri_wq, &gpio_flush_work);
+    
+    return HRTIMER_NORESTART;
+}
+
+/*
+ * Drive an output; any context
+ * Direct for SoC lines, through the shadow and flush worker for expanders
+ */
+static void gpio_line_set(struct gpio_device *dev, int value)
+{
+    WRITE_ONCE(dev->value, value);
+    
+    if (!dev->cansleep) {
+        gpio_set_value(dev->gpio_number, value);
+        return;
+    }
+    
+    /* The worker reads dev->value after clearing the dirty bit */
+    smp_mb__before_atomic();
+    set_bit(dev->minor, &gpio_dirty);
+    
+    /* First write of a window arms the flush; later ones ride along */
+    if (test_and_set_bit(0, &gpio_flush_armed)) {
+        return;
+    }
+    
+    if (coalesce_us <= 0) {
+        queue_work(system_highpri_wq, &gpio_flush_work);
+    } else {
+        hrtimer_start(&gpio_coalesce_timer, us_to_ktime(coalesce_us), HRTIMER_MODE_REL);
+    }
+}
+
+/*
+ * Drive an output immediately (timed op sequences); process context
+ */
+static void gpio_line_set_now(struct gpio_device *dev, int value)
+{
+    WRITE_ONCE(dev->value, value);
+    
+    if (dev->cansleep) {
+        gpio_set_value_cansleep(dev->gpio_number, value);
+    } else {
+        gpio_set_value(dev->gpio_number, value);
+    }
+}
+
+/*
+ * Sample the pin; process or threaded-IRQ context for expanders
+ */
+static int gpio_line_sample(struct gpio_device *dev)
+{
+    if (dev->cansleep) {
+        return gpio_get_value_cansleep(dev->gpio_number) ? 1 : 0;
+    }
+    
+    return gpio_get_value(dev->gpio_number) ? 1 : 0;
+}
+
+/*
+ * Current level for read()/ioctl; process context
+ * Expander outputs come from the shadow, and expander inputs with
+ * "input-cache" from the level the IRQ thread last sampled
+ */
+static int gpio_line_get(struct gpio_device *dev)
+{
+    if (dev->cansleep &&
+        (dev->direction == GPIO_DIRECTION_OUTPUT || (dev->input_cache && dev->irq > 0))) {
+        return READ_ONCE(dev->value);
+    }
+    
+    return gpio_line_sample(dev);
+}
+
+/*
+ * Seed dev->value from the pin and publish it, from process context
+ * Expander reads sleep, so they sample outside the lock; an edge the IRQ
+ * accounted meanwhile is newer than that sample and is kept
+ */
+static void gpio_sync_input(struct gpio_device *dev)
+{
+    unsigned long flags;
+    u64 edges;
+    int level;
+    
+    if (!dev->cansleep) {
+        spin_lock_irqsave(&dev->lock, flags);
+        dev->value = gpio_line_sample(dev);
+        gpio_publish_state(dev);
+        spin_unlock_irqrestore(&dev->lock, flags);
+        return;
+    }
+    
+    spin_lock_irqsave(&dev->lock, flags);
+    edges = dev->edges;
+    spin_unlock_irqrestore(&dev->lock, flags);
+    
+    level = gpio_line_sample(dev);
+    
+    spin_lock_irqsave(&dev->lock, flags);
+    if (dev->edges == edges) {
+        dev->value = level;
+    }
+    gpio_publish_state(dev);
+    spin_unlock_irqrestore(&dev->lock, flags);
+}
+
+/*
+ * Reflex pulse timer: drive the line low again
+ */
+static enum hrtimer_restart gpio_pulse_end(struct hrtimer *timer)
+{
+    struct gpio_device *dev = container_of(timer, struct gpio_device, pulse_timer);
+    unsigned long flags;
+    
+    /* An expander must see the high level before the low one */
+    if (test_bit(dev->minor, &gpio_dirty)) {
+        hrtimer_forward_now(timer, us_to_ktime(coalesce_us > 0 ? coalesce_us : 10));
+        return HRTIMER_RESTART;
+    }
+    
+    spin_lock_irqsave(&dev->lock, flags);
+    gpio_line_set(dev, 0);
+    gpio_publish_state(dev);
+    spin_unlock_irqrestore(&dev->lock, flags);
+    
+    return HRTIMER_NORESTART;
+}
+
+/*
+ * Apply a reflex rule to its target line
+ * Runs in IRQ context; expander targets are written by the flush worker
+ */
+static void gpio_reflex_fire(const struct gpio_reflex *rule)
+{
+    struct gpio_device *target = NULL;
+    unsigned long flags;
+    int value;
+    
+    spin_lock_irqsave(&gpio_devices_lock, flags);
+    
+    if (rule->target_line >= 0 && rule->target_line < GPIO_MAX_DEVICES) {
+        target = gpio_devices[rule->target_line];
+    }
+    
+    if (target == NULL) {
+        spin_unlock_irqrestore(&gpio_devices_lock, flags);
+        return;
+    }
+    
+    spin_lock(&target->lock);
+    
+    if (target->direction == GPIO_DIRECTION_OUTPUT) {
+        switch (rule->action) {
+        case GPIO_REFLEX_CLEAR:
+            value = 0;
+            break;
+        case GPIO_REFLEX_TOGGLE:
+            value = !target->value;
+            break;
+        default:
+            value = 1;
+            break;
+        }
+        
+        gpio_line_set(target, value);
+        gpio_publish_state(target);
+        
+        if (rule->action == GPIO_REFLEX_PULSE) {
+            hrtimer_start(&target->pulse_timer, us_to_ktime(rule->pulse_us), HRTIMER_MODE_REL);
+        }
+    }
+    
+    spin_unlock(&target->lock);
+    spin_unlock_irqrestore(&gpio_devices_lock, flags);
+}
+
+/*
+ * Append an edge to this CPU's history
+ * O(1) regardless of the number of readers and lock-free: only this CPU
+ * writes its ring. Returns the ring so the caller can wake its readers.
+ */
+static struct gpio_event_ring *gpio_event_push(struct gpio_device *dev, u16 type, u64 now,
+                                               u64 duration, u16 event_flags)
+{
+    struct gpio_event_ring *ring;
+    struct gpio_event *ev;
+    unsigned long flags;
+    u64 pos;
+    
+    local_irq_save(flags);
+    
+    ring = gpio_event_rings[smp_processor_id()];
+    pos = ring->head;
+    
+    /* A reader that sees the slot change must also see the head that freed it */
+    smp_wmb();
+    
+    ev = &ring->events[pos & (GPIO_EVENT_RING_SIZE - 1)];
+    ev->timestamp_ns = now;
+    ev->duration_ns = duration;
+    ev->seqno = (u32)pos;
+    ev->lost = 0;
+    ev->line = dev->minor;
+    ev->type = type;
+    ev->flags = event_flags;
+    ev->cpu = smp_processor_id();
+    smp_store_release(&ring->head, pos + 1);
+    
+    local_irq_restore(flags);
+    
+    return ring;
+}
+
+/*
+ * Record an event and hand the wake-ups to the ring's work
+ * O(1) here however many files are open; the files count and filter the
+ * event in process context (gpio_ring_wake, then gpio_file_judge_work)
+ */
+static void gpio_event_record(struct gpio_device *dev, u16 type, u64 now, u64 duration,
+                              u16 event_flags)
+{
+    struct gpio_event_ring *ring;
+    
+    ring = gpio_event_push(dev, type, now, duration, event_flags);
+    
+    /* Pairs with gpio_events_subscribe: it queues its judge work after adding its entries */
+    smp_mb();
+    if (waitqueue_active(&ring->wait)) {
+        queue_work(system_highpri_wq, &ring->wake_work);
+    }
+}
+
+/*
+ * Gesture layer
+ * Every edge restarts the debounce timer; when it expires the line has been
+ * stable for debounce_ms and gpio_gesture_settle turns the new level into
+ * PRESS/DOUBLE_CLICK or RELEASE, stamped with the burst's first edge.
+ * While pressed, hold_timer reports LONG_PRESS and then REPEAT.
+ */
+static void gpio_gesture_edge(struct gpio_device *dev, int level, u64 now)
+{
+    dev->raw_level = level;
+    if (!dev->bouncing) {
+        dev->bouncing = 1;
+        dev->bounce_ns = now;
+    }
+    hrtimer_start(&dev->debounce_timer, ms_to_ktime(dev->gesture.debounce_ms),
+                  HRTIMER_MODE_REL);
+}
+
+static enum hrtimer_restart gpio_gesture_settle(struct hrtimer *timer)
+{
+    struct gpio_device *dev = container_of(timer, struct gpio_device, debounce_timer);
+    struct gpio_gesture *g = &dev->gesture;
+    unsigned long flags;
+    u16 type = 0;
+    u64 duration = 0;
+    u64 ts;
+    int active;
+    
+    spin_lock_irqsave(&dev->lock, flags);
+    
+    dev->bouncing = 0;
+    ts = dev->bounce_ns;
+    active = dev->raw_level ^ ((g->flags & GPIO_GESTURE_ACTIVE_LOW) ? 1 : 0);
+    
+    if (active && !dev->pressed) {
+        /* A short press soon after another short press is a double click */
+        if (dev->click_armed && g->double_click_ms != 0 &&
+            ts - dev->press_ns <= (u64)g->double_click_ms * NSEC_PER_MSEC) {
+            type = GPIO_EVENT_DOUBLE_CLICK;
+            duration = ts - dev->press_ns;
+        } else {
+            type = GPIO_EVENT_PRESS;
+        }
+        dev->pressed = 1;
+        dev->held = 0;
+        dev->click_armed = (type == GPIO_EVENT_PRESS);
+        dev->press_ns = ts;
+        if (g->long_press_ms != 0) {
+            hrtimer_start(&dev->hold_timer, ms_to_ktime(g->long_press_ms), HRTIMER_MODE_REL);
+        }
+    } else if (!active && dev->pressed) {
+        type = GPIO_EVENT_RELEASE;
+        duration = ts - dev->press_ns;
+        dev->pressed = 0;
+        if (dev->held) {
+            dev->click_armed = 0;
+        }
+        /* hold_timer takes our lock: never wait for it here */
+        hrtimer_try_to_cancel(&dev->hold_timer);
+    }
+    
+    spin_unlock_irqrestore(&dev->lock, flags);
+    
+    /* Bounces that ended at the old level report nothing */
+    if (type != 0) {
+        gpio_event_record(dev, type, ts, duration, 0);
+    }
+    
+    return HRTIMER_NORESTART;
+}
+
+static enum hrtimer_restart gpio_gesture_hold(struct hrtimer *timer)
+{
+    struct gpio_device *dev = container_of(timer, struct gpio_device, hold_timer);
+    unsigned long flags;
+    u64 now = ktime_get_ns();
+    u64 duration;
+    u32 repeat_ms;
+    u16 type;
+    
+    spin_lock_irqsave(&dev->lock, flags);
+    
+    if (!dev->pressed) {
+        spin_unlock_irqrestore(&dev->lock, flags);
+        return HRTIMER_NORESTART;
+    }
+    
+    type = dev->held ? GPIO_EVENT_REPEAT : GPIO_EVENT_LONG_PRESS;
+    dev->held = 1;
+    duration = now - dev->press_ns;
+    repeat_ms = dev->gesture.repeat_ms;
+    
+    spin_unlock_irqrestore(&dev->lock, flags);
+    
+    gpio_event_record(dev, type, now, duration, 0);
+    
+    if (repeat_ms == 0) {
+        return HRTIMER_NORESTART;
+    }
+    
+    hrtimer_forward_now(timer, ms_to_ktime(repeat_ms));
+    return HRTIMER_RESTART;
+}
+
+/*
+ * Account an edge and deliver it to counters, reflexes and event readers
+ * Shared by the IRQ handler and the poll timer of lines without an IRQ
+ */
+static void gpio_handle_edge(struct gpio_device *dev, int level, u64 now, u16 event_flags)
+{
+    struct gpio_reflex rule;
+    unsigned long flags;
+    u32 edge = level ? GPIO_EDGE_RISING : GPIO_EDGE_FALLING;
+    u64 prev;
+    int counting;
+    int gesture;
+    int i;
+    
+    /* Threaded for expanders: keep out hard IRQs that take this lock */
+    spin_lock_irqsave(&dev->lock, flags);
+    
+    /* Counter mode never wakes userspace */
+    counting = dev->counter_enabled;
+    prev = dev->last_edge_ns;
+    gpio_count_edge(dev, level, now);
+    gpio_publish_state(dev);
+    rule = dev->reflex;
+    
+    /* eventfd counts every matching edge, in counter and gesture mode too */
+    if (dev->eventfd_edges & edge) {
+        for (i = 0; i < GPIO_EVENTFD_MAX; i++) {
+            if (dev->eventfds[i].ctx != NULL && (dev->eventfds[i].edges & edge)) {
+                eventfd_signal(dev->eventfds[i].ctx, 1);
+            }
+        }
+    }
+    
+    /* Gesture lines record gestures instead of raw edges */
+    gesture = dev->gesture.flags & GPIO_GESTURE_ENABLE;
+    if (gesture) {
+        gpio_gesture_edge(dev, level, now);
+    }
+    
+    spin_unlock_irqrestore(&dev->lock, flags);
+    
+    /* Reflex runs after dropping our lock, so A->B and B->A cannot deadlock */
+    if (rule.action != GPIO_REFLEX_NONE && (rule.edge & edge)) {
+        gpio_reflex_fire(&rule);
+    }
+    
+    if (!counting && !gesture && (dev->event_edges & edge)) {
+        gpio_event_record(dev, level ? GPIO_EVENT_RISING : GPIO_EVENT_FALLING, now,
+                          prev ? now - prev : 0, event_flags);
+    }
+}
+
+/*
+ * GPIO Interrupt Service Routine
+ * Called when GPIO interrupt is triggered
+ */
+static irqreturn_t gpio_interrupt_handler(int irq, void *dev_id)
+{
+    struct gpio_device *dev = (struct gpio_device *)dev_id;
+    u64 now = ktime_get_ns();
+    int level;
+    
+    if (dev == NULL) {
+        printk(KERN_ERR "GPIO_DRIVER: Invalid device pointer in ISR\n");
+        return IRQ_NONE;
+    }
+    
+    /*
+     * A single-edge trigger tells the level; sample it for both edges.
+     * Expander IRQs are threaded, so the sample may sleep (before the lock).
+     */
+    if (READ_ONCE(dev->trigger) == IRQ_TYPE_EDGE_BOTH) {
+        level = gpio_line_sample(dev);
+    } else {
+        level = (READ_ONCE(dev->trigger) == IRQ_TYPE_EDGE_RISING) ? 1 : 0;
+    }
+    
+    gpio_handle_edge(dev, level, now, 0);
+    
+    return IRQ_HANDLED;
+}
+
+/*
+ * Lines without an IRQ: adaptive-rate polling
+ * The poll timer samples the line and turns level changes into the same
+ * edges the IRQ handler would report (flagged GPIO_EVENT_FLAG_POLLED).
+ * After an edge it samples every poll_min_us; once the line has been quiet
+ * for GPIO_POLL_HOLD_SAMPLES fast samples the interval doubles per quiet
+ * sample up to poll_max_us. Expander lines are sampled from poll_work.
+ */
+static void gpio_poll_sample(struct gpio_device *dev)
+{
+    u64 min_ns = (u64)max(poll_min_us, 10) * NSEC_PER_USEC;
+    u64 max_ns = max_t(u64, (u64)poll_max_us * NSEC_PER_USEC, min_ns);
+    u64 now = ktime_get_ns();
+    int level = gpio_line_sample(dev);
+    
+    if (level != dev->poll_level) {
+        dev->poll_level = level;
+        dev->poll_edge_ns = now;
+        dev->poll_ns = min_ns;
+        gpio_handle_edge(dev, level, now, GPIO_EVENT_FLAG_POLLED);
+        return;
+    }
+    
+    if (now - dev->poll_edge_ns > GPIO_POLL_HOLD_SAMPLES * min_ns) {
+        dev->poll_ns = min(dev->poll_ns * 2, max_ns);
+    }
+}
+
+static enum hrtimer_restart gpio_poll_tick(struct hrtimer *timer)
+{
+    struct gpio_device *dev = container_of(timer, struct gpio_device, poll_timer);
+    
+    if (!READ_ONCE(dev->polling)) {
+        return HRTIMER_NORESTART;
+    }
+    
+    /* Expander reads sleep; the worker samples and re-arms */
+    if (dev->cansleep) {
+        queue_work(system_highpri_wq, &dev->poll_work);
+        return HRTIMER_NORESTART;
+    }
+    
+    gpio_poll_sample(dev);
+    hrtimer_forward_now(timer, ns_to_ktime(dev->poll_ns));
+    return HRTIMER_RESTART;
+}
+
+static void gpio_poll_work(struct work_struct *work)
+{
+    struct gpio_device *dev = container_of(work, struct gpio_device, poll_work);
+    
+    gpio_poll_sample(dev);
+    
+    if (READ_ONCE(dev->polling)) {
+        hrtimer_start(&dev->poll_timer, ns_to_ktime(dev->poll_ns), HRTIMER_MODE_REL);
+    }
+}
+
+/*
+ * Stop polling; process context
+ */
+static void gpio_poll_stop(struct gpio_device *dev)
+{
+    if (!dev->polling) {
+        return;
+    }
+    
+    /* The worker may re-arm the timer once more before it sees polling == 0 */
+    WRITE_ONCE(dev->polling, 0);
+    hrtimer_cancel(&dev->poll_timer);
+    cancel_work_sync(&dev->poll_work);
+    hrtimer_cancel(&dev->poll_timer);
+}
+
+/*
+ * Start or stop polling a line without an IRQ
+ * It polls while it is an input whose edges have a consumer: an event
+ * reader whose mask covers the line, counter mode, a level watcher, a
+ * reflex rule, gestures or an eventfd
+ * Called with gpio_mutex held (or before the line is published)
+ */
+static void gpio_poll_update(struct gpio_device *dev)
+{
+    int want = dev->irq <= 0 && dev->direction == GPIO_DIRECTION_INPUT &&
+               (gpio_pollers[dev->minor] > 0 || dev->counter_enabled ||
+                dev->level_watchers > 0 || dev->reflex.action != GPIO_REFLEX_NONE ||
+                (dev->gesture.flags & GPIO_GESTURE_ENABLE) || dev->eventfd_edges != 0);
+    
+    if (!want) {
+        gpio_poll_stop(dev);
+        return;
+    }
+    
+    if (!dev->polling) {
+        dev->poll_level = gpio_line_sample(dev);
+        dev->poll_edge_ns = ktime_get_ns();
+        dev->poll_ns = (u64)max(poll_min_us, 10) * NSEC_PER_USEC;
+        WRITE_ONCE(dev->polling, 1);
+        hrtimer_start(&dev->poll_timer, ns_to_ktime(dev->poll_ns), HRTIMER_MODE_REL);
+    }
+}
+
+/*
+ * Last reference to a device dropped (gpio_remove or the last close)
+ * Live mappings keep the shared page until they are unmapped
+ */
+static void gpio_device_free(struct kref *ref)
+{
+    struct gpio_device *dev = container_of(ref, struct gpio_device, ref);
+    
+    put_page(dev->shared_page);
+    kfree(dev);
+}
+
+/*
+ * An event-mode file's line mask changed from old_mask to new_mask
+ * (0 = not in event mode): recount the readers of every line that joined
+ * or left and start or stop its poller. Lines not probed yet find their
+ * count when they are.
+ * Called with gpio_mutex held
+ */
+static void gpio_pollers_update(u32 old_mask, u32 new_mask)
+{
+    unsigned long changed = old_mask ^ new_mask;
+    struct gpio_device *dev;
+    unsigned long flags;
+    int minor;
+    
+    for_each_set_bit(minor, &changed, GPIO_MAX_DEVICES) {
+        gpio_pollers[minor] += (new_mask & BIT(minor)) ? 1 : -1;
+        
+        spin_lock_irqsave(&gpio_devices_lock, flags);
+        dev = gpio_devices[minor];
+        if (dev != NULL) {
+            kref_get(&dev->ref);
+        }
+        spin_unlock_irqrestore(&gpio_devices_lock, flags);
+        
+        if (dev == NULL) {
+            continue;
+        }
+        if (!dev->removed) {
+            gpio_poll_update(dev);
+        }
+        kref_put(&dev->ref, gpio_device_free);
+    }
+}
+
+/*
+ * IRQ trigger needed for an event/counter/reflex configuration
+ */
+static unsigned int gpio_trigger_for(struct gpio_device *dev, int counter_enabled,
+                                     const struct gpio_reflex *reflex)
+{
+    unsigned int type = dev->event_edges;
+    
+    /* The input cache, level watchers and gestures must see both edges to stay current */
+    if (counter_enabled || dev->input_cache || dev->level_watchers > 0 ||
+        (dev->gesture.flags & GPIO_GESTURE_ENABLE)) {
+        type = IRQ_TYPE_EDGE_BOTH;
+    }
+    
+    if (reflex->action != GPIO_REFLEX_NONE) {
+        type |= reflex->edge;
+    }
+    
+    return type | dev->eventfd_edges;
+}
+
+/*
+ * Reprogram the IRQ trigger
+ * Called with gpio_mutex held
+ */
+static int gpio_set_trigger(struct gpio_device *dev, unsigned int type)
+{
+    unsigned long flags;
+    int ret;
+    
+    /* Polled lines see both edges; event_edges filters them */
+    if (dev->irq <= 0) {
+        return 0;
+    }
+    
+    if (type == dev->trigger) {
+        return 0;
+    }
+    
+    ret = irq_set_irq_type(dev->irq, type);
+    if (ret != 0) {
+        printk(KERN_ERR "GPIO_DRIVER: Failed to set IRQ trigger (error: %d)\n", ret);
+        return ret;
+    }
+    
+    spin_lock_irqsave(&dev->lock, flags);
+    dev->trigger = type;
+    spin_unlock_irqrestore(&dev->lock, flags);
+    
+    return 0;
+}
+
+/*
+ * Enable or disable counter mode
+ * Switches the IRQ to both edges while counting
+ */
+static int gpio_set_counter(struct gpio_device *dev, int enable)
+{
+    unsigned long flags;
+    int ret;
+    
+    ret = gpio_set_trigger(dev, gpio_trigger_for(dev, enable, &dev->reflex));
+    if (ret != 0) {
+        return ret;
+    }
+    
+    spin_lock_irqsave(&dev->lock, flags);
+    dev->counter_enabled = enable ? 1 : 0;
+    if (enable) {
+        dev->edges = 0;
+        dev->rising = 0;
+        dev->falling = 0;
+        dev->last_rise_ns = 0;
+        dev->period_ns = 0;
+        dev->high_ns = 0;
+    }
+    gpio_publish_state(dev);
+    spin_unlock_irqrestore(&dev->lock, flags);
+    
+    gpio_poll_update(dev);
+    
+    printk(KERN_INFO "GPIO_DRIVER: Counter mode %s\n", enable ? "enabled" : "disabled");
+    return 0;
+}
+
+/*
+ * Install (or remove, with GPIO_REFLEX_NONE) the reflex rule of a line
+ * Called with gpio_mutex held
+ */
+static int gpio_set_reflex(struct gpio_device *dev, const struct gpio_reflex *rule)
+{
+    struct gpio_device *target = NULL;
+    struct device_node *np;
+    unsigned long flags;
+    int ret;
+    
+    if (rule->action > GPIO_REFLEX_PULSE) {
+        return -EINVAL;
+    }
+    
+    if (rule->action != GPIO_REFLEX_NONE) {
+        if (rule->edge == 0 || rule->edge > GPIO_EDGE_BOTH) {
+            return -EINVAL;
+        }
+        
+        if (rule->action == GPIO_REFLEX_PULSE &&
+            (rule->pulse_us == 0 || rule->pulse_us > GPIO_REFLEX_MAX_PULSE_US)) {
+            return -EINVAL;
+        }
+        
+        if (rule->target_line < 0 || rule->target_line >= GPIO_MAX_DEVICES ||
+            rule->target_line == dev->minor) {
+            return -EINVAL;
+        }
+        
+        spin_lock_irqsave(&gpio_devices_lock, flags);
+        target = gpio_devices[rule->target_line];
+        /* Expander targets are fine: the flush worker does the bus write */
+        ret = (target == NULL) ? -ENODEV : 0;
+        spin_unlock_irqrestore(&gpio_devices_lock, flags);
+        
+        if (ret != 0) {
+            printk(KERN_ERR "GPIO_DRIVER: Reflex target line %d unusable (error: %d)\n",
+                   rule->target_line, ret);
+            return ret;
+        }
+    }
+    
+    ret = gpio_set_trigger(dev, gpio_trigger_for(dev, dev->counter_enabled, rule));
+    if (ret != 0) {
+        return ret;
+    }
+    
+    /* An explicit rule replaces the Device Tree binding */
+    spin_lock_irqsave(&gpio_devices_lock, flags);
+    np = dev->reflex_np;
+    dev->reflex_np = NULL;
+    spin_lock(&dev->lock);
+    dev->reflex = *rule;
+    spin_unlock(&dev->lock);
+    spin_unlock_irqrestore(&gpio_devices_lock, flags);
+    
+    of_node_put(np);
+    
+    gpio_poll_update(dev);
+    
+    printk(KERN_INFO "GPIO_DRIVER: Reflex on GPIO %d: %s on %s edge -> line %d\n",
+           dev->gpio_number, gpio_reflex_actions[rule->action],
+           gpio_reflex_edges[rule->action ? rule->edge : 0], rule->target_line);
+    return 0;
+}
+
+/*
+ * Bind Device Tree reflex rules to their target lines
+ * Targets may probe in any order, so this runs after every probe
+ */
+static void gpio_resolve_reflexes(void)
+{
+    struct gpio_device *src;
+    struct gpio_device *target;
+    unsigned long flags;
+    int i;
+    int j;
+    
+    spin_lock_irqsave(&gpio_devices_lock, flags);
+    
+    for (i = 0; i < GPIO_MAX_DEVICES; i++) {
+        src = gpio_devices[i];
+        if (src == NULL || src->reflex_np == NULL || src->reflex.target_line >= 0) {
+            continue;
+        }
+        
+        for (j = 0; j < GPIO_MAX_DEVICES; j++) {
+            target = gpio_devices[j];
+            if (target != NULL && target != src && target->node == src->reflex_np) {
+                spin_lock(&src->lock);
+                src->reflex.target_line = target->minor;
+                spin_unlock(&src->lock);
+                printk(KERN_INFO "GPIO_DRIVER: Reflex GPIO %d -> GPIO %d bound\n",
+                       src->gpio_number, target->gpio_number);
+                break;
+            }
+        }
+    }
+    
+    spin_unlock_irqrestore(&gpio_devices_lock, flags);
+}
+
+/*
+ * Read the reflex rule of a Device Tree node
+ *
+ *   reflex-target = <&gpio_led>;
+ *   reflex-action = "toggle";        set | clear | toggle | pulse
+ *   reflex-edge = "falling";         rising | falling | both
+ *   reflex-pulse-us = <500>;
+ */
+static void gpio_parse_reflex(struct gpio_device *dev, struct device_node *node)
+{
+    const char *name;
+    u32 pulse_us = 0;
+    int action;
+    int edge = GPIO_EDGE_FALLING;
+    
+    dev->reflex.action = GPIO_REFLEX_NONE;
+    dev->reflex.target_line = -1;
+    
+    dev->reflex_np = of_parse_phandle(node, "reflex-target", 0);
+    if (dev->reflex_np == NULL) {
+        return;
+    }
+    
+    if (of_property_read_string(node, "reflex-action", &name) != 0 ||
+        (action = match_string(gpio_reflex_actions, ARRAY_SIZE(gpio_reflex_actions), name)) <= 0) {
+        printk(KERN_WARNING "GPIO_DRIVER: Missing or invalid reflex-action, reflex ignored\n");
+        goto invalid;
+    }
+    
+    if (of_property_read_string(node, "reflex-edge", &name) == 0) {
+        edge = match_string(gpio_reflex_edges, ARRAY_SIZE(gpio_reflex_edges), name);
+        if (edge <= 0) {
+            printk(KERN_WARNING "GPIO_DRIVER: Invalid reflex-edge '%s', reflex ignored\n", name);
+            goto invalid;
+        }
+    }
+    
+    of_property_read_u32(node, "reflex-pulse-us", &pulse_us);
+    if (action == GPIO_REFLEX_PULSE && (pulse_us == 0 || pulse_us > GPIO_REFLEX_MAX_PULSE_US)) {
+        printk(KERN_WARNING "GPIO_DRIVER: Invalid reflex-pulse-us, reflex ignored\n");
+        goto invalid;
+    }
+    
+    dev->reflex.action = action;
+    dev->reflex.edge = edge;
+    dev->reflex.pulse_us = pulse_us;
+    return;
+    
+invalid:
+    of_node_put(dev->reflex_np);
+    dev->reflex_np = NULL;
+}
+
+/*
+ * Check gesture settings from the Device Tree or GPIO_IOCTL_SET_GESTURE
+ */
+static int gpio_gesture_valid(const struct gpio_gesture *g)
+{
+    if ((g->flags & ~(GPIO_GESTURE_ENABLE | GPIO_GESTURE_ACTIVE_LOW)) != 0 ||
+        g->debounce_ms > GPIO_GESTURE_MAX_MS || g->long_press_ms > GPIO_GESTURE_MAX_MS ||
+        g->repeat_ms > GPIO_GESTURE_MAX_MS || g->double_click_ms > GPIO_GESTURE_MAX_MS) {
+        return -EINVAL;
+    }
+    
+    return 0;
+}
+
+/*
+ * Install gesture settings and start from the line's current level
+ * Called with gpio_mutex held
+ */
+static int gpio_set_gesture(struct gpio_device *dev, const struct gpio_gesture *g)
+{
+    int enable = g->flags & GPIO_GESTURE_ENABLE;
+    unsigned long flags;
+    int level;
+    int ret;
+    
+    ret = gpio_gesture_valid(g);
+    if (ret != 0) {
+        return ret;
+    }
+    
+    if (enable) {
+        ret = gpio_set_trigger(dev, IRQ_TYPE_EDGE_BOTH);
+        if (ret != 0) {
+            return ret;
+        }
+    }
+    
+    spin_lock_irqsave(&dev->lock, flags);
+    dev->gesture = *g;
+    dev->gesture.reserved = 0;
+    spin_unlock_irqrestore(&dev->lock, flags);
+    
+    /* Nothing half-recognised survives a change of settings */
+    hrtimer_cancel(&dev->debounce_timer);
+    hrtimer_cancel(&dev->hold_timer);
+    
+    level = gpio_line_sample(dev);
+    
+    spin_lock_irqsave(&dev->lock, flags);
+    dev->bouncing = 0;
+    dev->pressed = level ^ ((g->flags & GPIO_GESTURE_ACTIVE_LOW) ? 1 : 0);
+    dev->held = 0;
+    dev->click_armed = 0;
+    spin_unlock_irqrestore(&dev->lock, flags);
+    
+    if (!enable) {
+        ret = gpio_set_trigger(dev, gpio_trigger_for(dev, dev->counter_enabled, &dev->reflex));
+    }
+    
+    gpio_poll_update(dev);
+    
+    printk(KERN_INFO "GPIO_DRIVER: Gestures on GPIO %d %s\n", dev->gpio_number,
+           enable ? "enabled" : "disabled");
+    return ret;
+}
+
+/*
+ * Register (fd >= 0) or remove (fd = -1) the file's eventfd for edges
+ * A file has at most one eventfd per edge type; registering edges takes
+ * them away from the file's older registrations. A registration the IRQ
+ * trigger cannot follow is undone; a removal always stands.
+ * Called with gpio_mutex held
+ */
+static int gpio_set_eventfd(struct gpio_file *file, int fd, u32 edges)
+{
+    struct gpio_device *dev = file->dev;
+    struct gpio_eventfd_reg saved[GPIO_EVENTFD_MAX];
+    struct eventfd_ctx *drop[GPIO_EVENTFD_MAX];
+    struct eventfd_ctx *ctx = NULL;
+    struct eventfd_ctx *added = NULL;
+    struct gpio_eventfd_reg *reg;
+    u32 saved_edges;
+    unsigned long flags;
+    int ndrop = 0;
+    int slot = -1;
+    int ret = 0;
+    int i;
+    
+    if (edges == 0 || edges > GPIO_EDGE_BOTH) {
+        return -EINVAL;
+    }
+    
+    if (fd >= 0) {
+        ctx = eventfd_ctx_fdget(fd);
+        if (IS_ERR(ctx)) {
+            return PTR_ERR(ctx);
+        }
+    }
+    
+    spin_lock_irqsave(&dev->lock, flags);
+    
+    memcpy(saved, dev->eventfds, sizeof(saved));
+    saved_edges = dev->eventfd_edges;
+    
+    /* A slot is free, or is one of ours that loses all its edges */
+    for (i = 0; i < GPIO_EVENTFD_MAX && slot < 0; i++) {
+        reg = &dev->eventfds[i];
+        if (reg->ctx == NULL || (reg->owner == file && (reg->edges & ~edges) == 0)) {
+            slot = i;
+        }
+    }
+    
+    if (ctx != NULL && slot < 0) {
+        ret = -ENOSPC;
+    } else {
+        for (i = 0; i < GPIO_EVENTFD_MAX; i++) {
+            reg = &dev->eventfds[i];
+            if (reg->ctx == NULL || reg->owner != file) {
+                continue;
+            }
+            reg->edges &= ~edges;
+            if (reg->edges == 0) {
+                drop[ndrop++] = reg->ctx;
+                reg->ctx = NULL;
+            }
+        }
+        
+        if (ctx != NULL) {
+            reg = &dev->eventfds[slot];
+            reg->ctx = ctx;
+            reg->edges = edges;
+            reg->owner = file;
+            added = ctx;
+            ctx = NULL;
+        }
+        
+        dev->eventfd_edges = 0;
+        for (i = 0; i < GPIO_EVENTFD_MAX; i++) {
+            if (dev->eventfds[i].ctx != NULL) {
+                dev->eventfd_edges |= dev->eventfds[i].edges;
+            }
+        }
+    }
+    
+    spin_unlock_irqrestore(&dev->lock, flags);
+    
+    if (ret == 0) {
+        ret = gpio_set_trigger(dev, gpio_trigger_for(dev, dev->counter_enabled, &dev->reflex));
+        
+        /* Put back what the registration replaced; the caller sees no change */
+        if (ret != 0 && added != NULL) {
+            spin_lock_irqsave(&dev->lock, flags);
+            memcpy(dev->eventfds, saved, sizeof(saved));
+            dev->eventfd_edges = saved_edges;
+            spin_unlock_irqrestore(&dev->lock, flags);
+            ndrop = 0;
+            ctx = added;
+        }
+        gpio_poll_update(dev);
+    }
+    
+    for (i = 0; i < ndrop; i++) {
+        eventfd_ctx_put(drop[i]);
+    }
+    if (ctx != NULL) {
+        eventfd_ctx_put(ctx);
+    }
+    
+    return ret;
+}
+
+/*
+ * Read the gesture settings of a Device Tree node
+ *
+ *   gestures;                          enable the gesture layer
+ *   gesture-active-low;                pressed reads 0
+ *   gesture-debounce-ms = <20>;
+ *   gesture-long-press-ms = <800>;     0 = no LONG_PRESS/REPEAT
+ *   gesture-repeat-ms = <200>;         default 0 = no REPEAT
+ *   gesture-double-click-ms = <300>;   0 = no DOUBLE_CLICK
+ */
+static void gpio_parse_gesture(struct gpio_device *dev, struct device_node *node)
+{
+    struct gpio_gesture g = {
+        .flags = GPIO_GESTURE_ENABLE,
+        .debounce_ms = GPIO_GESTURE_DEBOUNCE_MS,
+        .long_press_ms = GPIO_GESTURE_LONG_PRESS_MS,
+        .double_click_ms = GPIO_GESTURE_DOUBLE_CLICK_MS,
+    };
+    
+    if (!of_property_read_bool(node, "gestures")) {
+        return;
+    }
+    
+    if (of_property_read_bool(node, "gesture-active-low")) {
+        g.flags |= GPIO_GESTURE_ACTIVE_LOW;
+    }
+    of_property_read_u32(node, "gesture-debounce-ms", &g.debounce_ms);
+    of_property_read_u32(node, "gesture-long-press-ms", &g.long_press_ms);
+    of_property_read_u32(node, "gesture-repeat-ms", &g.repeat_ms);
+    of_property_read_u32(node, "gesture-double-click-ms", &g.double_click_ms);
+    
+    if (gpio_gesture_valid(&g) != 0) {
+        printk(KERN_WARNING "GPIO_DRIVER: Invalid gesture settings (max %u ms), gestures ignored\n",
+               GPIO_GESTURE_MAX_MS);
+        return;
+    }
+    
+    dev->gesture = g;
+}
+
+/*
+ * Snapshot counter state and derive frequency and duty cycle
+ */
+static void gpio_get_counter(struct gpio_device *dev, struct gpio_counter_info *info)
+{
+    unsigned long flags;
+    u64 now = ktime_get_ns();
+    
+    memset(info, 0, sizeof(*info));
+    
+    spin_lock_irqsave(&dev->lock, flags);
+    info->enabled = dev->counter_enabled;
+    info->edges = dev->edges;
+    info->rising = dev->rising;
+    info->falling = dev->falling;
+    info->last_edge_ns = dev->last_edge_ns;
+    info->period_ns = dev->period_ns;
+    info->high_ns = dev->high_ns;
+    spin_unlock_irqrestore(&dev->lock, flags);
+    
+    /* No edge for two periods: the signal stopped */
+    if (info->period_ns == 0 || now - info->last_edge_ns > 2 * info->period_ns) {
+        return;
+    }
+    
+    info->frequency_millihz = div64_u64(1000000000000ULL, info->period_ns);
+    info->duty_permille = (u32)div64_u64(min(info->high_ns, info->period_ns) * 1000,
+                                         info->period_ns);
+}
+
+/*
+ * Fill a full state snapshot for GPIO_IOCTL_GET_STATE
+ * Called with gpio_mutex held
+ */
+static void gpio_get_state(struct gpio_device *dev, struct gpio_state *state)
+{
+    unsigned long flags;
+    
+    memset(state, 0, sizeof(*state));
+    state->version = GPIO_STATE_VERSION;
+    state->line = dev->minor;
+    state->gpio = dev->gpio_number;
+    
+    /* Inputs are sampled live (or cached); outputs report the last written level */
+    if (dev->direction == GPIO_DIRECTION_INPUT) {
+        dev->value = gpio_line_get(dev);
+    }
+    
+    spin_lock_irqsave(&dev->lock, flags);
+    state->value = dev->value;
+    state->direction = dev->direction;
+    state->trigger = (dev->irq > 0) ? dev->trigger : 0;
+    state->flags = (dev->irq > 0 ? GPIO_STATE_HAS_IRQ : 0) |
+                   (dev->counter_enabled ? GPIO_STATE_COUNTER : 0) |
+                   (dev->reflex.action != GPIO_REFLEX_NONE ? GPIO_STATE_REFLEX : 0) |
+                   (dev->cansleep ? GPIO_STATE_EXPANDER : 0) |
+                   (dev->irq <= 0 ? GPIO_STATE_POLLED : 0) |
+                   ((dev->gesture.flags & GPIO_GESTURE_ENABLE) ? GPIO_STATE_GESTURE : 0);
+    state->edges = dev->edges;
+    state->rising = dev->rising;
+    state->falling = dev->falling;
+    state->last_edge_ns = dev->last_edge_ns;
+    spin_unlock_irqrestore(&dev->lock, flags);
+}
+
+/*
+ * GPIO_IOCTL_GET_STATE
+ * The caller's size field picks how much of the struct is copied, so old
+ * binaries keep working when the struct grows and new binaries can tell
+ * from the returned size which fields an older driver filled
+ */
+static long gpio_ioctl_get_state(struct gpio_device *dev, unsigned long arg)
+{
+    struct gpio_state __user *ustate = (struct gpio_state __user *)arg;
+    struct gpio_state state;
+    u32 size;
+    
+    if (get_user(size, &ustate->size) != 0) {
+        return -EFAULT;
+    }
+    
+    if (size < GPIO_STATE_SIZE_VER1) {
+        printk(KERN_ERR "GPIO_DRIVER: GET_STATE size %u too small\n", size);
+        return -EINVAL;
+    }
+    
+    gpio_get_state(dev, &state);
+    state.size = min_t(u32, size, sizeof(state));
+    
+    if (copy_to_user(ustate, &state, state.size) != 0) {
+        printk(KERN_ERR "GPIO_DRIVER: Failed to copy state to user\n");
+        return -EFAULT;
+    }
+    
+    return 0;
+}
+
+/*
+ * Wait for the line to reach a level, busy-polling when atomic
+ * Returns the level, or -ETIMEDOUT
+ */
+static int gpio_op_wait_level(struct gpio_device *dev, int level, u64 timeout_ns, bool atomic)
+{
+    u64 deadline = ktime_get_ns() + timeout_ns;
+    int value;
+    
+    for (;;) {
+        value = gpio_line_sample(dev);
+        if (value == level) {
+            return value;
+        }
+        
+        if (ktime_get_ns() >= deadline) {
+            return -ETIMEDOUT;
+        }
+        
+        if (atomic) {
+            cpu_relax();
+        } else {
+            usleep_range(10, 20);
+        }
+    }
+}
+
+/*
+ * Delay between operations; short delays always spin for accuracy
+ */
+static void gpio_op_delay(u64 ns, bool atomic)
+{
+    if (atomic || ns < 20000) {
+        while (ns > 1000000) {
+            mdelay(1);
+            ns -= 1000000;
+        }
+        ndelay(ns);
+    } else {
+        usleep_range(div_u64(ns, 1000), div_u64(ns, 1000) + 10);
+    }
+}
+
+/*
+ * Run a batch of operations in one kernel entry
+ * Called with gpio_mutex held; stops at the first failing op
+ */
+static int gpio_run_ops(struct gpio_device *dev, struct gpio_op_list *list, struct gpio_op *ops)
+{
+    bool atomic = list->flags & GPIO_OPS_ATOMIC;
+    u64 limit = atomic ? GPIO_OPS_ATOMIC_MAX_NS : GPIO_OPS_MAX_NS;
+    unsigned long flags;
+    u64 budget = 0;
+    u64 start;
+    int value = dev->value;
+    int err = 0;
+    u32 i;
+    
+    /* Validate everything up front so a bad list has no side effects */
+    for (i = 0; i < list->count; i++) {
+        switch (ops[i].code) {
+        case GPIO_OP_SET:
+        case GPIO_OP_TOGGLE:
+            if (dev->direction != GPIO_DIRECTION_OUTPUT) {
+                return -EACCES;
+            }
+            break;
+        case GPIO_OP_GET:
+            break;
+        case GPIO_OP_WAIT_LEVEL:
+        case GPIO_OP_DELAY_NS:
+            /* A wrapped sum would pass the budget check and spin for ages */
+            if (ops[i].ns > limit || check_add_overflow(budget, ops[i].ns, &budget)) {
+                return -EINVAL;
+            }
+            break;
+        default:
+            return -EINVAL;
+        }
+    }
+    
+    if (budget > limit ||
+        (atomic && gpio_cansleep(dev->gpio_number))) {
+        return -EINVAL;
+    }
+    
+    if (atomic) {
+        preempt_disable();
+    }
+    
+    start = ktime_get_ns();
+    
+    for (i = 0; i < list->count && err == 0; i++) {
+        struct gpio_op *op = &ops[i];
+        
+        switch (op->code) {
+        case GPIO_OP_SET:
+            value = op->arg ? 1 : 0;
+            gpio_line_set_now(dev, value);
+            op->result = value;
+            break;
+        case GPIO_OP_TOGGLE:
+            value = !value;
+            gpio_line_set_now(dev, value);
+            op->result = value;
+            break;
+        case GPIO_OP_GET:
+            op->result = gpio_line_sample(dev);
+            break;
+        case GPIO_OP_WAIT_LEVEL:
+            op->result = gpio_op_wait_level(dev, op->arg ? 1 : 0, op->ns, atomic);
+            if (op->result < 0) {
+                err = op->result;
+            }
+            break;
+        case GPIO_OP_DELAY_NS:
+            gpio_op_delay(op->ns, atomic);
+            op->result = 0;
+            break;
+        }
+        
+        op->timestamp_ns = ktime_get_ns();
+    }
+    
+    if (atomic) {
+        preempt_enable();
+    }
+    
+    list->completed = i;
+    list->error = err;
+    list->duration_ns = (i > 0) ? ops[i - 1].timestamp_ns - start : 0;
+    
+    if (dev->direction == GPIO_DIRECTION_OUTPUT) {
+        spin_lock_irqsave(&dev->lock, flags);
+        dev->value = value;
+        gpio_publish_state(dev);
+        spin_unlock_irqrestore(&dev->lock, flags);
+    }
+    
+    return 0;
+}
+
+/*
+ * GPIO_IOCTL_RUN_OPS: copy the list in, run it, copy results back
+ */
+static long gpio_ioctl_run_ops(struct gpio_device *dev, unsigned long arg)
+{
+    struct gpio_op_list __user *ulist = (struct gpio_op_list __user *)arg;
+    struct gpio_op_list list;
+    struct gpio_op *ops;
+    long ret;
+    
+    if (copy_from_user(&list, ulist, sizeof(list)) != 0) {
+        return -EFAULT;
+    }
+    
+    if (list.count == 0 || list.count > GPIO_OPS_MAX || (list.flags & ~GPIO_OPS_ATOMIC)) {
+        return -EINVAL;
+    }
+    
+    ops = memdup_user(u64_to_user_ptr(list.ops), list.count * sizeof(*ops));
+    if (IS_ERR(ops)) {
+        return PTR_ERR(ops);
+    }
+    
+    ret = gpio_run_ops(dev, &list, ops);
+    if (ret == 0 &&
+        (copy_to_user(u64_to_user_ptr(list.ops), ops, list.count * sizeof(*ops)) != 0 ||
+         copy_to_user(ulist, &list, sizeof(list)) != 0)) {
+        ret = -EFAULT;
+    }
+    
+    kfree(ops);
+    return ret;
+}
+
+/*
+ * Timed output
+ * Pending changes sit in dev->timed; timed_timer is kept armed (absolute
+ * CLOCK_MONOTONIC) for the earliest of them. Slots and the timer are only
+ * touched under dev->lock, so the ioctl and the callback can both re-arm.
+ */
+
+/*
+ * Arm the timer for the earliest pending change, if any
+ * Caller holds dev->lock
+ */
+static void gpio_timed_arm(struct gpio_device *dev)
+{
+    u64 earliest = U64_MAX;
+    int i;
+    
+    for (i = 0; i < GPIO_TIMED_MAX; i++) {
+        if (dev->timed[i].id != 0 && dev->timed[i].at_ns < earliest) {
+            earliest = dev->timed[i].at_ns;
+        }
+    }
+    
+    /* gpio_ioctl_schedule keeps at_ns <= KTIME_MAX, so this never goes negative */
+    if (earliest != U64_MAX) {
+        hrtimer_start(&dev->timed_timer, ns_to_ktime(min_t(u64, earliest, KTIME_MAX)),
+                      HRTIMER_MODE_ABS);
+    }
+}
+
+/*
+ * Retire a slot with its outcome
+ * Caller holds dev->lock
+ */
+static void gpio_timed_retire(struct gpio_device *dev, struct gpio_timed_slot *slot,
+                              int result, u64 fired_ns)
+{
+    struct gpio_timed_done *done = &dev->timed_done[slot->id % GPIO_TIMED_HISTORY];
+    
+    done->id = slot->id;
+    done->result = result;
+    done->fired_ns = fired_ns;
+    slot->id = 0;
+}
+
+/*
+ * Timed output timer: apply every due change, earliest first, then
+ * re-arm for the next one
+ */
+static enum hrtimer_restart gpio_timed_fire(struct hrtimer *timer)
+{
+    struct gpio_device *dev = container_of(timer, struct gpio_device, timed_timer);
+    struct gpio_timed_slot *next;
+    unsigned long flags;
+    int fired = 0;
+    u64 now;
+    int i;
+    
+    spin_lock_irqsave(&dev->lock, flags);
+    
+    now = ktime_get_ns();
+    for (;;) {
+        next = NULL;
+        for (i = 0; i < GPIO_TIMED_MAX; i++) {
+            if (dev->timed[i].id != 0 && dev->timed[i].at_ns <= now &&
+                (next == NULL || dev->timed[i].at_ns < next->at_ns ||
+                 (dev->timed[i].at_ns == next->at_ns && dev->timed[i].id < next->id))) {
+                next = &dev->timed[i];
+            }
+        }
+        
+        if (next == NULL) {
+            break;
+        }
+        
+        if (dev->direction == GPIO_DIRECTION_OUTPUT) {
+            gpio_line_set(dev, next->value);
+            gpio_timed_retire(dev, next, 0, ktime_get_ns());
+        } else {
+            gpio_timed_retire(dev, next, -EACCES, 0);
+        }
+        fired++;
+    }
+    
+    if (fired != 0) {
+        gpio_publish_state(dev);
+    }
+    gpio_timed_arm(dev);
+    
+    spin_unlock_irqrestore(&dev->lock, flags);
+    
+    if (fired != 0) {
+        wake_up_all(&dev->timed_wait);
+    }
+    
+    return HRTIMER_NORESTART;
+}
+
+/*
+ * Cancel the pending changes of one file, or of all files (file NULL)
+ */
+static void gpio_timed_cancel(struct gpio_device *dev, struct gpio_file *file)
+{
+    unsigned long flags;
+    int cancelled = 0;
+    int i;
+    
+    spin_lock_irqsave(&dev->lock, flags);
+    
+    for (i = 0; i < GPIO_TIMED_MAX; i++) {
+        if (dev->timed[i].id != 0 && (file == NULL || dev->timed[i].owner == file)) {
+            gpio_timed_retire(dev, &dev->timed[i], -ECANCELED, 0);
+            cancelled++;
+        }
+    }
+    
+    spin_unlock_irqrestore(&dev->lock, flags);
+    
+    /* The timer may now be early or idle; a spurious expiry finds nothing due */
+    if (cancelled != 0) {
+        wake_up_all(&dev->timed_wait);
+    }
+}
+
+/*
+ * Fill in the outcome of change->id
+ * Caller holds dev->lock
+ */
+static void gpio_timed_lookup(struct gpio_device *dev, struct gpio_timed *change)
+{
+    struct gpio_timed_done *done = &dev->timed_done[change->id % GPIO_TIMED_HISTORY];
+    int i;
+    
+    change->fired_ns = 0;
+    
+    for (i = 0; i < GPIO_TIMED_MAX; i++) {
+        if (change->id != 0 && dev->timed[i].id == change->id) {
+            change->result = -EINPROGRESS;
+            return;
+        }
+    }
+    
+    if (change->id == 0 || done->id != change->id) {
+        change->result = -ENOENT;
+        return;
+    }
+    
+    change->result = done->result;
+    change->fired_ns = done->fired_ns;
+}
+
+/* All of the list's changes have left the queue */
+static bool gpio_timed_settled(struct gpio_device *dev, const struct gpio_timed *changes,
+                               u32 count)
+{
+    unsigned long flags;
+    bool settled = true;
+    u32 n;
+    int i;
+    
+    spin_lock_irqsave(&dev->lock, flags);
+    for (n = 0; n < count && settled; n++) {
+        for (i = 0; i < GPIO_TIMED_MAX; i++) {
+            if (dev->timed[i].id == changes[n].id) {
+                settled = false;
+                break;
+            }
+        }
+    }
+    spin_unlock_irqrestore(&dev->lock, flags);
+    
+    return settled;
+}
+
+/*
+ * GPIO_IOCTL_SCHEDULE: queue the changes (all or none), hand back their
+ * ids and, with GPIO_TIMED_WAIT, sleep until they have fired
+ * Called without gpio_mutex, so a waiter does not hold up other ioctls
+ */
+static long gpio_ioctl_schedule(struct gpio_file *file, unsigned long arg)
+{
+    struct gpio_device *dev = file->dev;
+    struct gpio_timed_list list;
+    struct gpio_timed *changes;
+    unsigned long flags;
+    long ret = 0;
+    u32 n;
+    int slots = 0;
+    int i;
+    
+    if (copy_from_user(&list, (struct gpio_timed_list __user *)arg, sizeof(list)) != 0) {
+        return -EFAULT;
+    }
+    
+    if (list.count == 0 || list.count > GPIO_TIMED_MAX || (list.flags & ~GPIO_TIMED_WAIT)) {
+        return -EINVAL;
+    }
+    
+    changes = memdup_user(u64_to_user_ptr(list.changes), list.count * sizeof(*changes));
+    if (IS_ERR(changes)) {
+        return PTR_ERR(changes);
+    }
+    
+    /* Beyond KTIME_MAX the ABS timer would expire at once and re-arm forever */
+    for (n = 0; n < list.count; n++) {
+        if (changes[n].at_ns > KTIME_MAX) {
+            kfree(changes);
+            return -EINVAL;
+        }
+    }
+    
+    /* Direction changes are serialised by gpio_mutex */
+    mutex_lock(&gpio_mutex);
+    spin_lock_irqsave(&dev->lock, flags);
+    
+    for (i = 0; i < GPIO_TIMED_MAX; i++) {
+        slots += (dev->timed[i].id == 0);
+    }
+    
+    /* Fired from the hrtimer, so the line must not sleep */
+    if (dev->removed) {
+        ret = -ENODEV;
+    } else if (dev->cansleep) {
+        ret = -EOPNOTSUPP;
+    } else if (dev->direction != GPIO_DIRECTION_OUTPUT) {
+        ret = -EACCES;
+    } else if (slots < (int)list.count) {
+        ret = -ENOSPC;
+    } else {
+        for (n = 0, i = 0; n < list.count; i++) {
+            if (dev->timed[i].id != 0) {
+                continue;
+            }
+            changes[n].id = ++dev->timed_ids;
+            changes[n].result = -EINPROGRESS;
+            changes[n].fired_ns = 0;
+            dev->timed[i].id = changes[n].id;
+            dev->timed[i].at_ns = changes[n].at_ns;
+            dev->timed[i].value = changes[n].value ? 1 : 0;
+            dev->timed[i].owner = file;
+            n++;
+        }
+        gpio_timed_arm(dev);
+    }
+    
+    spin_unlock_irqrestore(&dev->lock, flags);
+    mutex_unlock(&gpio_mutex);
+    
+    /* Interrupted waits return -EINTR, not a restart that would queue twice */
+    if (ret == 0 && (list.flags & GPIO_TIMED_WAIT) &&
+        wait_event_interruptible(dev->timed_wait,
+                                 gpio_timed_settled(dev, changes, list.count)) != 0) {
+        ret = -EINTR;
+    }
+    
+    if (ret == 0 || ret == -EINTR) {
+        if (list.flags & GPIO_TIMED_WAIT) {
+            spin_lock_irqsave(&dev->lock, flags);
+            for (n = 0; n < list.count; n++) {
+                gpio_timed_lookup(dev, &changes[n]);
+            }
+            spin_unlock_irqrestore(&dev->lock, flags);
+        }
+        
+        /* Ids go back even when interrupted, for GPIO_IOCTL_GET_TIMED */
+        if (copy_to_user(u64_to_user_ptr(list.changes), changes,
+                         list.count * sizeof(*changes)) != 0) {
+            ret = -EFAULT;
+        }
+    }
+    
+    kfree(changes);
+    return ret;
+}
+
+/*
+ * GPIO_IOCTL_GET_TIMED: outcome of each listed id
+ */
+static long gpio_ioctl_get_timed(struct gpio_device *dev, unsigned long arg)
+{
+    struct gpio_timed_list list;
+    struct gpio_timed *changes;
+    unsigned long flags;
+    long ret = 0;
+    u32 n;
+    
+    if (copy_from_user(&list, (struct gpio_timed_list __user *)arg, sizeof(list)) != 0) {
+        return -EFAULT;
+    }
+    
+    if (list.count == 0 || list.count > GPIO_TIMED_MAX || list.flags != 0) {
+        return -EINVAL;
+    }
+    
+    changes = memdup_user(u64_to_user_ptr(list.changes), list.count * sizeof(*changes));
+    if (IS_ERR(changes)) {
+        return PTR_ERR(changes);
+    }
+    
+    spin_lock_irqsave(&dev->lock, flags);
+    for (n = 0; n < list.count; n++) {
+        gpio_timed_lookup(dev, &changes[n]);
+    }
+    spin_unlock_irqrestore(&dev->lock, flags);
+    
+    if (copy_to_user(u64_to_user_ptr(list.changes), changes,
+                     list.count * sizeof(*changes)) != 0) {
+        ret = -EFAULT;
+    }
+    
+    kfree(changes);
+    return ret;
+}
+
+/*
+ * Event filters (classic BPF subset)
+ * A program is checked once when attached: every opcode must be one the
+ * interpreter implements, loads stay inside struct gpio_filter_ctx and
+ * M[], jumps only go forward and the last instruction returns. It then
+ * runs from the file's judge work without further checks, except
+ * division by X.
+ */
+struct gpio_filter_prog {
+    u32 count;
+    struct sock_filter insns[];
+};
+
+static int gpio_filter_check(const struct sock_filter *insns, u32 count)
+{
+    const struct sock_filter *ins;
+    u32 remaining;
+    u32 size;
+    u32 pc;
+    
+    if (count == 0 || count > GPIO_FILTER_MAX_INSNS ||
+        BPF_CLASS(insns[count - 1].code) != BPF_RET) {
+        return -EINVAL;
+    }
+    
+    for (pc = 0; pc < count; pc++) {
+        ins = &insns[pc];
+        remaining = count - pc - 1;
+        
+        switch (ins->code) {
+        case BPF_LD | BPF_W | BPF_ABS:
+        case BPF_LD | BPF_H | BPF_ABS:
+        case BPF_LD | BPF_B | BPF_ABS:
+            size = (BPF_SIZE(ins->code) == BPF_W) ? 4 : (BPF_SIZE(ins->code) == BPF_H) ? 2 : 1;
+            if (ins->k % size != 0 || ins->k > sizeof(struct gpio_filter_ctx) - size) {
+                return -EINVAL;
+            }
+            break;
+        case BPF_LD | BPF_MEM:
+        case BPF_LDX | BPF_MEM:
+        case BPF_ST:
+        case BPF_STX:
+            if (ins->k >= GPIO_FILTER_MEMWORDS) {
+                return -EINVAL;
+            }
+            break;
+        case BPF_ALU | BPF_DIV | BPF_K:
+        case BPF_ALU | BPF_MOD | BPF_K:
+            if (ins->k == 0) {
+                return -EINVAL;
+            }
+            break;
+        case BPF_ALU | BPF_LSH | BPF_K:
+        case BPF_ALU | BPF_RSH | BPF_K:
+            if (ins->k >= 32) {
+                return -EINVAL;
+            }
+            break;
+        case BPF_JMP | BPF_JA:
+            if (ins->k >= remaining) {
+                return -EINVAL;
+            }
+            break;
+        case BPF_JMP | BPF_JEQ | BPF_K:
+        case BPF_JMP | BPF_JEQ | BPF_X:
+        case BPF_JMP | BPF_JGT | BPF_K:
+        case BPF_JMP | BPF_JGT | BPF_X:
+        case BPF_JMP | BPF_JGE | BPF_K:
+        case BPF_JMP | BPF_JGE | BPF_X:
+        case BPF_JMP | BPF_JSET | BPF_K:
+        case BPF_JMP | BPF_JSET | BPF_X:
+            if (ins->jt >= remaining || ins->jf >= remaining) {
+                return -EINVAL;
+            }
+            break;
+        case BPF_LD | BPF_W | BPF_LEN:
+        case BPF_LDX | BPF_W | BPF_LEN:
+        case BPF_LD | BPF_IMM:
+        case BPF_LDX | BPF_IMM:
+        case BPF_ALU | BPF_ADD | BPF_K:
+        case BPF_ALU | BPF_ADD | BPF_X:
+        case BPF_ALU | BPF_SUB | BPF_K:
+        case BPF_ALU | BPF_SUB | BPF_X:
+        case BPF_ALU | BPF_MUL | BPF_K:
+        case BPF_ALU | BPF_MUL | BPF_X:
+        case BPF_ALU | BPF_DIV | BPF_X:
+        case BPF_ALU | BPF_MOD | BPF_X:
+        case BPF_ALU | BPF_AND | BPF_K:
+        case BPF_ALU | BPF_AND | BPF_X:
+        case BPF_ALU | BPF_OR | BPF_K:
+        case BPF_ALU | BPF_OR | BPF_X:
+        case BPF_ALU | BPF_XOR | BPF_K:
+        case BPF_ALU | BPF_XOR | BPF_X:
+        case BPF_ALU | BPF_LSH | BPF_X:
+        case BPF_ALU | BPF_RSH | BPF_X:
+        case BPF_ALU | BPF_NEG:
+        case BPF_RET | BPF_K:
+        case BPF_RET | BPF_A:
+        case BPF_MISC | BPF_TAX:
+        case BPF_MISC | BPF_TXA:
+            break;
+        default:
+            return -EINVAL;
+        }
+    }
+    
+    return 0;
+}
+
+/*
+ * Run a checked program; mem is the file's persistent M[]
+ * Returns: The program's return value, 0 (reject) on division by zero
+ */
+static u32 gpio_filter_run(const struct gpio_filter_prog *prog, u32 *mem,
+                           const struct gpio_filter_ctx *ctx)
+{
+    const u8 *data = (const u8 *)ctx;
+    const struct sock_filter *ins;
+    u32 A = 0;
+    u32 X = 0;
+    u32 pc;
+    
+    for (pc = 0; pc < prog->count; pc++) {
+        ins = &prog->insns[pc];
+        
+        switch (ins->code) {
+        case BPF_LD | BPF_W | BPF_ABS:      A = *(const u32 *)(data + ins->k); break;
+        case BPF_LD | BPF_H | BPF_ABS:      A = *(const u16 *)(data + ins->k); break;
+        case BPF_LD | BPF_B | BPF_ABS:      A = data[ins->k]; break;
+        case BPF_LD | BPF_W | BPF_LEN:      A = sizeof(*ctx); break;
+        case BPF_LDX | BPF_W | BPF_LEN:     X = sizeof(*ctx); break;
+        case BPF_LD | BPF_IMM:              A = ins->k; break;
+        case BPF_LDX | BPF_IMM:             X = ins->k; break;
+        case BPF_LD | BPF_MEM:              A = mem[ins->k]; break;
+        case BPF_LDX | BPF_MEM:             X = mem[ins->k]; break;
+        case BPF_ST:                        mem[ins->k] = A; break;
+        case BPF_STX:                       mem[ins->k] = X; break;
+        case BPF_ALU | BPF_ADD | BPF_K:     A += ins->k; break;
+        case BPF_ALU | BPF_ADD | BPF_X:     A += X; break;
+        case BPF_ALU | BPF_SUB | BPF_K:     A -= ins->k; break;
+        case BPF_ALU | BPF_SUB | BPF_X:     A -= X; break;
+        case BPF_ALU | BPF_MUL | BPF_K:     A *= ins->k; break;
+        case BPF_ALU | BPF_MUL | BPF_X:     A *= X; break;
+        case BPF_ALU | BPF_DIV | BPF_K:     A /= ins->k; break;
+        case BPF_ALU | BPF_MOD | BPF_K:     A %= ins->k; break;
+        case BPF_ALU | BPF_AND | BPF_K:     A &= ins->k; break;
+        case BPF_ALU | BPF_AND | BPF_X:     A &= X; break;
+        case BPF_ALU | BPF_OR | BPF_K:      A |= ins->k; break;
+        case BPF_ALU | BPF_OR | BPF_X:      A |= X; break;
+        case BPF_ALU | BPF_XOR | BPF_K:     A ^= ins->k; break;
+        case BPF_ALU | BPF_XOR | BPF_X:     A ^= X; break;
+        case BPF_ALU | BPF_LSH | BPF_K:     A <<= ins->k; break;
+        case BPF_ALU | BPF_LSH | BPF_X:     A = (X < 32) ? A << X : 0; break;
+        case BPF_ALU | BPF_RSH | BPF_K:     A >>= ins->k; break;
+        case BPF_ALU | BPF_RSH | BPF_X:     A = (X < 32) ? A >> X : 0; break;
+        case BPF_ALU | BPF_NEG:             A = -A; break;
+        case BPF_ALU | BPF_DIV | BPF_X:
+            if (X == 0) {
+                return 0;
+            }
+            A /= X;
+            break;
+        case BPF_ALU | BPF_MOD | BPF_X:
+            if (X == 0) {
+                return 0;
+            }
+            A %= X;
+            break;
+        case BPF_JMP | BPF_JA:              pc += ins->k; break;
+        case BPF_JMP | BPF_JEQ | BPF_K:     pc += (A == ins->k) ? ins->jt : ins->jf; break;
+        case BPF_JMP | BPF_JEQ | BPF_X:     pc += (A == X) ? ins->jt : ins->jf; break;
+        case BPF_JMP | BPF_JGT | BPF_K:     pc += (A > ins->k) ? ins->jt : ins->jf; break;
+        case BPF_JMP | BPF_JGT | BPF_X:     pc += (A > X) ? ins->jt : ins->jf; break;
+        case BPF_JMP | BPF_JGE | BPF_K:     pc += (A >= ins->k) ? ins->jt : ins->jf; break;
+        case BPF_JMP | BPF_JGE | BPF_X:     pc += (A >= X) ? ins->jt : ins->jf; break;
+        case BPF_JMP | BPF_JSET | BPF_K:    pc += (A & ins->k) ? ins->jt : ins->jf; break;
+        case BPF_JMP | BPF_JSET | BPF_X:    pc += (A & X) ? ins->jt : ins->jf; break;
+        case BPF_RET | BPF_K:               return ins->k;
+        case BPF_RET | BPF_A:               return A;
+        case BPF_MISC | BPF_TAX:            X = A; break;
+        case BPF_MISC | BPF_TXA:            A = X; break;
+        default:                            return 0;
+        }
+    }
+    
+    return 0;
+}
+
+/*
+ * Count, and with a filter judge, every event this file has not seen yet.
+ * The CPU rings are merged into timestamp order, as read() delivers them,
+ * so a filter's M[] state sees one ordered stream. Runs from the file's
+ * judge work with filter_lock held: the interpreter runs with interrupts
+ * on and outside the rings' queue locks.
+ * Returns: Number of events the file accepts
+ */
+static int gpio_file_judge(struct gpio_file *file)
+{
+    struct gpio_filter_ctx ctx;
+    struct gpio_event_ring *ring;
+    struct gpio_event_ring *best_ring = NULL;
+    struct gpio_file_cpu *best;
+    struct gpio_file_cpu *fc;
+    u32 mask = READ_ONCE(file->line_mask);
+    u64 best_ts = 0;
+    u64 ts;
+    u64 pos;
+    bool keep;
+    int accepted = 0;
+    int cpu;
+    
+    /* Stop at the heads seen now; later events queue the work again */
+    for_each_possible_cpu(cpu) {
+        fc = &file->cpus[cpu];
+        fc->judge_end = smp_load_acquire(&gpio_event_rings[cpu]->head);
+        if (fc->judge_end - fc->judged > GPIO_EVENT_RING_SIZE) {
+            smp_store_release(&fc->judged, fc->judge_end - GPIO_EVENT_RING_SIZE);
+        }
+    }
+    
+    memset(&ctx, 0, sizeof(ctx));
+    for (;;) {
+        best = NULL;
+        for_each_possible_cpu(cpu) {
+            fc = &file->cpus[cpu];
+            if (fc->judged == fc->judge_end) {
+                continue;
+            }
+            ring = gpio_event_rings[cpu];
+            ts = READ_ONCE(ring->events[fc->judged & (GPIO_EVENT_RING_SIZE - 1)].timestamp_ns);
+            if (best == NULL || ts < best_ts) {
+                best = fc;
+                best_ring = ring;
+                best_ts = ts;
+            }
+        }
+        
+        if (best == NULL) {
+            break;
+        }
+        
+        /* Snapshot the slot; one the writer overwrote meanwhile is lost anyway */
+        pos = best->judged;
+        ctx.event = best_ring->events[pos & (GPIO_EVENT_RING_SIZE - 1)];
+        smp_rmb();
+        keep = READ_ONCE(best_ring->head) - pos < GPIO_EVENT_RING_SIZE &&
+               (mask & BIT(ctx.event.line));
+        
+        if (keep && file->filter != NULL) {
+            ctx.event.lost = 0;
+            ctx.duration_us = (u32)min_t(u64, div_u64(ctx.event.duration_ns, 1000), U32_MAX);
+            keep = gpio_filter_run(file->filter, file->filter_mem, &ctx) != 0;
+        }
+        
+        if (keep) {
+            __set_bit(pos & (GPIO_EVENT_RING_SIZE - 1), best->verdict);
+            accepted++;
+        } else {
+            __clear_bit(pos & (GPIO_EVENT_RING_SIZE - 1), best->verdict);
+        }
+        
+        /* Verdicts before judged are visible to the reader (gpio_event_peek) */
+        smp_store_release(&best->judged, pos + 1);
+    }
+    
+    return accepted;
+}
+
+/*
+ * GPIO_IOCTL_SET_FILTER
+ * Swap the file's filter; the cursors jump to the present so that no
+ * unread event is left without a verdict
+ */
+static long gpio_ioctl_set_filter(struct gpio_file *file, unsigned long arg)
+{
+    struct gpio_filter_prog *prog = NULL;
+    struct gpio_filter_prog *old;
+    struct gpio_filter req;
+    struct gpio_file_cpu *fc;
+    u64 head;
+    int cpu;
+    int ret;
+    
+    if (copy_from_user(&req, (struct gpio_filter __user *)arg, sizeof(req)) != 0) {
+        return -EFAULT;
+    }
+    
+    if (req.reserved != 0 || req.count > GPIO_FILTER_MAX_INSNS) {
+        return -EINVAL;
+    }
+    
+    if (req.count != 0) {
+        prog = kmalloc(struct_size(prog, insns, req.count), GFP_KERNEL);
+        if (prog == NULL) {
+            return -ENOMEM;
+        }
+        prog->count = req.count;
+        
+        if (copy_from_user(prog->insns, u64_to_user_ptr(req.insns),
+                           req.count * sizeof(struct sock_filter)) != 0) {
+            kfree(prog);
+            return -EFAULT;
+        }
+        
+        ret = gpio_filter_check(prog->insns, prog->count);
+        if (ret != 0) {
+            printk(KERN_ERR "GPIO_DRIVER: Event filter rejected by the verifier\n");
+            kfree(prog);
+            return ret;
+        }
+    }
+    
+    if (mutex_lock_interruptible(&file->read_lock) != 0) {
+        kfree(prog);
+        return -ERESTARTSYS;
+    }
+    
+    mutex_lock(&file->filter_lock);
+    old = file->filter;
+    WRITE_ONCE(file->filter, prog);
+    memset(file->filter_mem, 0, sizeof(file->filter_mem));
+    for_each_possible_cpu(cpu) {
+        fc = &file->cpus[cpu];
+        head = smp_load_acquire(&gpio_event_rings[cpu]->head);
+        fc->cursor = head;
+        fc->judged = head;
+        fc->peeked = 0;
+    }
+    atomic_set(&file->pending, 0);
+    mutex_unlock(&file->filter_lock);
+    
+    mutex_unlock(&file->read_lock);
+    
+    kfree(old);
+    return 0;
+}
+
+/*
+ * Latency timer: the oldest pending event has waited max_latency_ns
+ */
+static enum hrtimer_restart gpio_latency_expired(struct hrtimer *timer)
+{
+    struct gpio_file *file = container_of(timer, struct gpio_file, latency_timer);
+    
+    WRITE_ONCE(file->expired, 1);
+    wake_up_interruptible(&file->wait);
+    
+    return HRTIMER_NORESTART;
+}
+
+/*
+ * Judge work of an event-mode file: counts the events the file will
+ * receive (those its filter accepts, if it has one) and wakes its reader
+ * only at the watermark; the first pending event arms the latency timer
+ * instead.
+ */
+static void gpio_file_judge_work(struct work_struct *work)
+{
+    struct gpio_file *file = container_of(work, struct gpio_file, judge_work);
+    int accepted;
+    int pending;
+    
+    mutex_lock(&file->filter_lock);
+    accepted = gpio_file_judge(file);
+    mutex_unlock(&file->filter_lock);
+    
+    if (accepted == 0) {
+        return;
+    }
+    
+    pending = atomic_add_return(accepted, &file->pending);
+    if (pending >= (int)READ_ONCE(file->watermark)) {
+        wake_up_interruptible(&file->wait);
+    } else if (pending == accepted && READ_ONCE(file->max_latency_ns) != 0) {
+        hrtimer_start(&file->latency_timer, ns_to_ktime(file->max_latency_ns),
+                      HRTIMER_MODE_REL);
+    }
+}
+
+/*
+ * Wake function of an event-mode file's entry on a CPU ring's queue,
+ * called from the ring's wake work (queue lock held, interrupts off).
+ * O(1): the file's judge work takes it from there, for all rings at once.
+ */
+static int gpio_file_wake(wait_queue_entry_t *entry, unsigned int mode, int flags, void *key)
+{
+    struct gpio_file_cpu *fc = container_of(entry, struct gpio_file_cpu, wake_entry);
+    
+    queue_work(system_highpri_wq, &fc->file->judge_work);
+    
+    return 0;
+}
+
+/*
+ * A CPU ring's wake work: run the wake functions of the event-mode files
+ */
+static void gpio_ring_wake(struct work_struct *work)
+{
+    struct gpio_event_ring *ring = container_of(work, struct gpio_event_ring, wake_work);
+    
+    wake_up_interruptible_all(&ring->wait);
+}
+
+/*
+ * Enter (on) or leave event mode. Only event-mode files sit on the rings'
+ * queues, so files reading levels or bitmaps cost an edge nothing. A file
+ * entering event mode starts at the present.
+ * Called with gpio_mutex held
+ */
+static void gpio_events_subscribe(struct gpio_file *file, bool on)
+{
+    struct gpio_file_cpu *fc;
+    int cpu;
+    
+    if (!on) {
+        for_each_possible_cpu(cpu) {
+            remove_wait_queue(&gpio_event_rings[cpu]->wait, &file->cpus[cpu].wake_entry);
+        }
+        /* Nothing queues the judge work any more, and only it re-arms the timer */
+        cancel_work_sync(&file->judge_work);
+        hrtimer_cancel(&file->latency_timer);
+        return;
+    }
+    
+    mutex_lock(&file->filter_lock);
+    for_each_possible_cpu(cpu) {
+        fc = &file->cpus[cpu];
+        fc->cursor = smp_load_acquire(&gpio_event_rings[cpu]->head);
+        fc->judged = fc->cursor;
+        fc->peeked = 0;
+    }
+    atomic_set(&file->pending, 0);
+    WRITE_ONCE(file->expired, 0);
+    mutex_unlock(&file->filter_lock);
+    
+    for_each_possible_cpu(cpu) {
+        add_wait_queue(&gpio_event_rings[cpu]->wait, &file->cpus[cpu].wake_entry);
+    }
+    /* An edge that missed the new entries is counted by this run of the work */
+    queue_work(system_highpri_wq, &file->judge_work);
+}
+
+/*
+ * Character Device: Open
+ * Called when /dev/gpio_dev is opened
+ */
+static int gpio_open(struct inode *inode, struct file *filp)
+{
+    struct gpio_device *dev;
+    struct gpio_file *file;
+    struct gpio_file_cpu *fc;
+    unsigned long flags;
+    int cpu;
+    
+    printk(KERN_INFO "GPIO_DRIVER: Device opened\n");
+    
+    /* Look the line up by minor: a device being removed is no longer listed */
+    spin_lock_irqsave(&gpio_devices_lock, flags);
+    dev = (iminor(inode) < GPIO_MAX_DEVICES) ? gpio_devices[iminor(inode)] : NULL;
+    if (dev != NULL) {
+        kref_get(&dev->ref);
+    }
+    spin_unlock_irqrestore(&gpio_devices_lock, flags);
+    
+    if (dev == NULL) {
+        return -ENODEV;
+    }
+    
+    file = kzalloc(sizeof(*file), GFP_KERNEL);
+    if (file == NULL) {
+        kref_put(&dev->ref, gpio_device_free);
+        return -ENOMEM;
+    }
+    
+    file->cpus = kcalloc(nr_cpu_ids, sizeof(*file->cpus), GFP_KERNEL);
+    if (file->cpus == NULL) {
+        kfree(file);
+        kref_put(&dev->ref, gpio_device_free);
+        return -ENOMEM;
+    }
+    
+    /* New readers start at the present and see only their own line */
+    file->dev = dev;
+    file->read_mode = GPIO_READ_VALUE;
+    file->timeout_ms = GPIO_TIMEOUT_INFINITE;
+    file->line_mask = BIT(dev->minor);
+    file->watermark = 1;
+    mutex_init(&file->read_lock);
+    mutex_init(&file->filter_lock);
+    INIT_WORK(&file->judge_work, gpio_file_judge_work);
+    init_waitqueue_head(&file->wait);
+    hrtimer_init(&file->latency_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    file->latency_timer.function = gpio_latency_expired;
+    
+    /* Queued on the rings only in event mode, see gpio_events_subscribe */
+    for_each_possible_cpu(cpu) {
+        fc = &file->cpus[cpu];
+        fc->file = file;
+        init_waitqueue_func_entry(&fc->wake_entry, gpio_file_wake);
+    }
+    filp->private_data = file;
+    
+    mutex_lock(&gpio_mutex);
+    
+    /* GPIO is already requested in probe(), just initialize flags */
+    if (!dev->removed) {
+        dev->value = gpio_line_get(dev);
+    }
+    
+    mutex_unlock(&gpio_mutex);
+    
+    return 0;
+}
+
+/*
+ * Character Device: Release/Close
+ * Called when /dev/gpio_dev is closed
+ */
+static int gpio_release(struct inode *inode, struct file *filp)
+{
+    struct gpio_file *file = filp->private_data;
+    
+    if (file == NULL) {
+        printk(KERN_ERR "GPIO_DRIVER: Invalid device pointer in release\n");
+        return -EINVAL;
+    }
+    
+    mutex_lock(&gpio_mutex);
+    if (file->read_mode == GPIO_READ_EVENTS) {
+        gpio_events_subscribe(file, false);
+        gpio_pollers_update(file->line_mask, 0);
+    }
+    /* gpio_remove already quiesced the line and dropped every registration */
+    if (!file->dev->removed) {
+        if (file->watch_level) {
+            file->dev->level_watchers--;
+        }
+        /* Drops the file's eventfds and re-evaluates trigger and polling */
+        gpio_set_eventfd(file, -1, GPIO_EDGE_BOTH);
+    }
+    mutex_unlock(&gpio_mutex);
+    
+    gpio_timed_cancel(file->dev, file);
+    
+    kref_put(&file->dev->ref, gpio_device_free);
+    kfree(file->filter);
+    kfree(file->cpus);
+    kfree(file);
+    filp->private_data = NULL;
+    
+    printk(KERN_INFO "GPIO_DRIVER: Device closed\n");
+    
+    return 0;
+}
+
+/*
+ * Last position of a ring the read path may consume: the head, or with a
+ * filter the first event still without a verdict
+ */
+static u64 gpio_event_limit(struct gpio_file *file, struct gpio_event_ring *ring,
+                            struct gpio_file_cpu *fc)
+{
+    if (READ_ONCE(file->filter) != NULL) {
+        return smp_load_acquire(&fc->judged);
+    }
+    
+    return smp_load_acquire(&ring->head);
+}
 
 /*
- * GPIO Interrupt Service Routine
- * Called when GPIO interrupt is triggered
+ * Anything past this file's cursors (the read path applies the line mask)
  */
-static irqreturn_t gpio_interrupt_handler(int irq, void *dev_id)
+static bool gpio_events_pending(struct gpio_file *file)
 {
-    struct gpio_device *dev = (struct gpio_device *)dev_id;
+    int cpu;
     
-    if (dev == NULL) {
-        printk(KERN_ERR "GPIO_DRIVER: Invalid device pointer in ISR\n");
-        return IRQ_NONE;
+    for_each_possible_cpu(cpu) {
+        if (gpio_event_limit(file, gpio_event_rings[cpu], &file->cpus[cpu]) !=
+            READ_ONCE(file->cpus[cpu].cursor)) {
+            return true;
+        }
     }
     
-    interrupt_triggered = true;
-    printk(KERN_INFO "GPIO_DRIVER: Interrupt triggered on GPIO %d (IRQ %d)\n", 
-           dev->gpio_number, irq);
+    return false;
+}
+
+/*
+ * Oldest unread event of one CPU's ring, copied into fc->peek
+ * Lock-free against the writer: a slot the writer may have started to
+ * overwrite during the copy is treated as lost. Events the file's filter
+ * rejected are skipped.
+ * Returns: true if fc->peek holds the event at fc->cursor
+ */
+static bool gpio_event_peek(struct gpio_file *file, struct gpio_event_ring *ring,
+                            struct gpio_file_cpu *fc)
+{
+    u64 head;
+    u64 lost;
     
-    /* Wake up any process waiting in read() */
-    wake_up_interruptible(&gpio_wait_queue);
+    if (fc->peeked) {
+        return true;
+    }
     
-    return IRQ_HANDLED;
+    for (;;) {
+        head = smp_load_acquire(&ring->head);
+        if (head - fc->cursor > GPIO_EVENT_RING_SIZE) {
+            lost = head - GPIO_EVENT_RING_SIZE - fc->cursor;
+            fc->dropped += lost;
+            file->unreported += lost;
+            fc->cursor = head - GPIO_EVENT_RING_SIZE;
+        }
+        
+        if ((s64)(gpio_event_limit(file, ring, fc) - fc->cursor) <= 0) {
+            return false;
+        }
+        
+        if (file->filter != NULL &&
+            !test_bit(fc->cursor & (GPIO_EVENT_RING_SIZE - 1), fc->verdict)) {
+            fc->cursor++;
+            continue;
+        }
+        
+        fc->peek = ring->events[fc->cursor & (GPIO_EVENT_RING_SIZE - 1)];
+        smp_rmb();
+        if (READ_ONCE(ring->head) - fc->cursor < GPIO_EVENT_RING_SIZE) {
+            fc->peeked = 1;
+            return true;
+        }
+    }
 }
 
 /*
- * Character Device: Open
- * Called when /dev/gpio_dev is opened
+ * Copy events for one file out of the per-CPU histories, merged into
+ * timestamp order (O(CPUs) per event). Skips lines outside the file's
+ * mask; an overrun is reported in the lost field of the first event
+ * delivered after it. The destination is a user buffer for read() and
+ * pipe pages for splice(), so events are copied once either way.
+ * Returns: Bytes copied, -EAGAIN if nothing is pending
  */
-static int gpio_open(struct inode *inode, struct file *filp)
+static ssize_t gpio_read_events(struct gpio_file *file, struct iov_iter *to)
 {
-    struct gpio_device *dev;
+    struct gpio_event batch[16];
+    struct gpio_file_cpu *best;
+    struct gpio_file_cpu *fc;
+    u64 overruns;
+    size_t count = iov_iter_count(to);
+    size_t copied = 0;
+    int n = 0;
+    int cpu;
+    
+    if (count < sizeof(struct gpio_event)) {
+        return -EINVAL;
+    }
     
-    printk(KERN_INFO "GPIO_DRIVER: Device opened\n");
+    if (mutex_lock_interruptible(&file->read_lock) != 0) {
+        return -ERESTARTSYS;
+    }
     
-    /* Get device private data from cdev container_of */
-    dev = container_of(inode->i_cdev, struct gpio_device, cdev);
-    filp->private_data = dev;
+    overruns = file->overruns + file->unreported;
     
-    mutex_lock(&gpio_mutex);
+    while (copied + (n + 1) * sizeof(struct gpio_event) <= count) {
+        best = NULL;
+        for_each_possible_cpu(cpu) {
+            fc = &file->cpus[cpu];
+            if (gpio_event_peek(file, gpio_event_rings[cpu], fc) &&
+                (best == NULL || fc->peek.timestamp_ns < best->peek.timestamp_ns)) {
+                best = fc;
+            }
+        }
+        
+        if (best == NULL) {
+            break;
+        }
+        
+        best->peeked = 0;
+        best->cursor++;
+        if (!(file->line_mask & BIT(best->peek.line))) {
+            continue;
+        }
+        
+        batch[n] = best->peek;
+        batch[n].lost = (u32)min_t(u64, file->unreported, U32_MAX);
+        file->overruns += file->unreported;
+        file->unreported = 0;
+        n++;
+        
+        if (n == ARRAY_SIZE(batch)) {
+            if (copy_to_iter(batch, n * sizeof(struct gpio_event), to) !=
+                n * sizeof(struct gpio_event)) {
+                mutex_unlock(&file->read_lock);
+                return -EFAULT;
+            }
+            copied += n * sizeof(struct gpio_event);
+            file->delivered += n;
+            atomic_sub(n, &file->pending);
+            n = 0;
+        }
+    }
     
-    /* GPIO is already requested in probe(), just initialize flags */
-    dev->value = gpio_get_value(dev->gpio_number);
+    if (n != 0) {
+        if (copy_to_iter(batch, n * sizeof(struct gpio_event), to) !=
+            n * sizeof(struct gpio_event)) {
+            mutex_unlock(&file->read_lock);
+            return -EFAULT;
+        }
+        copied += n * sizeof(struct gpio_event);
+        file->delivered += n;
+        atomic_sub(n, &file->pending);
+    }
     
-    mutex_unlock(&gpio_mutex);
+    /* Drained: restart the batch (an overrun also resets the count) */
+    if (!gpio_events_pending(file)) {
+        if (file->overruns + file->unreported != overruns) {
+            atomic_set(&file->pending, 0);
+        }
+        hrtimer_try_to_cancel(&file->latency_timer);
+        WRITE_ONCE(file->expired, 0);
+        
+        /* An event that slipped in after the check keeps its latency bound */
+        if (file->max_latency_ns != 0 && gpio_events_pending(file)) {
+            hrtimer_start(&file->latency_timer, ns_to_ktime(file->max_latency_ns),
+                          HRTIMER_MODE_REL);
+        }
+    }
     
-    return 0;
+    mutex_unlock(&file->read_lock);
+    
+    return copied ? copied : -EAGAIN;
 }
 
 /*
- * Character Device: Release/Close
- * Called when /dev/gpio_dev is closed
+ * A sleeping reader may go: the watermark is reached or the oldest
+ * pending event has waited out the latency timer
  */
-static int gpio_release(struct inode *inode, struct file *filp)
+static bool gpio_events_ready(struct gpio_file *file)
 {
-    struct gpio_device *dev = filp->private_data;
+    if (!gpio_events_pending(file)) {
+        return false;
+    }
     
-    if (dev == NULL) {
-        printk(KERN_ERR "GPIO_DRIVER: Invalid device pointer in release\n");
+    return file->watermark <= 1 || READ_ONCE(file->expired) ||
+           atomic_read(&file->pending) >= (int)file->watermark;
+}
+
+/*
+ * Event-mode read: block until the file's wakeup condition holds, the
+ * timeout expires or a signal is pending. O_NONBLOCK and a zero timeout
+ * return whatever is pending, or -EAGAIN. On timeout, events below the
+ * watermark are returned; -ETIMEDOUT only if there are none.
+ */
+static ssize_t gpio_read_events_wait(struct file *filp, struct gpio_file *file,
+                                     struct iov_iter *to)
+{
+    long remaining = (file->timeout_ms > 0) ? msecs_to_jiffies(file->timeout_ms) : 0;
+    ssize_t ret;
+    long wait;
+    
+    if ((filp->f_flags & O_NONBLOCK) || file->timeout_ms == GPIO_TIMEOUT_NONE) {
+        return gpio_read_events(file, to);
+    }
+    
+    for (;;) {
+        if (gpio_events_ready(file)) {
+            ret = gpio_read_events(file, to);
+            if (ret != -EAGAIN) {
+                return ret;
+            }
+        }
+        
+        if (file->timeout_ms < 0) {
+            if (wait_event_interruptible(file->wait, gpio_events_ready(file)) != 0) {
+                return -ERESTARTSYS;
+            }
+            continue;
+        }
+        
+        /* Events for other lines may leave us empty; keep the remaining time */
+        wait = wait_event_interruptible_timeout(file->wait, gpio_events_ready(file),
+                                                remaining);
+        if (wait < 0) {
+            return -ERESTARTSYS;
+        }
+        if (wait == 0) {
+            ret = gpio_read_events(file, to);
+            return (ret == -EAGAIN) ? -ETIMEDOUT : ret;
+        }
+        remaining = wait;
+    }
+}
+
+/*
+ * GPIO_READ_BITMAP read: sample the file's lines in bursts of
+ * GPIO_BITMAP_CHUNK and copy each burst to its planes. gpio_mutex keeps
+ * gpio_remove from releasing a line's descriptor during a burst; only
+ * the lookup takes gpio_devices_lock, and only the burst itself runs with
+ * local interrupts off, so other lines' reflexes are not held up.
+ */
+static ssize_t gpio_read_bitmap(struct gpio_file *file, char __user *buf, size_t count)
+{
+    struct gpio_desc *descs[GPIO_MAX_DEVICES];
+    struct gpio_device *dev;
+    u64 planes[GPIO_MAX_DEVICES];
+    unsigned long lines = READ_ONCE(file->line_mask);
+    unsigned long values;
+    unsigned long flags;
+    size_t plane_bytes;
+    size_t done;
+    int nlines = hweight32(lines);
+    int ret = 0;
+    int minor;
+    int n;
+    int i;
+    int s;
+    
+    plane_bytes = min_t(size_t, count / nlines, GPIO_BITMAP_MAX_SAMPLES / 8) & ~(size_t)7;
+    if (plane_bytes == 0) {
         return -EINVAL;
     }
     
-    printk(KERN_INFO "GPIO_DRIVER: Device closed\n");
+    for (done = 0; done < plane_bytes; done += sizeof(u64)) {
+        memset(planes, 0, sizeof(planes));
+        n = 0;
+        
+        mutex_lock(&gpio_mutex);
+        
+        /* A published line not yet marked removed stays until gpio_mutex is dropped */
+        spin_lock_irqsave(&gpio_devices_lock, flags);
+        for_each_set_bit(minor, &lines, GPIO_MAX_DEVICES) {
+            dev = gpio_devices[minor];
+            /* A bus transfer per sample is no capture; expanders are refused */
+            if (dev == NULL || dev->removed || dev->cansleep) {
+                ret = (dev == NULL || dev->removed) ? -ENODEV : -EOPNOTSUPP;
+                break;
+            }
+            descs[n++] = gpio_to_desc(dev->gpio_number);
+        }
+        spin_unlock_irqrestore(&gpio_devices_lock, flags);
+        
+        /* Evenly spaced samples: no interrupt on this CPU in the middle of a burst */
+        local_irq_save(flags);
+        for (s = 0; ret == 0 && s < GPIO_BITMAP_CHUNK; s++) {
+            values = 0;
+            ret = gpiod_get_array_value(n, descs, NULL, &values);
+            for (i = 0; i < n; i++) {
+                planes[i] |= (u64)((values >> i) & 1) << s;
+            }
+        }
+        local_irq_restore(flags);
+        
+        mutex_unlock(&gpio_mutex);
+        
+        if (ret != 0) {
+            return ret;
+        }
+        
+        for (i = 0; i < n; i++) {
+            planes[i] = cpu_to_le64(planes[i]);
+            if (copy_to_user(buf + i * plane_bytes + done, &planes[i], sizeof(u64)) != 0) {
+                return -EFAULT;
+            }
+        }
+        
+        cond_resched();
+    }
     
-    return 0;
+    return nlines * plane_bytes;
 }
 
 /*
@@ -124,7 +2699,10 @@ static int gpio_release(struct inode *inode, struct file *filp)
  */
 static ssize_t gpio_read(struct file *filp, char __user *buf, size_t count, loff_t *f_pos)
 {
-    struct gpio_device *dev = filp->private_data;
+    struct gpio_file *file = filp->private_data;
+    struct gpio_device *dev = file ? file->dev : NULL;
+    struct iov_iter to;
+    struct iovec iov;
     unsigned char gpio_value;
     int ret;
     
@@ -133,15 +2711,31 @@ static ssize_t gpio_read(struct file *filp, char __user *buf, size_t count, loff
         return -EINVAL;
     }
     
+    if (file->read_mode == GPIO_READ_EVENTS) {
+        iov.iov_base = buf;
+        iov.iov_len = count;
+        iov_iter_init(&to, READ, &iov, 1, count);
+        return gpio_read_events_wait(filp, file, &to);
+    }
+    
+    if (file->read_mode == GPIO_READ_BITMAP) {
+        return gpio_read_bitmap(file, buf, count);
+    }
+    
     if (count < 1) {
-        printk(KERN_WARN "GPIO_DRIVER: Read count less than 1 byte\n");
+        printk(KERN_WARNING "GPIO_DRIVER: Read count less than 1 byte\n");
         return -EINVAL;
     }
     
     mutex_lock(&gpio_mutex);
     
+    if (dev->removed) {
+        mutex_unlock(&gpio_mutex);
+        return -ENODEV;
+    }
+    
     /* Read current GPIO value */
-    gpio_value = (unsigned char)gpio_get_value(dev->gpio_number);
+    gpio_value = (unsigned char)gpio_line_get(dev);
     dev->value = gpio_value;
     
     printk(KERN_DEBUG "GPIO_DRIVER: Read GPIO %d value: %d\n", 
@@ -160,6 +2754,23 @@ static ssize_t gpio_read(struct file *filp, char __user *buf, size_t count, loff
     return 1;  /* Return number of bytes read */
 }
 
+/*
+ * Character Device: Read Iterator
+ * Event mode only. splice() reads through it (generic_file_splice_read):
+ * events are copied once into pipe pages and a recorder moves them on to
+ * a file or socket with no user buffer; read() keeps using gpio_read.
+ */
+static ssize_t gpio_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+    struct gpio_file *file = iocb->ki_filp->private_data;
+    
+    if (file == NULL || file->read_mode != GPIO_READ_EVENTS) {
+        return -EINVAL;
+    }
+    
+    return gpio_read_events_wait(iocb->ki_filp, file, to);
+}
+
 /*
  * Character Device: Write
  * Write GPIO value to device
@@ -168,7 +2779,8 @@ static ssize_t gpio_read(struct file *filp, char __user *buf, size_t count, loff
 static ssize_t gpio_write(struct file *filp, const char __user *buf, 
                          size_t count, loff_t *f_pos)
 {
-    struct gpio_device *dev = filp->private_data;
+    struct gpio_file *file = filp->private_data;
+    struct gpio_device *dev = file ? file->dev : NULL;
     unsigned char gpio_value;
     int ret;
     
@@ -178,7 +2790,7 @@ static ssize_t gpio_write(struct file *filp, const char __user *buf,
     }
     
     if (count < 1) {
-        printk(KERN_WARN "GPIO_DRIVER: Write count less than 1 byte\n");
+        printk(KERN_WARNING "GPIO_DRIVER: Write count less than 1 byte\n");
         return -EINVAL;
     }
     
@@ -191,16 +2803,21 @@ static ssize_t gpio_write(struct file *filp, const char __user *buf,
     
     mutex_lock(&gpio_mutex);
     
+    if (dev->removed) {
+        mutex_unlock(&gpio_mutex);
+        return -ENODEV;
+    }
+    
     /* Check if GPIO is configured as output */
     if (dev->direction != GPIO_DIRECTION_OUTPUT) {
-        printk(KERN_WARN "GPIO_DRIVER: Cannot write to input GPIO\n");
+        printk(KERN_WARNING "GPIO_DRIVER: Cannot write to input GPIO\n");
         mutex_unlock(&gpio_mutex);
         return -EACCES;
     }
     
-    /* Set GPIO value */
-    gpio_set_value(dev->gpio_number, gpio_value ? 1 : 0);
-    dev->value = gpio_value ? 1 : 0;
+    /* Set GPIO value (expanders: shadow now, bus write coalesced) */
+    gpio_line_set(dev, gpio_value ? 1 : 0);
+    gpio_sync_state(dev);
     
     printk(KERN_DEBUG "GPIO_DRIVER: Wrote GPIO %d value: %d\n", 
            dev->gpio_number, dev->value);
@@ -211,16 +2828,66 @@ static ssize_t gpio_write(struct file *filp, const char __user *buf,
     return 1;  /* Return number of bytes written */
 }
 
+/*
+ * GPIO_IOCTL_GET_CPU_STATS: per-CPU recorded/dropped counters for the
+ * calling file, one entry per possible CPU up to the caller's capacity
+ */
+static long gpio_ioctl_get_cpu_stats(struct gpio_file *file, unsigned long arg)
+{
+    struct gpio_cpu_stats_list __user *ulist = (struct gpio_cpu_stats_list __user *)arg;
+    struct gpio_cpu_stats_list list;
+    struct gpio_cpu_stats st;
+    struct gpio_cpu_stats __user *out;
+    u32 n = 0;
+    int cpu;
+    
+    if (copy_from_user(&list, ulist, sizeof(list)) != 0) {
+        return -EFAULT;
+    }
+    
+    out = u64_to_user_ptr(list.stats);
+    for_each_possible_cpu(cpu) {
+        if (n < list.count) {
+            memset(&st, 0, sizeof(st));
+            st.cpu = cpu;
+            st.recorded = READ_ONCE(gpio_event_rings[cpu]->head);
+            st.dropped = file->cpus[cpu].dropped;
+            if (copy_to_user(&out[n], &st, sizeof(st)) != 0) {
+                return -EFAULT;
+            }
+        }
+        n++;
+    }
+    
+    list.count = n;
+    if (copy_to_user(ulist, &list, sizeof(list)) != 0) {
+        return -EFAULT;
+    }
+    
+    return 0;
+}
+
 /*
  * Character Device: IOCTL
  * Handle device-specific I/O control commands
  */
 static long gpio_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 {
-    struct gpio_device *dev = filp->private_data;
+    struct gpio_file *file = filp->private_data;
+    struct gpio_device *dev = file ? file->dev : NULL;
     int ret = 0;
     int direction = 0;
     int value = 0;
+    struct gpio_counter_info counter;
+    struct gpio_reflex reflex;
+    struct gpio_gesture gesture;
+    struct gpio_eventfd efd;
+    struct gpio_event_stats stats;
+    struct gpio_wakeup wakeup;
+    unsigned int prev_edges;
+    u32 mask;
+    u64 head;
+    int cpu;
     
     if (dev == NULL) {
         printk(KERN_ERR "GPIO_DRIVER: Invalid device pointer in ioctl\n");
@@ -232,85 +2899,372 @@ static long gpio_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
         return -ENOTTY;
     }
     
+    /* May sleep until its changes fire; takes gpio_mutex only to queue them */
+    if (cmd == GPIO_IOCTL_SCHEDULE) {
+        return gpio_ioctl_schedule(file, arg);
+    }
+    
     mutex_lock(&gpio_mutex);
     
-    switch (cmd) {
-    case GPIO_IOCTL_SET_VALUE:
-        /* Set GPIO output value */
+    if (dev->removed) {
+        mutex_unlock(&gpio_mutex);
+        return -ENODEV;
+    }
+    
+    /* Extensible structs: the size encoded in cmd varies across versions */
+    if (_IOC_NR(cmd) == _IOC_NR(GPIO_IOCTL_GET_STATE)) {
+        ret = gpio_ioctl_get_state(dev, arg);
+        mutex_unlock(&gpio_mutex);
+        return ret;
+    }
+    
+    switch (cmd) {
+    case GPIO_IOCTL_SET_VALUE:
+        /* Set GPIO output value */
+        ret = copy_from_user(&value, (int __user *)arg, sizeof(int));
+        if (ret != 0) {
+            printk(KERN_ERR "GPIO_DRIVER: Failed to copy value from user\n");
+            ret = -EFAULT;
+            break;
+        }
+        
+        if (dev->direction != GPIO_DIRECTION_OUTPUT) {
+            printk(KERN_WARNING "GPIO_DRIVER: Cannot set value on input GPIO\n");
+            ret = -EACCES;
+            break;
+        }
+        
+        gpio_line_set(dev, value ? 1 : 0);
+        gpio_sync_state(dev);
+        printk(KERN_INFO "GPIO_DRIVER: IOCTL SET_VALUE to %d\n", dev->value);
+        break;
+    
+    case GPIO_IOCTL_GET_VALUE:
+        /* Get GPIO current value */
+        value = gpio_line_get(dev);
+        dev->value = value;
+        
+        ret = copy_to_user((int __user *)arg, &value, sizeof(int));
+        if (ret != 0) {
+            printk(KERN_ERR "GPIO_DRIVER: Failed to copy value to user\n");
+            ret = -EFAULT;
+            break;
+        }
+        
+        printk(KERN_INFO "GPIO_DRIVER: IOCTL GET_VALUE = %d\n", value);
+        break;
+    
+    case GPIO_IOCTL_SET_DIRECTION:
+        /* Set GPIO direction (input/output) */
+        ret = copy_from_user(&direction, (int __user *)arg, sizeof(int));
+        if (ret != 0) {
+            printk(KERN_ERR "GPIO_DRIVER: Failed to copy direction from user\n");
+            ret = -EFAULT;
+            break;
+        }
+        
+        if (direction == GPIO_DIRECTION_INPUT) {
+            ret = gpio_direction_input(dev->gpio_number);
+            if (ret == 0) {
+                dev->direction = GPIO_DIRECTION_INPUT;
+                printk(KERN_INFO "GPIO_DRIVER: Set GPIO to INPUT\n");
+            } else {
+                printk(KERN_ERR "GPIO_DRIVER: Failed to set GPIO to INPUT\n");
+            }
+        } else if (direction == GPIO_DIRECTION_OUTPUT) {
+            ret = gpio_direction_output(dev->gpio_number, 0);
+            if (ret == 0) {
+                dev->direction = GPIO_DIRECTION_OUTPUT;
+                dev->value = 0;
+                printk(KERN_INFO "GPIO_DRIVER: Set GPIO to OUTPUT\n");
+            } else {
+                printk(KERN_ERR "GPIO_DRIVER: Failed to set GPIO to OUTPUT\n");
+            }
+        } else {
+            printk(KERN_ERR "GPIO_DRIVER: Invalid direction value\n");
+            ret = -EINVAL;
+        }
+        if (dev->direction == GPIO_DIRECTION_INPUT) {
+            /* Seed the shared level; edges keep it current from here */
+            gpio_sync_input(dev);
+        } else {
+            gpio_sync_state(dev);
+        }
+        gpio_poll_update(dev);
+        break;
+    
+    case GPIO_IOCTL_GET_DIRECTION:
+        /* Get GPIO current direction */
+        ret = copy_to_user((int __user *)arg, &dev->direction, sizeof(int));
+        if (ret != 0) {
+            printk(KERN_ERR "GPIO_DRIVER: Failed to copy direction to user\n");
+            ret = -EFAULT;
+            break;
+        }
+        
+        printk(KERN_INFO "GPIO_DRIVER: IOCTL GET_DIRECTION = %d\n", dev->direction);
+        break;
+    
+    case GPIO_IOCTL_SET_COUNTER:
+        /* Enable (non-zero) or disable counter mode */
+        ret = copy_from_user(&value, (int __user *)arg, sizeof(int));
+        if (ret != 0) {
+            printk(KERN_ERR "GPIO_DRIVER: Failed to copy counter mode from user\n");
+            ret = -EFAULT;
+            break;
+        }
+        
+        if (value && dev->direction != GPIO_DIRECTION_INPUT) {
+            printk(KERN_WARNING "GPIO_DRIVER: Counter mode requires an input GPIO\n");
+            ret = -EACCES;
+            break;
+        }
+        
+        ret = gpio_set_counter(dev, value);
+        break;
+    
+    case GPIO_IOCTL_RUN_OPS:
+        /* Execute a batched operation list */
+        ret = gpio_ioctl_run_ops(dev, arg);
+        break;
+    
+    case GPIO_IOCTL_SET_READ_MODE:
+        /* Switch read() between level bytes, event records and bitmaps */
+        ret = copy_from_user(&value, (int __user *)arg, sizeof(int));
+        if (ret != 0) {
+            ret = -EFAULT;
+            break;
+        }
+        
+        if (value != GPIO_READ_VALUE && value != GPIO_READ_EVENTS && value != GPIO_READ_BITMAP) {
+            ret = -EINVAL;
+            break;
+        }
+        
+        /* An event reader is what a line without IRQ polls for */
+        if ((value == GPIO_READ_EVENTS) != (file->read_mode == GPIO_READ_EVENTS)) {
+            gpio_events_subscribe(file, value == GPIO_READ_EVENTS);
+            if (value == GPIO_READ_EVENTS) {
+                gpio_pollers_update(0, file->line_mask);
+            } else {
+                gpio_pollers_update(file->line_mask, 0);
+            }
+        }
+        file->read_mode = value;
+        break;
+    
+    case GPIO_IOCTL_SET_READ_TIMEOUT:
+        /* Event read timeout in ms (-1 = block forever, 0 = never block) */
         ret = copy_from_user(&value, (int __user *)arg, sizeof(int));
         if (ret != 0) {
-            printk(KERN_ERR "GPIO_DRIVER: Failed to copy value from user\n");
             ret = -EFAULT;
             break;
         }
         
-        if (dev->direction != GPIO_DIRECTION_OUTPUT) {
-            printk(KERN_WARN "GPIO_DRIVER: Cannot set value on input GPIO\n");
-            ret = -EACCES;
+        file->timeout_ms = (value < 0) ? GPIO_TIMEOUT_INFINITE : value;
+        break;
+    
+    case GPIO_IOCTL_SET_WAKEUP:
+        /* Batch reader wakeups: watermark events or max latency */
+        ret = copy_from_user(&wakeup, (struct gpio_wakeup __user *)arg, sizeof(wakeup));
+        if (ret != 0) {
+            ret = -EFAULT;
             break;
         }
         
-        gpio_set_value(dev->gpio_number, value ? 1 : 0);
-        dev->value = value ? 1 : 0;
-        printk(KERN_INFO "GPIO_DRIVER: IOCTL SET_VALUE to %d\n", dev->value);
+        if (wakeup.watermark > GPIO_EVENT_RING_SIZE ||
+            wakeup.max_latency_us > GPIO_WAKEUP_MAX_LATENCY_US) {
+            ret = -EINVAL;
+            break;
+        }
+        
+        WRITE_ONCE(file->watermark, max_t(u32, wakeup.watermark, 1));
+        WRITE_ONCE(file->max_latency_ns, (u64)wakeup.max_latency_us * NSEC_PER_USEC);
+        
+        /* Events already waiting start their latency now */
+        if (file->max_latency_ns != 0 && atomic_read(&file->pending) > 0) {
+            hrtimer_start(&file->latency_timer, ns_to_ktime(file->max_latency_ns),
+                          HRTIMER_MODE_REL);
+        }
+        
+        /* Re-evaluate sleepers against the new condition */
+        wake_up_interruptible(&file->wait);
         break;
     
-    case GPIO_IOCTL_GET_VALUE:
-        /* Get GPIO current value */
-        value = gpio_get_value(dev->gpio_number);
-        dev->value = value;
+    case GPIO_IOCTL_SET_EDGES:
+        /* Edges recorded as events on this line (device-wide setting) */
+        ret = copy_from_user(&value, (int __user *)arg, sizeof(int));
+        if (ret != 0) {
+            ret = -EFAULT;
+            break;
+        }
         
-        ret = copy_to_user((int __user *)arg, &value, sizeof(int));
+        if (value < GPIO_EDGE_RISING || value > GPIO_EDGE_BOTH) {
+            ret = -EINVAL;
+            break;
+        }
+        
+        prev_edges = dev->event_edges;
+        dev->event_edges = value;
+        ret = gpio_set_trigger(dev, gpio_trigger_for(dev, dev->counter_enabled, &dev->reflex));
+        if (ret != 0) {
+            dev->event_edges = prev_edges;
+        }
+        break;
+    
+    case GPIO_IOCTL_WATCH_LEVEL:
+        /* Keep the shared level current without touching the recorded edges */
+        ret = copy_from_user(&value, (int __user *)arg, sizeof(int));
         if (ret != 0) {
-            printk(KERN_ERR "GPIO_DRIVER: Failed to copy value to user\n");
             ret = -EFAULT;
             break;
         }
         
-        printk(KERN_INFO "GPIO_DRIVER: IOCTL GET_VALUE = %d\n", value);
+        value = value ? 1 : 0;
+        if (value == file->watch_level) {
+            break;
+        }
+        
+        dev->level_watchers += value ? 1 : -1;
+        ret = gpio_set_trigger(dev, gpio_trigger_for(dev, dev->counter_enabled, &dev->reflex));
+        if (ret != 0) {
+            dev->level_watchers -= value ? 1 : -1;
+            break;
+        }
+        file->watch_level = value;
+        gpio_poll_update(dev);
         break;
     
-    case GPIO_IOCTL_SET_DIRECTION:
-        /* Set GPIO direction (input/output) */
-        ret = copy_from_user(&direction, (int __user *)arg, sizeof(int));
+    case GPIO_IOCTL_SET_LINE_MASK:
+        /* Choose which lines' events (or bitmap planes) this file receives */
+        ret = copy_from_user(&mask, (u32 __user *)arg, sizeof(u32));
         if (ret != 0) {
-            printk(KERN_ERR "GPIO_DRIVER: Failed to copy direction from user\n");
             ret = -EFAULT;
             break;
         }
         
-        if (direction == GPIO_DIRECTION_INPUT) {
-            ret = gpio_direction_input(dev->gpio_number);
-            if (ret == 0) {
-                dev->direction = GPIO_DIRECTION_INPUT;
-                printk(KERN_INFO "GPIO_DRIVER: Set GPIO to INPUT\n");
-            } else {
-                printk(KERN_ERR "GPIO_DRIVER: Failed to set GPIO to INPUT\n");
-            }
-        } else if (direction == GPIO_DIRECTION_OUTPUT) {
-            ret = gpio_direction_output(dev->gpio_number, 0);
-            if (ret == 0) {
-                dev->direction = GPIO_DIRECTION_OUTPUT;
-                printk(KERN_INFO "GPIO_DRIVER: Set GPIO to OUTPUT\n");
-            } else {
-                printk(KERN_ERR "GPIO_DRIVER: Failed to set GPIO to OUTPUT\n");
-            }
-        } else {
-            printk(KERN_ERR "GPIO_DRIVER: Invalid direction value\n");
+        if (mask == 0 || (mask & ~(BIT(GPIO_MAX_DEVICES) - 1))) {
             ret = -EINVAL;
+            break;
+        }
+        
+        /* Poll-only lines the reader now covers start sampling */
+        if (file->read_mode == GPIO_READ_EVENTS) {
+            gpio_pollers_update(file->line_mask, mask);
         }
+        WRITE_ONCE(file->line_mask, mask);
         break;
     
-    case GPIO_IOCTL_GET_DIRECTION:
-        /* Get GPIO current direction */
-        ret = copy_to_user((int __user *)arg, &dev->direction, sizeof(int));
+    case GPIO_IOCTL_GET_EVENT_STATS:
+        /* Per-reader delivery and overrun counters */
+        memset(&stats, 0, sizeof(stats));
+        for_each_possible_cpu(cpu) {
+            head = READ_ONCE(gpio_event_rings[cpu]->head);
+            stats.total += head;
+            stats.pending += min_t(u64, head - file->cpus[cpu].cursor, GPIO_EVENT_RING_SIZE);
+        }
+        stats.delivered = file->delivered;
+        stats.overruns = file->overruns;
+        
+        ret = copy_to_user((struct gpio_event_stats __user *)arg, &stats, sizeof(stats));
         if (ret != 0) {
-            printk(KERN_ERR "GPIO_DRIVER: Failed to copy direction to user\n");
+            ret = -EFAULT;
+        }
+        break;
+    
+    case GPIO_IOCTL_GET_CPU_STATS:
+        /* Where events were recorded and what this file lost, per CPU */
+        ret = gpio_ioctl_get_cpu_stats(file, arg);
+        break;
+    
+    case GPIO_IOCTL_SET_FILTER:
+        /* Attach, replace or (count 0) detach this file's event filter */
+        ret = gpio_ioctl_set_filter(file, arg);
+        break;
+    
+    case GPIO_IOCTL_SET_EVENTFD:
+        /* Count edges of this line into an eventfd */
+        ret = copy_from_user(&efd, (struct gpio_eventfd __user *)arg, sizeof(efd));
+        if (ret != 0) {
+            printk(KERN_ERR "GPIO_DRIVER: Failed to copy eventfd from user\n");
             ret = -EFAULT;
             break;
         }
         
-        printk(KERN_INFO "GPIO_DRIVER: IOCTL GET_DIRECTION = %d\n", dev->direction);
+        ret = gpio_set_eventfd(file, efd.fd, efd.edges);
+        break;
+    
+    case GPIO_IOCTL_GET_TIMED:
+        /* Outcome of changes queued with GPIO_IOCTL_SCHEDULE */
+        ret = gpio_ioctl_get_timed(dev, arg);
+        break;
+    
+    case GPIO_IOCTL_SET_REFLEX:
+        /* Bind an edge of this line to an action on another line */
+        ret = copy_from_user(&reflex, (struct gpio_reflex __user *)arg, sizeof(reflex));
+        if (ret != 0) {
+            printk(KERN_ERR "GPIO_DRIVER: Failed to copy reflex from user\n");
+            ret = -EFAULT;
+            break;
+        }
+        
+        ret = gpio_set_reflex(dev, &reflex);
+        break;
+    
+    case GPIO_IOCTL_SET_GESTURE:
+        /* Turn debounced edges into button gestures */
+        ret = copy_from_user(&gesture, (struct gpio_gesture __user *)arg, sizeof(gesture));
+        if (ret != 0) {
+            printk(KERN_ERR "GPIO_DRIVER: Failed to copy gesture settings from user\n");
+            ret = -EFAULT;
+            break;
+        }
+        
+        /* On an output the driver's own writes would read as presses */
+        if ((gesture.flags & GPIO_GESTURE_ENABLE) && dev->direction != GPIO_DIRECTION_INPUT) {
+            printk(KERN_WARNING "GPIO_DRIVER: Gestures require an input GPIO\n");
+            ret = -EACCES;
+            break;
+        }
+        
+        ret = gpio_set_gesture(dev, &gesture);
+        break;
+    
+    case GPIO_IOCTL_GET_GESTURE:
+        /* Get the gesture settings of this line */
+        spin_lock_irq(&dev->lock);
+        gesture = dev->gesture;
+        spin_unlock_irq(&dev->lock);
+        
+        ret = copy_to_user((struct gpio_gesture __user *)arg, &gesture, sizeof(gesture));
+        if (ret != 0) {
+            printk(KERN_ERR "GPIO_DRIVER: Failed to copy gesture settings to user\n");
+            ret = -EFAULT;
+        }
+        break;
+    
+    case GPIO_IOCTL_GET_REFLEX:
+        /* Get the reflex rule of this line */
+        spin_lock_irq(&dev->lock);
+        reflex = dev->reflex;
+        spin_unlock_irq(&dev->lock);
+        
+        ret = copy_to_user((struct gpio_reflex __user *)arg, &reflex, sizeof(reflex));
+        if (ret != 0) {
+            printk(KERN_ERR "GPIO_DRIVER: Failed to copy reflex to user\n");
+            ret = -EFAULT;
+        }
+        break;
+    
+    case GPIO_IOCTL_GET_COUNTER:
+        /* Get edge counts, rolling frequency and duty cycle */
+        gpio_get_counter(dev, &counter);
+        
+        ret = copy_to_user((struct gpio_counter_info __user *)arg, &counter, sizeof(counter));
+        if (ret != 0) {
+            printk(KERN_ERR "GPIO_DRIVER: Failed to copy counter to user\n");
+            ret = -EFAULT;
+        }
         break;
     
     default:
@@ -324,6 +3278,57 @@ static long gpio_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
     return ret;
 }
 
+/*
+ * Character Device: poll
+ * Event mode is readable at the file's wakeup condition; value mode always is
+ */
+static __poll_t gpio_poll(struct file *filp, poll_table *wait)
+{
+    struct gpio_file *file = filp->private_data;
+    
+    if (file->read_mode != GPIO_READ_EVENTS) {
+        return EPOLLIN | EPOLLRDNORM;
+    }
+    
+    poll_wait(filp, &file->wait, wait);
+    
+    return gpio_events_ready(file) ? (EPOLLIN | EPOLLRDNORM) : 0;
+}
+
+/*
+ * Character Device: mmap
+ * Maps the shared state page read-only. vm_insert_page takes a page
+ * reference per mapping, so the page outlives an unbind until the last
+ * mapping goes away.
+ */
+static int gpio_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+    struct gpio_file *file = filp->private_data;
+    struct gpio_device *dev = file ? file->dev : NULL;
+    
+    if (dev == NULL || dev->shared == NULL) {
+        printk(KERN_ERR "GPIO_DRIVER: Invalid device pointer in mmap\n");
+        return -EINVAL;
+    }
+    
+    /* The page itself lives as long as dev, so a racing unbind is harmless */
+    if (READ_ONCE(dev->removed)) {
+        return -ENODEV;
+    }
+    
+    if (vma->vm_pgoff != 0 || vma->vm_end - vma->vm_start > PAGE_SIZE) {
+        return -EINVAL;
+    }
+    
+    if (vma->vm_flags & VM_WRITE) {
+        printk(KERN_WARNING "GPIO_DRIVER: Shared state can only be mapped read-only\n");
+        return -EACCES;
+    }
+    vm_flags_clear(vma, VM_MAYWRITE);
+    
+    return vm_insert_page(vma, vma->vm_start, dev->shared_page);
+}
+
 /*
  * File Operations Structure
  * Defines operations on /dev/gpio_dev character device
@@ -333,119 +3338,248 @@ static const struct file_operations gpio_fops = {
     .open = gpio_open,
     .release = gpio_release,
     .read = gpio_read,
+    .read_iter = gpio_read_iter,
+    .splice_read = generic_file_splice_read,
     .write = gpio_write,
     .unlocked_ioctl = gpio_ioctl,
+    .poll = gpio_poll,
+    .mmap = gpio_mmap,
+};
+
+/*
+ * Reserve a minor: the Device Tree "line" property pins one, otherwise
+ * the first free is taken. Probes run asynchronously and finish in any
+ * order, so boards that depend on /dev names should set "line".
+ */
+static int gpio_reserve_minor(struct device_node *node)
+{
+    u32 line;
+    int minor;
+    
+    if (of_property_read_u32(node, "line", &line) == 0) {
+        if (line >= GPIO_MAX_DEVICES) {
+            return -EINVAL;
+        }
+        return test_and_set_bit(line, gpio_minors) ? -EBUSY : (int)line;
+    }
+    
+    for (minor = 0; minor < GPIO_MAX_DEVICES; minor++) {
+        if (!test_and_set_bit(minor, gpio_minors)) {
+            return minor;
+        }
+    }
+    
+    return -ENOSPC;
+}
+
+/*
+ * sysfs: /sys/class/gpio_class/<dev>/probe_time_us
+ */
+static ssize_t probe_time_us_show(struct device *device, struct device_attribute *attr,
+                                  char *buf)
+{
+    struct gpio_device *dev = dev_get_drvdata(device);
+    
+    return sysfs_emit(buf, "%llu\n", (unsigned long long)div_u64(dev->probe_ns, 1000));
+}
+static DEVICE_ATTR_RO(probe_time_us);
+
+static struct attribute *gpio_dev_attrs[] = {
+    &dev_attr_probe_time_us.attr,
+    NULL,
 };
+ATTRIBUTE_GROUPS(gpio_dev);
 
 /*
  * Platform Driver: Probe Function
  * Called when device matching compatible string is found in Device Tree
+ * Each matching node gets its own minor: /dev/gpio_dev, /dev/gpio_dev1, ...
+ * Resources are device-managed, except the gpio_device itself: open files
+ * keep it (see gpio_device_free), so it is refcounted instead. The cdev,
+ * the minor and the reflex node reference are unwound by hand too.
  */
 static int gpio_probe(struct platform_device *pdev)
 {
     int ret = 0;
     struct device_node *node = pdev->dev.of_node;
-    
-    printk(KERN_INFO "GPIO_DRIVER: Probe function called\n");
+    struct gpio_device *dev;
+    struct device *device;
+    unsigned long flags;
+    u64 start = ktime_get_ns();
+    int minor;
     
     if (node == NULL) {
         printk(KERN_ERR "GPIO_DRIVER: Device Tree node not found\n");
         return -ENODEV;
     }
     
+    minor = gpio_reserve_minor(node);
+    if (minor < 0) {
+        printk(KERN_ERR "GPIO_DRIVER: No minor for %s (error: %d, max %d devices)\n",
+               node->name, minor, GPIO_MAX_DEVICES);
+        return minor;
+    }
+    
     /* Allocate memory for device structure */
-    gpio_dev_data = kzalloc(sizeof(struct gpio_device), GFP_KERNEL);
-    if (gpio_dev_data == NULL) {
-        printk(KERN_ERR "GPIO_DRIVER: Failed to allocate device memory\n");
-        return -ENOMEM;
+    dev = kzalloc(sizeof(struct gpio_device), GFP_KERNEL);
+    if (dev == NULL) {
+        ret = -ENOMEM;
+        goto err_minor;
     }
     
-    /* Get GPIO number from Device Tree */
-    ret = of_property_read_u32(node, "gpio-number", (u32 *)&gpio_dev_data->gpio_number);
-    if (ret != 0) {
-        /* Use module parameter as fallback */
-        gpio_dev_data->gpio_number = gpio_number;
-        printk(KERN_INFO "GPIO_DRIVER: Using module parameter GPIO number: %d\n", gpio_number);
-    } else {
-        printk(KERN_INFO "GPIO_DRIVER: Got GPIO number from Device Tree: %d\n", 
-               gpio_dev_data->gpio_number);
+    kref_init(&dev->ref);
+    dev->minor = minor;
+    dev->node = node;
+    dev->irq = -1;
+    dev->event_edges = GPIO_EDGE_FALLING;
+    spin_lock_init(&dev->lock);
+    hrtimer_init(&dev->pulse_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    dev->pulse_timer.function = gpio_pulse_end;
+    hrtimer_init(&dev->poll_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    dev->poll_timer.function = gpio_poll_tick;
+    INIT_WORK(&dev->poll_work, gpio_poll_work);
+    hrtimer_init(&dev->debounce_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    dev->debounce_timer.function = gpio_gesture_settle;
+    hrtimer_init(&dev->hold_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    dev->hold_timer.function = gpio_gesture_hold;
+    hrtimer_init(&dev->timed_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+    dev->timed_timer.function = gpio_timed_fire;
+    init_waitqueue_head(&dev->timed_wait);
+    
+    /* Get GPIO number from Device Tree, module parameter as fallback */
+    if (of_property_read_u32(node, "gpio-number", (u32 *)&dev->gpio_number) != 0) {
+        dev->gpio_number = gpio_number;
     }
     
     /* Request GPIO */
-    ret = gpio_request(gpio_dev_data->gpio_number, DEVICE_NAME);
+    ret = devm_gpio_request(&pdev->dev, dev->gpio_number, DEVICE_NAME);
     if (ret != 0) {
         printk(KERN_ERR "GPIO_DRIVER: Failed to request GPIO %d (error: %d)\n", 
-               gpio_dev_data->gpio_number, ret);
-        kfree(gpio_dev_data);
-        return ret;
+               dev->gpio_number, ret);
+        goto err_minor;
     }
     
-    printk(KERN_INFO "GPIO_DRIVER: GPIO %d requested successfully\n", 
-           gpio_dev_data->gpio_number);
+    /* I2C/SPI expander lines get the shadow/coalescing path */
+    dev->cansleep = gpio_cansleep(dev->gpio_number);
+    dev->input_cache = dev->cansleep && of_property_read_bool(node, "input-cache");
     
-    /* Set default direction to output */
-    ret = gpio_direction_output(gpio_dev_data->gpio_number, 0);
+    /* Reflex sources and buttons with gestures are inputs, the rest outputs */
+    gpio_parse_reflex(dev, node);
+    gpio_parse_gesture(dev, node);
+    if (dev->reflex_np != NULL || (dev->gesture.flags & GPIO_GESTURE_ENABLE)) {
+        ret = gpio_direction_input(dev->gpio_number);
+        dev->direction = GPIO_DIRECTION_INPUT;
+    } else {
+        ret = gpio_direction_output(dev->gpio_number, 0);
+        dev->direction = GPIO_DIRECTION_OUTPUT;
+    }
     if (ret != 0) {
         printk(KERN_ERR "GPIO_DRIVER: Failed to set GPIO direction\n");
-        gpio_free(gpio_dev_data->gpio_number);
-        kfree(gpio_dev_data);
-        return ret;
+        goto err_reflex;
     }
     
-    gpio_dev_data->direction = GPIO_DIRECTION_OUTPUT;
-    gpio_dev_data->value = 0;
-    
-    /* Store platform device as driver data */
-    platform_set_drvdata(pdev, gpio_dev_data);
+    dev->value = gpio_line_sample(dev);
+    dev->pressed = dev->value ^ ((dev->gesture.flags & GPIO_GESTURE_ACTIVE_LOW) ? 1 : 0);
     
-    /* Request IRQ for GPIO (if available in Device Tree) */
-    gpio_irq = irq_of_parse_and_map(node, 0);
-    if (gpio_irq > 0) {
-        ret = request_irq(gpio_irq, gpio_interrupt_handler, 
-                         IRQF_TRIGGER_FALLING, DEVICE_NAME, gpio_dev_data);
-        if (ret == 0) {
-            printk(KERN_INFO "GPIO_DRIVER: IRQ %d registered successfully\n", gpio_irq);
-        } else {
-            printk(KERN_WARN "GPIO_DRIVER: Failed to register IRQ (error: %d)\n", ret);
-            gpio_irq = -1;
+    /* Allocate the page userspace maps to read state without syscalls */
+    dev->shared_page = alloc_page(GFP_KERNEL | __GFP_ZERO);
+    if (dev->shared_page == NULL) {
+        ret = -ENOMEM;
+        goto err_reflex;
+    }
+    dev->shared = page_address(dev->shared_page);
+    dev->shared->version = GPIO_SHARED_STATE_VERSION;
+    gpio_sync_state(dev);
+    
+    /* Store device structure as driver data */
+    platform_set_drvdata(pdev, dev);
+    
+    /*
+     * Request IRQ for GPIO (if available in Device Tree). The handler
+     * publishes to the shared page, so it is freed before the page on every
+     * exit path. Expander IRQs are nested in the expander's IRQ thread,
+     * hence any-context.
+     */
+    dev->irq = irq_of_parse_and_map(node, 0);
+    if (dev->irq > 0) {
+        dev->trigger = gpio_trigger_for(dev, 0, &dev->reflex);
+        ret = devm_request_any_context_irq(&pdev->dev, dev->irq, gpio_interrupt_handler, 
+                                           dev->trigger, DEVICE_NAME, dev);
+        if (ret < 0) {
+            printk(KERN_WARNING "GPIO_DRIVER: Failed to register IRQ (error: %d)\n", ret);
+            dev->irq = -1;
         }
     }
     
+    /* No IRQ: a Device Tree reflex source or button is polled from the start */
+    gpio_poll_update(dev);
+    
     /* Initialize character device */
-    cdev_init(&gpio_dev_data->cdev, &gpio_fops);
-    gpio_dev_data->cdev.owner = THIS_MODULE;
+    cdev_init(&dev->cdev, &gpio_fops);
+    dev->cdev.owner = THIS_MODULE;
     
     /* Add character device to system */
-    ret = cdev_add(&gpio_dev_data->cdev, gpio_device_num, 1);
+    ret = cdev_add(&dev->cdev, MKDEV(MAJOR(gpio_device_num), minor), 1);
     if (ret != 0) {
         printk(KERN_ERR "GPIO_DRIVER: Failed to add character device (error: %d)\n", ret);
-        gpio_free(gpio_dev_data->gpio_number);
-        if (gpio_irq > 0) {
-            free_irq(gpio_irq, gpio_dev_data);
-        }
-        kfree(gpio_dev_data);
-        return ret;
+        goto err_page;
     }
     
-    printk(KERN_INFO "GPIO_DRIVER: Character device added successfully\n");
-    
-    /* Create device node in /dev */
-    gpio_device = device_create(gpio_class, &pdev->dev, gpio_device_num, NULL, DEVICE_NAME);
-    if (IS_ERR(gpio_device)) {
+    /* Create device node in /dev (minor 0 keeps the historical name) */
+    if (minor == 0) {
+        device = device_create_with_groups(gpio_class, &pdev->dev, gpio_device_num, dev,
+                                           gpio_dev_groups, DEVICE_NAME);
+    } else {
+        device = device_create_with_groups(gpio_class, &pdev->dev,
+                                           MKDEV(MAJOR(gpio_device_num), minor), dev,
+                                           gpio_dev_groups, DEVICE_NAME "%d", minor);
+    }
+    if (IS_ERR(device)) {
         printk(KERN_ERR "GPIO_DRIVER: Failed to create device node\n");
-        cdev_del(&gpio_dev_data->cdev);
-        gpio_free(gpio_dev_data->gpio_number);
-        if (gpio_irq > 0) {
-            free_irq(gpio_irq, gpio_dev_data);
-        }
-        kfree(gpio_dev_data);
-        return PTR_ERR(gpio_device);
+        ret = PTR_ERR(device);
+        goto err_cdev;
     }
+    dev->device = device;
+    
+    /* Visible to reflex rules from here on */
+    spin_lock_irqsave(&gpio_devices_lock, flags);
+    gpio_devices[minor] = dev;
+    spin_unlock_irqrestore(&gpio_devices_lock, flags);
+    gpio_resolve_reflexes();
     
-    printk(KERN_INFO "GPIO_DRIVER: Device node /dev/%s created successfully\n", DEVICE_NAME);
-    printk(KERN_INFO "GPIO_DRIVER: Platform device probe completed successfully\n");
+    /* Event readers whose line mask already covered this minor */
+    mutex_lock(&gpio_mutex);
+    gpio_poll_update(dev);
+    mutex_unlock(&gpio_mutex);
+    
+    /* One line per device; boot consoles are slow */
+    dev->probe_ns = ktime_get_ns() - start;
+    printk(KERN_INFO "GPIO_DRIVER: /dev/%s: GPIO %d, IRQ %d, probed in %llu us\n",
+           dev_name(device), dev->gpio_number, dev->irq,
+           (unsigned long long)div_u64(dev->probe_ns, 1000));
     
     return 0;
+    
+err_cdev:
+    cdev_del(&dev->cdev);
+err_page:
+    /* Polling may have started above; its timer must not outlive dev */
+    gpio_poll_stop(dev);
+    if (dev->irq > 0) {
+        devm_free_irq(&pdev->dev, dev->irq, dev);
+    }
+    /* An edge taken meanwhile may have armed these; same order as gpio_remove */
+    hrtimer_cancel(&dev->pulse_timer);
+    hrtimer_cancel(&dev->debounce_timer);
+    hrtimer_cancel(&dev->hold_timer);
+    hrtimer_cancel(&dev->timed_timer);
+    put_page(dev->shared_page);
+err_reflex:
+    of_node_put(dev->reflex_np);
+err_minor:
+    kfree(dev);
+    clear_bit(minor, gpio_minors);
+    return ret;
 }
 
 /*
@@ -455,37 +3589,88 @@ static int gpio_probe(struct platform_device *pdev)
 static int gpio_remove(struct platform_device *pdev)
 {
     struct gpio_device *dev = platform_get_drvdata(pdev);
-    
-    printk(KERN_INFO "GPIO_DRIVER: Remove function called\n");
+    struct gpio_device *src;
+    unsigned long flags;
+    int i;
     
     if (dev == NULL) {
         printk(KERN_ERR "GPIO_DRIVER: Invalid device pointer in remove\n");
         return -EINVAL;
     }
     
-    /* Destroy device node */
-    if (gpio_device != NULL) {
-        device_destroy(gpio_class, gpio_device_num);
-        gpio_device = NULL;
+    /* Files still open keep dev, but every operation on them fails from here */
+    mutex_lock(&gpio_mutex);
+    dev->removed = 1;
+    mutex_unlock(&gpio_mutex);
+    
+    /* Land a coalesced expander write still pending for this line */
+    if (dev->cansleep) {
+        queue_work(system_highpri_wq, &gpio_flush_work);
+        flush_work(&gpio_flush_work);
+    }
+    
+    /*
+     * Unpublish, then detach reflex rules aimed at this line: Device Tree
+     * rules rebind if the target probes again, ioctl rules are dropped
+     */
+    spin_lock_irqsave(&gpio_devices_lock, flags);
+    gpio_devices[dev->minor] = NULL;
+    for (i = 0; i < GPIO_MAX_DEVICES; i++) {
+        src = gpio_devices[i];
+        if (src == NULL || src->reflex.target_line != dev->minor) {
+            continue;
+        }
+        spin_lock(&src->lock);
+        src->reflex.target_line = -1;
+        if (src->reflex_np == NULL) {
+            src->reflex.action = GPIO_REFLEX_NONE;
+        }
+        spin_unlock(&src->lock);
     }
+    spin_unlock_irqrestore(&gpio_devices_lock, flags);
+    
+    /* The flush worker may still hold this line's descriptor */
+    flush_work(&gpio_flush_work);
+    
+    /* Destroy device node */
+    device_destroy(gpio_class, MKDEV(MAJOR(gpio_device_num), dev->minor));
     
     /* Delete character device */
     cdev_del(&dev->cdev);
     
-    /* Free IRQ if allocated */
-    if (gpio_irq > 0) {
-        free_irq(gpio_irq, dev);
-        gpio_irq = -1;
+    /* Quiesce the IRQ or poller before a pulse timer it may arm is cancelled */
+    if (dev->irq > 0) {
+        devm_free_irq(&pdev->dev, dev->irq, dev);
+    } else {
+        mutex_lock(&gpio_mutex);
+        gpio_poll_stop(dev);
+        mutex_unlock(&gpio_mutex);
     }
     
-    /* Free GPIO */
-    gpio_free(dev->gpio_number);
+    /* A pulse started by another line's reflex may still be pending */
+    hrtimer_cancel(&dev->pulse_timer);
     
-    /* Free allocated memory */
-    kfree(dev);
-    gpio_dev_data = NULL;
+    /* The debounce timer arms the hold timer, so it goes first */
+    hrtimer_cancel(&dev->debounce_timer);
+    hrtimer_cancel(&dev->hold_timer);
+    
+    /* Pending timed changes are cancelled; GPIO_TIMED_WAIT callers return */
+    gpio_timed_cancel(dev, NULL);
+    hrtimer_cancel(&dev->timed_timer);
+    
+    /* Nothing signals them any more; open files just lose their registrations */
+    for (i = 0; i < GPIO_EVENTFD_MAX; i++) {
+        if (dev->eventfds[i].ctx != NULL) {
+            eventfd_ctx_put(dev->eventfds[i].ctx);
+            dev->eventfds[i].ctx = NULL;
+        }
+    }
+    
+    of_node_put(dev->reflex_np);
+    clear_bit(dev->minor, gpio_minors);
     
-    printk(KERN_INFO "GPIO_DRIVER: Device removed and cleanup completed\n");
+    /* The GPIO is released by devm; dev goes with the last open file */
+    kref_put(&dev->ref, gpio_device_free);
     
     return 0;
 }
@@ -511,53 +3696,117 @@ static struct platform_driver gpio_platform_driver = {
         .name = "gpio_device_driver",
         .owner = THIS_MODULE,
         .of_match_table = of_match_ptr(gpio_of_match),
+        /* Probe off the boot-critical path; nodes probe in parallel */
+        .probe_type = PROBE_PREFER_ASYNCHRONOUS,
     },
 };
 
+/*
+ * sysfs: /sys/class/gpio_class/init_time_us
+ * Module init only; asynchronous probes report their own probe_time_us
+ */
+static ssize_t init_time_us_show(struct class *class, struct class_attribute *attr, char *buf)
+{
+    return sysfs_emit(buf, "%llu\n", (unsigned long long)div_u64(gpio_init_ns, 1000));
+}
+static CLASS_ATTR_RO(init_time_us);
+
+/*
+ * Event ring per possible CPU, on that CPU's memory node
+ */
+static void gpio_event_rings_free(void)
+{
+    int cpu;
+    
+    for_each_possible_cpu(cpu) {
+        if (gpio_event_rings[cpu] != NULL) {
+            cancel_work_sync(&gpio_event_rings[cpu]->wake_work);
+        }
+        kvfree(gpio_event_rings[cpu]);
+    }
+    kfree(gpio_event_rings);
+    gpio_event_rings = NULL;
+}
+
+static int gpio_event_rings_alloc(void)
+{
+    struct gpio_event_ring *ring;
+    int cpu;
+    
+    gpio_event_rings = kcalloc(nr_cpu_ids, sizeof(*gpio_event_rings), GFP_KERNEL);
+    if (gpio_event_rings == NULL) {
+        return -ENOMEM;
+    }
+    
+    for_each_possible_cpu(cpu) {
+        ring = kvzalloc_node(sizeof(*ring), GFP_KERNEL, cpu_to_node(cpu));
+        if (ring == NULL) {
+            gpio_event_rings_free();
+            return -ENOMEM;
+        }
+        init_waitqueue_head(&ring->wait);
+        INIT_WORK(&ring->wake_work, gpio_ring_wake);
+        gpio_event_rings[cpu] = ring;
+    }
+    
+    return 0;
+}
+
 /*
  * Module Initialization
  * Registers character device class and platform driver
  */
 static int __init gpio_driver_init(void)
 {
+    u64 start = ktime_get_ns();
     int ret;
     
-    printk(KERN_INFO "GPIO_DRIVER: Initializing GPIO Device Driver\n");
+    hrtimer_init(&gpio_coalesce_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    gpio_coalesce_timer.function = gpio_coalesce_expired;
     
-    /* Initialize wait queue for interrupt handling */
-    init_waitqueue_head(&gpio_wait_queue);
+    /* Per-CPU edge histories for the interrupt handlers */
+    ret = gpio_event_rings_alloc();
+    if (ret != 0) {
+        printk(KERN_ERR "GPIO_DRIVER: Failed to allocate event rings\n");
+        return ret;
+    }
     
     /* Allocate character device number (major, minor) */
-    ret = alloc_chrdev_region(&gpio_device_num, 0, 1, DEVICE_NAME);
+    ret = alloc_chrdev_region(&gpio_device_num, 0, GPIO_MAX_DEVICES, DEVICE_NAME);
     if (ret < 0) {
         printk(KERN_ERR "GPIO_DRIVER: Failed to allocate character device number\n");
+        gpio_event_rings_free();
         return ret;
     }
     
-    printk(KERN_INFO "GPIO_DRIVER: Character device number allocated: %d:%d\n",
-           MAJOR(gpio_device_num), MINOR(gpio_device_num));
-    
     /* Create device class */
     gpio_class = class_create(THIS_MODULE, CLASS_NAME);
     if (IS_ERR(gpio_class)) {
         printk(KERN_ERR "GPIO_DRIVER: Failed to create device class\n");
-        unregister_chrdev_region(gpio_device_num, 1);
+        unregister_chrdev_region(gpio_device_num, GPIO_MAX_DEVICES);
+        gpio_event_rings_free();
         return PTR_ERR(gpio_class);
     }
     
-    printk(KERN_INFO "GPIO_DRIVER: Device class created successfully\n");
+    /* Informational only, init goes on without it */
+    if (class_create_file(gpio_class, &class_attr_init_time_us) != 0) {
+        printk(KERN_WARNING "GPIO_DRIVER: Failed to create init_time_us attribute\n");
+    }
     
-    /* Register platform driver */
+    /* Register platform driver; matching nodes probe asynchronously */
     ret = platform_driver_register(&gpio_platform_driver);
     if (ret < 0) {
         printk(KERN_ERR "GPIO_DRIVER: Failed to register platform driver\n");
+        class_remove_file(gpio_class, &class_attr_init_time_us);
         class_destroy(gpio_class);
-        unregister_chrdev_region(gpio_device_num, 1);
+        unregister_chrdev_region(gpio_device_num, GPIO_MAX_DEVICES);
+        gpio_event_rings_free();
         return ret;
     }
     
-    printk(KERN_INFO "GPIO_DRIVER: Platform driver registered successfully\n");
-    printk(KERN_INFO "GPIO_DRIVER: Module initialized\n");
+    gpio_init_ns = ktime_get_ns() - start;
+    printk(KERN_INFO "GPIO_DRIVER: Module initialized (major %d) in %llu us\n",
+           MAJOR(gpio_device_num), (unsigned long long)div_u64(gpio_init_ns, 1000));
     
     return 0;
 }
@@ -568,16 +3817,20 @@ static int __init gpio_driver_init(void)
  */
 static void __exit gpio_driver_exit(void)
 {
-    printk(KERN_INFO "GPIO_DRIVER: Exiting GPIO Device Driver\n");
-    
     /* Unregister platform driver */
     platform_driver_unregister(&gpio_platform_driver);
     
+    hrtimer_cancel(&gpio_coalesce_timer);
+    cancel_work_sync(&gpio_flush_work);
+    
     /* Destroy device class */
+    class_remove_file(gpio_class, &class_attr_init_time_us);
     class_destroy(gpio_class);
     
     /* Unregister character device region */
-    unregister_chrdev_region(gpio_device_num, 1);
+    unregister_chrdev_region(gpio_device_num, GPIO_MAX_DEVICES);
+    
+    gpio_event_rings_free();
     
     printk(KERN_INFO "GPIO_DRIVER: Module exited\n");
 }
@@ -17,12 +17,33 @@
 #include <sys/ioctl.h>
 #include <string.h>
 #include <errno.h>
+#include <stdint.h>
+#include <time.h>
 
 /* IOCTL command definitions */
 #define GPIO_IOCTL_SET_VALUE    _IOW('g', 1, int)
 #define GPIO_IOCTL_GET_VALUE    _IOR('g', 2, int)
 #define GPIO_IOCTL_SET_DIRECTION _IOW('g', 3, int)
 #define GPIO_IOCTL_GET_DIRECTION _IOR('g', 4, int)
+#define GPIO_IOCTL_SET_READ_MODE _IOW('g', 11, int)
+#define GPIO_IOCTL_SET_READ_TIMEOUT _IOW('g', 14, int)
+#define GPIO_IOCTL_SET_EDGES    _IOW('g', 15, int)
+
+#define GPIO_READ_EVENTS        1
+#define GPIO_EDGE_BOTH          3
+#define GPIO_EVENT_RISING       1
+
+/* Record returned by read() in event mode */
+struct gpio_event {
+    uint64_t timestamp_ns;
+    uint64_t duration_ns;
+    uint32_t seqno;
+    uint32_t lost;
+    uint16_t line;
+    uint16_t type;
+    uint16_t flags;
+    uint16_t cpu;
+};
 
 #define GPIO_DIRECTION_INPUT    0
 #define GPIO_DIRECTION_OUTPUT   1
@@ -122,13 +143,18 @@ int example_blink_led()
 
 /*
  * Example 3: Button Monitoring
- * Reads button state continuously
+ * Sleeps in read() until the driver reports a button edge
  */
 int example_button_monitoring()
 {
     int fd, ret, i;
     unsigned char value;
     unsigned char prev_value = 0xFF;
+    struct gpio_event event;
+    struct timespec start, now;
+    int mode = GPIO_READ_EVENTS;
+    int edges = GPIO_EDGE_BOTH;
+    int timeout_ms = 500;
     
     printf("\n=== Example 3: Button Monitoring ===\n");
     
@@ -141,7 +167,32 @@ int example_button_monitoring()
     
     printf("Monitoring for 10 seconds...\n");
     
-    /* Poll for 10 seconds */
+    /* Event mode works on every line; the driver polls lines without an IRQ */
+    if (ioctl(fd, GPIO_IOCTL_SET_EDGES, &edges) == 0 &&
+        ioctl(fd, GPIO_IOCTL_SET_READ_TIMEOUT, &timeout_ms) == 0 &&
+        ioctl(fd, GPIO_IOCTL_SET_READ_MODE, &mode) == 0) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        do {
+            /* Blocks until an edge, or fails with ETIMEDOUT after 500ms */
+            ret = read(fd, &event, sizeof(event));
+            if (ret < 0 && errno != ETIMEDOUT && errno != EINTR) {
+                ERROR_CHECK(ret, "Cannot read GPIO event");
+            }
+            if (ret == sizeof(event)) {
+                printf("Button %s at %llu.%09llu\n",
+                       event.type == GPIO_EVENT_RISING ? "PRESSED" : "RELEASED",
+                       (unsigned long long)(event.timestamp_ns / 1000000000ULL),
+                       (unsigned long long)(event.timestamp_ns % 1000000000ULL));
+            }
+            clock_gettime(CLOCK_MONOTONIC, &now);
+        } while (now.tv_sec - start.tv_sec < 10);
+        
+        close(fd);
+        printf("✓ Monitoring complete\n");
+        return 0;
+    }
+    
+    /* Driver without event support: poll for 10 seconds */
     for (i = 0; i < 20; i++) {  /* 20 x 0.5 sec = 10 sec */
         ret = read(fd, &value, 1);
         ERROR_CHECK(ret, "Cannot read from GPIO");
@@ -0,0 +1,264 @@
+#ifndef __GPIO_HPP__
+#define __GPIO_HPP__
+
+/*
+ * Header-only C++ layer over the GPIO device driver
+ *
+ * Direction is part of the type: Pin<Output> has write(), Pin<Input> has
+ * level(), and calling the wrong one does not compile. Everything is
+ * checked once, when the pin is constructed (open, direction, mmap), so
+ * the hot-path calls are a single ioctl or a load from the driver's
+ * shared state page with no per-call validation.
+ *
+ *   gpio::Pin<gpio::Output> led(0);
+ *   gpio::Pin<gpio::Input> button(2);
+ *   led.write(button.level());
+ *
+ * Constructors throw std::system_error; hot-path calls return the raw
+ * ioctl result instead.
+ */
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdint>
+#include <system_error>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include "gpio_control.h"
+
+namespace gpio {
+
+/* Direction tags */
+struct Input {};
+struct Output {};
+
+/*
+ * Owns the file descriptor of one line (one gpio_dev minor)
+ */
+class Line {
+public:
+    explicit Line(int line)
+    {
+        char path[64];
+
+        if (line < 0 || line >= GPIO_MAX_DEVICES) {
+            throw std::system_error(EINVAL, std::generic_category(), "invalid GPIO line");
+        }
+
+        if (line == 0) {
+            std::snprintf(path, sizeof(path), "%s", GPIO_DEVICE_PATH);
+        } else {
+            std::snprintf(path, sizeof(path), "%s%d", GPIO_DEVICE_PATH, line);
+        }
+
+        fd_ = ::open(path, O_RDWR | O_CLOEXEC);
+        if (fd_ < 0) {
+            throw std::system_error(errno, std::generic_category(), path);
+        }
+    }
+
+    Line(Line &&other) noexcept : fd_(other.fd_)
+    {
+        other.fd_ = -1;
+    }
+
+    Line &operator=(Line &&other) noexcept
+    {
+        if (this != &other) {
+            reset();
+            fd_ = other.fd_;
+            other.fd_ = -1;
+        }
+        return *this;
+    }
+
+    Line(const Line &) = delete;
+    Line &operator=(const Line &) = delete;
+
+    ~Line()
+    {
+        reset();
+    }
+
+    int fd() const noexcept
+    {
+        return fd_;
+    }
+
+    /* Sets the direction once; Pin constructors use this */
+    void set_direction(int direction)
+    {
+        if (::ioctl(fd_, GPIO_IOCTL_SET_DIRECTION, &direction) < 0) {
+            throw std::system_error(errno, std::generic_category(), "GPIO_IOCTL_SET_DIRECTION");
+        }
+    }
+
+private:
+    void reset() noexcept
+    {
+        if (fd_ >= 0) {
+            ::close(fd_);
+            fd_ = -1;
+        }
+    }
+
+    int fd_;
+};
+
+template <typename Direction>
+class Pin {
+    static_assert(sizeof(Direction) == 0, "gpio::Pin direction must be gpio::Input or gpio::Output");
+};
+
+/*
+ * Output pin: the line is switched to output on construction
+ */
+template <>
+class Pin<Output> {
+public:
+    explicit Pin(int line, bool initial = false) : line_(line)
+    {
+        line_.set_direction(GPIO_DIRECTION_OUTPUT);
+        if (write(initial) < 0) {
+            throw std::system_error(errno, std::generic_category(), "GPIO_IOCTL_SET_VALUE");
+        }
+    }
+
+    /* One GPIO_IOCTL_SET_VALUE; returns its result */
+    int write(bool high) const noexcept
+    {
+        int value = high;
+
+        return ::ioctl(line_.fd(), GPIO_IOCTL_SET_VALUE, &value);
+    }
+
+    int set() const noexcept
+    {
+        return write(true);
+    }
+
+    int clear() const noexcept
+    {
+        return write(false);
+    }
+
+    int fd() const noexcept
+    {
+        return line_.fd();
+    }
+
+private:
+    Line line_;
+};
+
+/*
+ * Input pin: the line is switched to input, the driver is asked to watch
+ * both edges (GPIO_IOCTL_WATCH_LEVEL, so the shared level stays current)
+ * and its shared state page is mapped on construction. The edges other
+ * clients' event readers record are left alone.
+ */
+template <>
+class Pin<Input> {
+public:
+    explicit Pin(int line) : line_(line)
+    {
+        int watch = 1;
+
+        line_.set_direction(GPIO_DIRECTION_INPUT);
+        if (::ioctl(line_.fd(), GPIO_IOCTL_WATCH_LEVEL, &watch) < 0) {
+            throw std::system_error(errno, std::generic_category(), "GPIO_IOCTL_WATCH_LEVEL");
+        }
+
+        void *map = ::mmap(nullptr, sizeof(gpio_shared_state), PROT_READ, MAP_SHARED, line_.fd(), 0);
+        if (map == MAP_FAILED) {
+            throw std::system_error(errno, std::generic_category(), "mmap");
+        }
+
+        state_ = static_cast<const gpio_shared_state *>(map);
+        if (state_->version != GPIO_SHARED_STATE_VERSION) {
+            ::munmap(map, sizeof(gpio_shared_state));
+            throw std::system_error(EPROTO, std::generic_category(), "shared state version");
+        }
+    }
+
+    Pin(Pin &&other) noexcept : line_(static_cast<Line &&>(other.line_)), state_(other.state_)
+    {
+        other.state_ = nullptr;
+    }
+
+    Pin(const Pin &) = delete;
+    Pin &operator=(const Pin &) = delete;
+    Pin &operator=(Pin &&) = delete;
+
+    ~Pin()
+    {
+        if (state_ != nullptr) {
+            ::munmap(const_cast<gpio_shared_state *>(state_), sizeof(gpio_shared_state));
+        }
+    }
+
+    /*
+     * Level as of the last edge the driver saw: one load, no system call.
+     * Current for the pin's lifetime: the constructor has the driver
+     * watch both edges until the line is closed.
+     */
+    bool level() const noexcept
+    {
+        return __atomic_load_n(&state_->value, __ATOMIC_ACQUIRE) != 0;
+    }
+
+    /* Edges seen so far: one load */
+    uint64_t edges() const noexcept
+    {
+        return __atomic_load_n(&state_->edges, __ATOMIC_ACQUIRE);
+    }
+
+    /* Samples the line with one GPIO_IOCTL_GET_VALUE; -1 on error */
+    int read() const noexcept
+    {
+        int value;
+
+        if (::ioctl(line_.fd(), GPIO_IOCTL_GET_VALUE, &value) < 0) {
+            return -1;
+        }
+        return value;
+    }
+
+    /* Consistent copy of the whole page (see gpio_read_state) */
+    gpio_shared_state snapshot() const noexcept
+    {
+        gpio_shared_state copy;
+        uint32_t seq;
+
+        for (;;) {
+            seq = __atomic_load_n(&state_->seq, __ATOMIC_ACQUIRE);
+            if (seq & 1) {
+                continue;
+            }
+
+            copy = *state_;
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+            if (__atomic_load_n(&state_->seq, __ATOMIC_RELAXED) == seq) {
+                copy.seq = seq;
+                return copy;
+            }
+        }
+    }
+
+    int fd() const noexcept
+    {
+        return line_.fd();
+    }
+
+private:
+    Line line_;
+    const gpio_shared_state *state_;
+};
+
+} /* namespace gpio */
+
+#endif /* __GPIO_HPP__ */
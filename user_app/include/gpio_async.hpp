@@ -0,0 +1,568 @@
+#ifndef __GPIO_ASYNC_HPP__
+#define __GPIO_ASYNC_HPP__
+
+/*
+ * C++20 coroutine layer over an epoll reactor
+ *
+ * Each device sequence is a gpio::async::Task. Any number of them run on
+ * the one thread that calls Reactor::run():
+ *
+ *   gpio::async::Task sequence(gpio::async::Line &button, gpio::Pin<gpio::Output> &buzzer)
+ *   {
+ *       co_await button.edge(GPIO_EDGE_FALLING);
+ *       buzzer.set();
+ *       co_await gpio::async::sleep_for(button.reactor(), std::chrono::milliseconds(50));
+ *       buzzer.clear();
+ *       co_await button.level(1);
+ *   }
+ *
+ *   reactor.spawn(sequence(button, buzzer));
+ *   reactor.run();
+ *
+ * A waiting sequence costs its coroutine frame and nothing else: the
+ * awaiters live in the frame and are linked into the line's waiter list
+ * or the reactor's timer heap, so there is no thread, fd or allocation
+ * per wait (the heap only grows to the peak number of sleepers). Edges reach the reactor through eventfds the driver signals
+ * (GPIO_IOCTL_SET_EVENTFD); all timers share one timerfd.
+ *
+ * Lines and the reactor must outlive the tasks that use them.
+ */
+
+#include <cerrno>
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <system_error>
+#include <utility>
+#include <vector>
+#include <algorithm>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/timerfd.h>
+
+#include "gpio.hpp"
+
+namespace gpio {
+namespace async {
+
+class Reactor;
+
+/*
+ * Something the reactor polls; ready() runs when its fd is readable
+ */
+class Watch {
+public:
+    virtual void ready() = 0;
+
+protected:
+    ~Watch() = default;
+};
+
+/*
+ * Coroutine type of a sequence. A task starts when it is spawned on a
+ * reactor or awaited by another task; an awaited task resumes its caller
+ * when it finishes.
+ */
+class Task {
+public:
+    struct promise_type {
+        std::coroutine_handle<> continuation;
+        Reactor *reactor = nullptr;     /* Set for spawned (detached) tasks */
+
+        Task get_return_object() noexcept
+        {
+            return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        std::suspend_always initial_suspend() noexcept
+        {
+            return {};
+        }
+
+        struct FinalAwaiter {
+            bool await_ready() const noexcept
+            {
+                return false;
+            }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept;
+
+            void await_resume() const noexcept
+            {
+            }
+        };
+
+        FinalAwaiter final_suspend() noexcept
+        {
+            return {};
+        }
+
+        void return_void() noexcept
+        {
+        }
+
+        /* A sequence has nobody to report to */
+        void unhandled_exception() noexcept
+        {
+            std::terminate();
+        }
+    };
+
+    Task(Task &&other) noexcept : handle_(std::exchange(other.handle_, nullptr))
+    {
+    }
+
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+    Task &operator=(Task &&) = delete;
+
+    ~Task()
+    {
+        if (handle_) {
+            handle_.destroy();
+        }
+    }
+
+    /* co_await task: run it to completion, then continue here */
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept
+    {
+        handle_.promise().continuation = caller;
+        return handle_;
+    }
+
+    void await_resume() const noexcept
+    {
+    }
+
+private:
+    friend class Reactor;
+
+    explicit Task(std::coroutine_handle<promise_type> handle) noexcept : handle_(handle)
+    {
+    }
+
+    std::coroutine_handle<promise_type> handle_;
+};
+
+/*
+ * Single-threaded epoll loop with one timerfd for every pending sleep
+ */
+class Reactor : private Watch {
+public:
+    Reactor()
+    {
+        epfd_ = ::epoll_create1(EPOLL_CLOEXEC);
+        if (epfd_ < 0) {
+            throw std::system_error(errno, std::generic_category(), "epoll_create1");
+        }
+
+        tfd_ = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (tfd_ < 0) {
+            int err = errno;
+
+            ::close(epfd_);
+            throw std::system_error(err, std::generic_category(), "timerfd_create");
+        }
+
+        add(tfd_, this);
+    }
+
+    Reactor(const Reactor &) = delete;
+    Reactor &operator=(const Reactor &) = delete;
+
+    ~Reactor()
+    {
+        ::close(tfd_);
+        ::close(epfd_);
+    }
+
+    /* Start a detached sequence; it runs until its first suspension */
+    void spawn(Task task)
+    {
+        auto handle = std::exchange(task.handle_, nullptr);
+
+        handle.promise().reactor = this;
+        tasks_++;
+        handle.resume();
+    }
+
+    /* Dispatch until every spawned task has finished or stop() is called */
+    void run()
+    {
+        struct epoll_event events[16];
+        int n;
+        int i;
+
+        stopped_ = false;
+        while (tasks_ > 0 && !stopped_) {
+            n = ::epoll_wait(epfd_, events, 16, -1);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::system_error(errno, std::generic_category(), "epoll_wait");
+            }
+
+            for (i = 0; i < n; i++) {
+                static_cast<Watch *>(events[i].data.ptr)->ready();
+            }
+        }
+    }
+
+    void stop() noexcept
+    {
+        stopped_ = true;
+    }
+
+    void add(int fd, Watch *watch)
+    {
+        struct epoll_event ev = {};
+
+        ev.events = EPOLLIN;
+        ev.data.ptr = watch;
+        if (::epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            throw std::system_error(errno, std::generic_category(), "epoll_ctl");
+        }
+    }
+
+    void remove(int fd) noexcept
+    {
+        ::epoll_ctl(epfd_, EPOLL_CTL_DEL, fd, nullptr);
+    }
+
+    /* Pending sleep; lives in the sleeping coroutine's frame */
+    struct Timer {
+        uint64_t deadline_ns;
+        std::coroutine_handle<> handle;
+    };
+
+    void schedule(Timer *timer)
+    {
+        timers_.push_back(timer);
+        std::push_heap(timers_.begin(), timers_.end(), later);
+        if (timers_.front() == timer) {
+            arm();
+        }
+    }
+
+    static uint64_t now_ns() noexcept
+    {
+        struct timespec ts;
+
+        ::clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+    }
+
+private:
+    friend struct Task::promise_type::FinalAwaiter;
+
+    static bool later(const Timer *a, const Timer *b) noexcept
+    {
+        return a->deadline_ns > b->deadline_ns;
+    }
+
+    /* Program the timerfd for the earliest deadline */
+    void arm() noexcept
+    {
+        struct itimerspec its = {};
+
+        if (!timers_.empty()) {
+            its.it_value.tv_sec = (time_t)(timers_.front()->deadline_ns / 1000000000ULL);
+            its.it_value.tv_nsec = (long)(timers_.front()->deadline_ns % 1000000000ULL);
+            if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0) {
+                its.it_value.tv_nsec = 1;   /* All zero would disarm */
+            }
+        }
+        ::timerfd_settime(tfd_, TFD_TIMER_ABSTIME, &its, nullptr);
+    }
+
+    /* timerfd expired: resume every sleeper that is due */
+    void ready() override
+    {
+        std::coroutine_handle<> handle;
+        uint64_t expirations;
+        uint64_t now = now_ns();
+
+        if (::read(tfd_, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) {
+            throw std::system_error(errno, std::generic_category(), "timerfd read");
+        }
+
+        /* A resumed sleeper may schedule again, so pop before resuming */
+        while (!timers_.empty() && timers_.front()->deadline_ns <= now) {
+            handle = timers_.front()->handle;
+            std::pop_heap(timers_.begin(), timers_.end(), later);
+            timers_.pop_back();
+            handle.resume();
+        }
+        arm();
+    }
+
+    int epfd_;
+    int tfd_;
+    bool stopped_ = false;
+    unsigned long tasks_ = 0;
+    std::vector<Timer *> timers_;       /* Min-heap on deadline_ns; keeps its capacity */
+};
+
+inline std::coroutine_handle<> Task::promise_type::FinalAwaiter::await_suspend(
+    std::coroutine_handle<promise_type> h) noexcept
+{
+    std::coroutine_handle<> next = h.promise().continuation;
+    Reactor *reactor = h.promise().reactor;
+
+    /* Awaited tasks are destroyed by their Task object in the caller */
+    if (reactor != nullptr) {
+        reactor->tasks_--;
+        h.destroy();
+    }
+
+    return next ? next : std::noop_coroutine();
+}
+
+/*
+ * co_await sleep_for(reactor, duration)
+ */
+class SleepAwaiter {
+public:
+    SleepAwaiter(Reactor &reactor, uint64_t duration_ns) noexcept : reactor_(reactor)
+    {
+        timer_.deadline_ns = Reactor::now_ns() + duration_ns;
+    }
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        timer_.handle = handle;
+        reactor_.schedule(&timer_);
+    }
+
+    void await_resume() const noexcept
+    {
+    }
+
+private:
+    Reactor &reactor_;
+    Reactor::Timer timer_;
+};
+
+template <typename Rep, typename Period>
+SleepAwaiter sleep_for(Reactor &reactor, std::chrono::duration<Rep, Period> duration)
+{
+    return SleepAwaiter(reactor,
+                        (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+}
+
+/*
+ * Input line whose edges resume awaiting coroutines. The line is set to
+ * input and one eventfd per edge type is registered with the driver.
+ */
+class Line {
+public:
+    /* Waiting coroutine; lives in its frame, linked into waiters_ */
+    struct Waiter {
+        uint32_t edges;                 /* GPIO_EDGE_* that resume it */
+        uint32_t fired;                 /* Edge that did */
+        std::coroutine_handle<> handle;
+        Waiter *next;
+    };
+
+    class EdgeAwaiter {
+    public:
+        EdgeAwaiter(Line &line, uint32_t edges, bool ready) noexcept : line_(line), ready_(ready)
+        {
+            waiter_.edges = edges;
+            waiter_.fired = 0;
+            waiter_.next = nullptr;
+        }
+
+        bool await_ready() const noexcept
+        {
+            return ready_;
+        }
+
+        void await_suspend(std::coroutine_handle<> handle) noexcept
+        {
+            waiter_.handle = handle;
+            line_.enqueue(&waiter_);
+        }
+
+        /* GPIO_EDGE_RISING or GPIO_EDGE_FALLING; 0 if the level already matched */
+        uint32_t await_resume() const noexcept
+        {
+            return waiter_.fired;
+        }
+
+    private:
+        Line &line_;
+        bool ready_;
+        Waiter waiter_;
+    };
+
+    Line(Reactor &reactor, int line) : reactor_(reactor), line_(line)
+    {
+        line_.set_direction(GPIO_DIRECTION_INPUT);
+        rising_.open(*this, GPIO_EDGE_RISING);
+        falling_.open(*this, GPIO_EDGE_FALLING);
+    }
+
+    Line(const Line &) = delete;
+    Line &operator=(const Line &) = delete;
+
+    /* Resumes on the next edge in edges (GPIO_EDGE_RISING/FALLING/BOTH) */
+    EdgeAwaiter edge(uint32_t edges = GPIO_EDGE_BOTH) noexcept
+    {
+        return EdgeAwaiter(*this, edges, false);
+    }
+
+    /* Resumes at once if the line reads value, else on the edge to it */
+    EdgeAwaiter level(int value) noexcept
+    {
+        return EdgeAwaiter(*this, value ? GPIO_EDGE_RISING : GPIO_EDGE_FALLING,
+                           read() == (value ? 1 : 0));
+    }
+
+    /* One GPIO_IOCTL_GET_VALUE; -1 on error */
+    int read() const noexcept
+    {
+        int value;
+
+        if (::ioctl(line_.fd(), GPIO_IOCTL_GET_VALUE, &value) < 0) {
+            return -1;
+        }
+        return value;
+    }
+
+    Reactor &reactor() noexcept
+    {
+        return reactor_;
+    }
+
+    int fd() const noexcept
+    {
+        return line_.fd();
+    }
+
+private:
+    /* eventfd the driver counts one edge type into */
+    class Notifier : public Watch {
+    public:
+        ~Notifier()
+        {
+            close();
+        }
+
+        void open(Line &line, uint32_t edge)
+        {
+            struct gpio_eventfd req = {};
+
+            line_ = &line;
+            edge_ = edge;
+            efd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (efd_ < 0) {
+                throw std::system_error(errno, std::generic_category(), "eventfd");
+            }
+
+            req.fd = efd_;
+            req.edges = edge;
+            if (::ioctl(line.fd(), GPIO_IOCTL_SET_EVENTFD, &req) < 0) {
+                int err = errno;
+
+                close();
+                throw std::system_error(err, std::generic_category(), "GPIO_IOCTL_SET_EVENTFD");
+            }
+
+            line.reactor_.add(efd_, this);
+        }
+
+        void close() noexcept
+        {
+            if (efd_ >= 0) {
+                line_->reactor_.remove(efd_);
+                ::close(efd_);
+                efd_ = -1;
+            }
+        }
+
+        void ready() override
+        {
+            uint64_t count;
+
+            /* Edges coalesce: one wakeup per batch, whatever the count */
+            if (::read(efd_, &count, sizeof(count)) == (ssize_t)sizeof(count)) {
+                line_->dispatch(edge_);
+            }
+        }
+
+    private:
+        Line *line_ = nullptr;
+        uint32_t edge_ = 0;
+        int efd_ = -1;
+    };
+
+    void enqueue(Waiter *waiter) noexcept
+    {
+        waiter->next = nullptr;
+        if (tail_ != nullptr) {
+            tail_->next = waiter;
+        } else {
+            head_ = waiter;
+        }
+        tail_ = waiter;
+    }
+
+    /*
+     * Resume, in arrival order, every waiter that wanted edge. The list is
+     * rebuilt first so that resumed coroutines can wait again.
+     */
+    void dispatch(uint32_t edge)
+    {
+        Waiter *waiter = head_;
+        Waiter *woken = nullptr;
+        Waiter **woken_tail = &woken;
+        Waiter *next;
+
+        head_ = nullptr;
+        tail_ = nullptr;
+        for (; waiter != nullptr; waiter = next) {
+            next = waiter->next;
+            if (waiter->edges & edge) {
+                waiter->fired = edge;
+                waiter->next = nullptr;
+                *woken_tail = waiter;
+                woken_tail = &waiter->next;
+            } else {
+                enqueue(waiter);
+            }
+        }
+
+        for (waiter = woken; waiter != nullptr; waiter = next) {
+            next = waiter->next;
+            waiter->handle.resume();
+        }
+    }
+
+    Reactor &reactor_;
+    gpio::Line line_;
+    Notifier rising_;
+    Notifier falling_;
+    Waiter *head_ = nullptr;
+    Waiter *tail_ = nullptr;
+};
+
+} /* namespace async */
+} /* namespace gpio */
+
+#endif /* __GPIO_ASYNC_HPP__ */
@@ -0,0 +1,57 @@
+#ifndef __GPIO_BITMAP_H__
+#define __GPIO_BITMAP_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Bitmap capture file layout (little-endian):
+ *
+ *   file header
+ *   block*   one plane per line of line_mask, lowest minor first, each
+ *            plane_bytes long (exactly what one GPIO_READ_BITMAP read()
+ *            returns); sample k of a plane is bit k % 8 of byte k / 8
+ */
+#define GPIO_BITMAP_FILE_MAGIC      0x4d425047u     /* "GPBM" */
+#define GPIO_BITMAP_FILE_VERSION    1
+
+struct gpio_bitmap_file_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t line_mask;
+    uint32_t plane_bytes;           /* Per line per block */
+    uint32_t reserved;
+    uint64_t blocks;
+    uint64_t sample_ps;             /* Mean sample period, picoseconds */
+};
+
+/*
+ * Decoder state of one line, carried from plane to plane. Pulse widths
+ * are in samples and count only pulses with an edge at both ends.
+ */
+struct gpio_bitmap_line {
+    uint64_t samples;               /* Samples decoded so far */
+    uint64_t high_samples;
+    uint64_t rising;
+    uint64_t falling;
+    uint64_t last_edge;             /* Sample index of the last edge */
+    int level;                      /* Level of the last decoded sample, -1 = none yet */
+    uint64_t high_pulses;
+    uint64_t high_min;
+    uint64_t high_max;
+    uint64_t high_sum;
+    uint64_t low_pulses;
+    uint64_t low_min;
+    uint64_t low_max;
+    uint64_t low_sum;
+};
+
+/* Function Prototypes */
+void gpio_bitmap_line_init(struct gpio_bitmap_line *line);
+size_t gpio_bitmap_edges(struct gpio_bitmap_line *line, const uint8_t *plane, size_t bytes,
+                         uint64_t *edges, size_t capacity);
+const char *gpio_bitmap_kernel(void);
+int gpio_bitmap_use(const char *name);
+
+#endif /* __GPIO_BITMAP_H__ */
@@ -2,17 +2,348 @@
 #define __GPIO_CONTROL_H__
 
 #include <stdint.h>
+#include <sys/ioctl.h>
+#include <linux/filter.h>
 
-/* GPIO Device Path */
+/* GPIO Device Path (line 0; line N is GPIO_DEVICE_PATH "N") */
 #define GPIO_DEVICE_PATH "/dev/gpio_dev"
+#define GPIO_MAX_DEVICES 8
+
+/* IOCTL commands - mirrors kernel definitions in driver/include/gpio_driver.h */
+#define GPIO_IOCTL_SET_VALUE    _IOW('g', 1, int)
+#define GPIO_IOCTL_GET_VALUE    _IOR('g', 2, int)
+#define GPIO_IOCTL_SET_DIRECTION _IOW('g', 3, int)
+#define GPIO_IOCTL_GET_DIRECTION _IOR('g', 4, int)
+#define GPIO_IOCTL_SET_COUNTER  _IOW('g', 5, int)
+#define GPIO_IOCTL_GET_COUNTER  _IOR('g', 6, struct gpio_counter_info)
+#define GPIO_IOCTL_SET_REFLEX   _IOW('g', 7, struct gpio_reflex)
+#define GPIO_IOCTL_GET_REFLEX   _IOR('g', 8, struct gpio_reflex)
+#define GPIO_IOCTL_GET_STATE    _IOWR('g', 9, struct gpio_state)
+#define GPIO_IOCTL_RUN_OPS      _IOWR('g', 10, struct gpio_op_list)
+#define GPIO_IOCTL_SET_READ_MODE _IOW('g', 11, int)
+#define GPIO_IOCTL_SET_LINE_MASK _IOW('g', 12, uint32_t)
+#define GPIO_IOCTL_GET_EVENT_STATS _IOR('g', 13, struct gpio_event_stats)
+#define GPIO_IOCTL_SET_READ_TIMEOUT _IOW('g', 14, int)
+#define GPIO_IOCTL_SET_EDGES    _IOW('g', 15, int)
+#define GPIO_IOCTL_SET_WAKEUP   _IOW('g', 16, struct gpio_wakeup)
+#define GPIO_IOCTL_GET_CPU_STATS _IOWR('g', 17, struct gpio_cpu_stats_list)
+#define GPIO_IOCTL_SET_GESTURE  _IOW('g', 18, struct gpio_gesture)
+#define GPIO_IOCTL_GET_GESTURE  _IOR('g', 19, struct gpio_gesture)
+#define GPIO_IOCTL_SET_FILTER   _IOW('g', 20, struct gpio_filter)
+#define GPIO_IOCTL_SET_EVENTFD  _IOW('g', 21, struct gpio_eventfd)
+#define GPIO_IOCTL_SCHEDULE     _IOWR('g', 22, struct gpio_timed_list)
+#define GPIO_IOCTL_GET_TIMED    _IOWR('g', 23, struct gpio_timed_list)
+#define GPIO_IOCTL_WATCH_LEVEL  _IOW('g', 24, int)
+
+/* GPIO Direction constants */
+#define GPIO_DIRECTION_INPUT    0
+#define GPIO_DIRECTION_OUTPUT   1
+
+/* GPIO Value constants */
+#define GPIO_VALUE_LOW          0
+#define GPIO_VALUE_HIGH         1
+
+/* Edge selectors */
+#define GPIO_EDGE_RISING        1
+#define GPIO_EDGE_FALLING       2
+#define GPIO_EDGE_BOTH          3
+
+/* Reflex actions, run by the driver's IRQ handler */
+#define GPIO_REFLEX_NONE        0
+#define GPIO_REFLEX_SET         1
+#define GPIO_REFLEX_CLEAR       2
+#define GPIO_REFLEX_TOGGLE      3
+#define GPIO_REFLEX_PULSE       4
+
+#define GPIO_REFLEX_MAX_PULSE_US 1000000
+
+/* On an edge of this line, drive target_line (another gpio_dev minor) */
+struct gpio_reflex {
+    int32_t target_line;
+    uint32_t action;
+    uint32_t edge;
+    uint32_t pulse_us;
+};
+
+/*
+ * Gesture layer: debounces the line and records button gestures instead
+ * of raw edges. Thresholds in ms; 0 disables the gesture it controls.
+ */
+#define GPIO_GESTURE_ENABLE     (1 << 0)
+#define GPIO_GESTURE_ACTIVE_LOW (1 << 1)    /* Pressed reads 0 */
+#define GPIO_GESTURE_MAX_MS     60000
+
+#define GPIO_GESTURE_DEBOUNCE_MS        20
+#define GPIO_GESTURE_LONG_PRESS_MS      800
+#define GPIO_GESTURE_DOUBLE_CLICK_MS    300
+
+struct gpio_gesture {
+    uint32_t flags;             /* GPIO_GESTURE_* */
+    uint32_t debounce_ms;       /* Level must be stable this long */
+    uint32_t long_press_ms;
+    uint32_t repeat_ms;
+    uint32_t double_click_ms;   /* Max time between the two presses */
+    uint32_t reserved;
+};
+
+/*
+ * Edge notification through an eventfd: the driver's edge path adds 1 per
+ * matching edge, so one read() of the eventfd returns the edges since the
+ * last read. Each file holds at most one registration per edge type; a
+ * new one replaces it and fd = -1 removes it. Closing the file drops them.
+ */
+#define GPIO_EVENTFD_MAX        8       /* Registrations per line */
+
+struct gpio_eventfd {
+    int32_t fd;                 /* eventfd, or -1 to unregister */
+    uint32_t edges;             /* GPIO_EDGE_* that signal it */
+};
+
+/* Full line state; set size before GPIO_IOCTL_GET_STATE, fields are only appended */
+#define GPIO_STATE_VERSION      1
+#define GPIO_STATE_SIZE_VER1    64
+
+#define GPIO_STATE_HAS_IRQ      (1 << 0)
+#define GPIO_STATE_COUNTER      (1 << 1)
+#define GPIO_STATE_REFLEX       (1 << 2)
+#define GPIO_STATE_EXPANDER     (1 << 3)    /* Sleeping line: shadowed, coalesced writes */
+#define GPIO_STATE_POLLED       (1 << 4)    /* No IRQ: edges come from the poll timer */
+#define GPIO_STATE_GESTURE      (1 << 5)
+
+struct gpio_state {
+    uint32_t size;              /* In: sizeof(struct gpio_state), out: bytes filled */
+    uint32_t version;
+    int32_t line;               /* Minor number */
+    uint32_t gpio;              /* GPIO number */
+    uint32_t value;
+    uint32_t direction;
+    uint32_t trigger;           /* GPIO_EDGE_* the IRQ fires on, 0 = no IRQ */
+    uint32_t flags;             /* GPIO_STATE_* */
+    uint64_t edges;
+    uint64_t rising;
+    uint64_t falling;
+    uint64_t last_edge_ns;      /* CLOCK_MONOTONIC ns of the latest edge */
+};
+
+/* Batched operations, run by the driver in one ioctl */
+#define GPIO_OP_SET             1   /* Drive arg (0/1) */
+#define GPIO_OP_GET             2   /* Sample into result */
+#define GPIO_OP_WAIT_LEVEL      3   /* Wait up to ns for level arg */
+#define GPIO_OP_DELAY_NS        4   /* Wait ns */
+#define GPIO_OP_TOGGLE          5   /* Invert the output */
+
+#define GPIO_OPS_MAX            256
+#define GPIO_OPS_ATOMIC         (1 << 0)    /* Run with preemption disabled */
+#define GPIO_OPS_ATOMIC_MAX_NS  100000      /* Delay + wait budget when atomic */
+#define GPIO_OPS_MAX_NS         1000000000ULL /* Delay + wait budget otherwise */
+
+struct gpio_op {
+    uint16_t code;              /* GPIO_OP_* */
+    uint16_t reserved;
+    int32_t arg;
+    uint64_t ns;
+    int32_t result;             /* Out: sampled level, or -ETIMEDOUT */
+    uint32_t reserved2;
+    uint64_t timestamp_ns;      /* Out: CLOCK_MONOTONIC ns when the op completed */
+};
+
+struct gpio_op_list {
+    uint64_t ops;               /* Pointer to struct gpio_op[count] */
+    uint32_t count;
+    uint32_t flags;             /* GPIO_OPS_* */
+    uint32_t completed;         /* Out: ops executed */
+    int32_t error;              /* Out: 0 or -errno of the op that stopped the list */
+    uint64_t duration_ns;       /* Out: time from first to last op */
+};
+
+/*
+ * Timed output: level changes at absolute CLOCK_MONOTONIC times, applied
+ * by an hrtimer in the driver. Ids come back from GPIO_IOCTL_SCHEDULE;
+ * GPIO_TIMED_WAIT waits for the changes, GPIO_IOCTL_GET_TIMED polls them.
+ */
+#define GPIO_TIMED_MAX          32      /* Pending changes per line */
+#define GPIO_TIMED_HISTORY      64      /* Results kept per line */
+#define GPIO_TIMED_WAIT         (1 << 0)
+
+struct gpio_timed {
+    uint64_t at_ns;             /* CLOCK_MONOTONIC deadline, < 2^63; past ones fire at once */
+    int32_t value;
+    int32_t result;             /* Out: 0, -EINPROGRESS, -ECANCELED, -EACCES, -ENOENT */
+    uint64_t id;                /* Out of SCHEDULE, in to GET_TIMED */
+    uint64_t fired_ns;          /* Out: CLOCK_MONOTONIC ns right after the line was driven */
+};
+
+struct gpio_timed_list {
+    uint64_t changes;           /* Pointer to struct gpio_timed[count] */
+    uint32_t count;
+    uint32_t flags;             /* GPIO_TIMED_* */
+};
+
+/* What read() returns on a file */
+#define GPIO_READ_VALUE         0   /* 1 byte: current level (default) */
+#define GPIO_READ_EVENTS        1   /* struct gpio_event records */
+#define GPIO_READ_BITMAP        2   /* One plane per line of the mask, bit per sample */
+
+#define GPIO_BITMAP_MAX_SAMPLES 65536   /* Per line per read() */
+
+/* Event read timeout in ms: block forever (default) or return at once */
+#define GPIO_TIMEOUT_INFINITE   (-1)
+#define GPIO_TIMEOUT_NONE       0
+
+#define GPIO_EVENT_RISING       1
+#define GPIO_EVENT_FALLING      2
+
+/* Gesture events, replacing raw edges on a line with gestures enabled */
+#define GPIO_EVENT_PRESS        3
+#define GPIO_EVENT_RELEASE      4   /* duration_ns: how long it was held */
+#define GPIO_EVENT_LONG_PRESS   5   /* Held for long_press_ms */
+#define GPIO_EVENT_REPEAT       6   /* Every repeat_ms after LONG_PRESS */
+#define GPIO_EVENT_DOUBLE_CLICK 7   /* Instead of PRESS; duration_ns: since the first press */
+
+/* Edge record; every open file has its own cursor into the driver's history */
+struct gpio_event {
+    uint64_t timestamp_ns;      /* CLOCK_MONOTONIC ns in the IRQ handler */
+    uint64_t duration_ns;       /* Time since the previous edge on this line */
+    uint32_t seqno;             /* Driver-wide event sequence number */
+    uint32_t lost;              /* Events this reader missed just before this one */
+    uint16_t line;              /* Minor number of the source line */
+    uint16_t type;              /* GPIO_EVENT_* */
+    uint16_t flags;             /* GPIO_EVENT_FLAG_* */
+    uint16_t cpu;               /* CPU that handled the IRQ */
+};
+
+/* Polled line: timestamp is when the new level was sampled */
+#define GPIO_EVENT_FLAG_POLLED  (1 << 0)
+
+/*
+ * Per-file event filter: a classic BPF program (struct sock_filter from
+ * <linux/filter.h>) run on each event before it counts for the file, so
+ * rejected events cost the reader no wakeup and no copy. BPF_ABS loads read
+ * struct gpio_filter_ctx in host byte order; a non-zero return keeps the
+ * event. Jumps go forward only. Scratch memory M[] keeps its contents from
+ * event to event (cleared on attach), so programs can count. count = 0
+ * detaches; attaching or detaching discards unread events.
+ */
+#define GPIO_FILTER_MAX_INSNS   64
+#define GPIO_FILTER_MEMWORDS    16
+
+struct gpio_filter {
+    uint64_t insns;             /* User pointer to struct sock_filter[count] */
+    uint32_t count;
+    uint32_t reserved;
+};
+
+/* What a filter program loads from */
+struct gpio_filter_ctx {
+    struct gpio_event event;    /* lost is always 0 */
+    uint32_t duration_us;       /* event.duration_ns / 1000, saturated */
+    uint32_t reserved;
+};
+
+/* Wake an event reader at watermark events or after max_latency_us */
+#define GPIO_WAKEUP_MAX_LATENCY_US  10000000
+
+struct gpio_wakeup {
+    uint32_t watermark;         /* 1 (default) .. GPIO_EVENT_RING_SIZE */
+    uint32_t max_latency_us;    /* 0 = no latency timer */
+};
+
+struct gpio_event_stats {
+    uint64_t delivered;         /* Events read by this file */
+    uint64_t overruns;          /* Events this file lost to ring wrap-around */
+    uint64_t pending;           /* Events past this file's cursor (all lines) */
+    uint64_t total;             /* Events recorded by the driver */
+};
+
+/* One CPU's share of the edge history, as seen by the calling file */
+struct gpio_cpu_stats {
+    uint32_t cpu;
+    uint32_t reserved;
+    uint64_t recorded;          /* Events this CPU's IRQs recorded */
+    uint64_t dropped;           /* Of those, overwritten before this file read them */
+};
+
+struct gpio_cpu_stats_list {
+    uint64_t stats;             /* Pointer to struct gpio_cpu_stats[count] */
+    uint32_t count;             /* In: capacity, out: possible CPUs */
+    uint32_t reserved;
+};
+
+/* Counter snapshot returned by GPIO_IOCTL_GET_COUNTER */
+struct gpio_counter_info {
+    uint32_t enabled;
+    uint32_t reserved;
+    uint64_t edges;             /* Rising + falling since counter was enabled */
+    uint64_t rising;
+    uint64_t falling;
+    uint64_t last_edge_ns;      /* CLOCK_MONOTONIC ns of the latest edge */
+    uint64_t period_ns;         /* Rolling average rising-to-rising time */
+    uint64_t high_ns;           /* Rolling average rising-to-falling time */
+    uint64_t frequency_millihz; /* 1e12 / period_ns, 0 when the signal stopped */
+    uint32_t duty_permille;     /* 1000 * high_ns / period_ns */
+    uint32_t reserved2;
+};
+
+/* Read-only state page mapped from the device (seq odd = update in progress) */
+#define GPIO_SHARED_STATE_VERSION 1
+
+struct gpio_shared_state {
+    uint32_t seq;
+    uint32_t version;
+    uint32_t value;
+    uint32_t direction;
+    uint32_t counter_enabled;
+    uint32_t reserved;
+    uint64_t edges;
+    uint64_t rising;
+    uint64_t falling;
+    uint64_t last_edge_ns;
+    uint64_t period_ns;
+    uint64_t high_ns;
+};
 
 /* Function Prototypes */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 int gpio_open_device(void);
+int gpio_open_line(int line);
 int gpio_close_device(int fd);
 int gpio_read_value(int fd, uint8_t *value);
 int gpio_write_value(int fd, uint8_t value);
 int gpio_set_direction(int fd, uint8_t direction);
 int gpio_get_direction(int fd, uint8_t *direction);
+int gpio_get_state(int fd, struct gpio_state *state);
 void gpio_print_status(int fd);
+int gpio_counter_enable(int fd, int enable);
+int gpio_counter_read(int fd, struct gpio_counter_info *info);
+const struct gpio_shared_state *gpio_map_state(int fd);
+void gpio_unmap_state(const struct gpio_shared_state *state);
+void gpio_read_state(const struct gpio_shared_state *state, struct gpio_shared_state *snapshot);
+int gpio_run_ops(int fd, struct gpio_op *ops, uint32_t count, uint32_t flags,
+                 struct gpio_op_list *list);
+int gpio_set_read_mode(int fd, int mode);
+int gpio_set_line_mask(int fd, uint32_t mask);
+int gpio_set_read_timeout(int fd, int timeout_ms);
+int gpio_set_wakeup(int fd, uint32_t watermark, uint32_t max_latency_us);
+int gpio_set_edges(int fd, int edges);
+int gpio_read_events(int fd, struct gpio_event *events, int max_events);
+int gpio_get_event_stats(int fd, struct gpio_event_stats *stats);
+int gpio_get_cpu_stats(int fd, struct gpio_cpu_stats *stats, int capacity);
+int gpio_set_reflex(int fd, const struct gpio_reflex *rule);
+int gpio_get_reflex(int fd, struct gpio_reflex *rule);
+int gpio_set_gesture(int fd, const struct gpio_gesture *gesture);
+int gpio_get_gesture(int fd, struct gpio_gesture *gesture);
+const char *gpio_event_name(uint16_t type);
+int gpio_set_filter(int fd, const struct sock_filter *insns, uint32_t count);
+int gpio_filter_compile(const char *spec, struct sock_filter *insns, int capacity);
+int gpio_set_eventfd(int fd, int efd, uint32_t edges);
+int gpio_schedule(int fd, struct gpio_timed *changes, uint32_t count, uint32_t flags);
+int gpio_get_timed(int fd, struct gpio_timed *changes, uint32_t count);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif /* __GPIO_CONTROL_H__ */
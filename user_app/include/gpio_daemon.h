@@ -0,0 +1,43 @@
+#ifndef __GPIO_DAEMON_H__
+#define __GPIO_DAEMON_H__
+
+#include <stdint.h>
+
+/* Default daemon socket (SOCK_SEQPACKET, one message per packet) */
+#define GPIOD_SOCKET_PATH       "/run/gpio_dev.sock"
+
+/* Server limits */
+#define GPIOD_MAX_CLIENTS       1024
+#define GPIOD_MAX_BATCH         512
+#define GPIOD_MAX_PER_CLIENT    16      /* Messages drained per client per round */
+
+/* Request / reply / notification opcodes */
+#define GPIOD_OP_READ           1       /* reply arg = value */
+#define GPIOD_OP_WRITE          2       /* arg = value */
+#define GPIOD_OP_SET_DIRECTION  3       /* arg = direction */
+#define GPIOD_OP_GET_DIRECTION  4       /* reply arg = direction */
+#define GPIOD_OP_SUBSCRIBE      5       /* start receiving GPIOD_OP_EVENT */
+#define GPIOD_OP_UNSUBSCRIBE    6
+#define GPIOD_OP_EVENT          7       /* server -> client, arg = new value */
+
+/*
+ * Wire message (24 bytes, host byte order - the socket is local).
+ * Replies echo op and seq; status is 0 or a positive errno value.
+ */
+struct gpiod_msg {
+    uint8_t op;
+    uint8_t status;
+    uint16_t reserved;
+    uint32_t seq;
+    int32_t arg;
+    uint32_t reserved2;
+    uint64_t timestamp_ns;      /* CLOCK_MONOTONIC, set on replies and events */
+};
+
+/* Function Prototypes */
+int gpiod_serve(int dev_fd, const char *socket_path, volatile int *keep_running);
+int gpiod_connect(const char *socket_path);
+int gpiod_request(int sock, uint8_t op, int32_t arg, int32_t *result);
+int gpiod_next_event(int sock, struct gpiod_msg *event);
+
+#endif /* __GPIO_DAEMON_H__ */
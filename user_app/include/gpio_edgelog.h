@@ -0,0 +1,127 @@
+#ifndef __GPIO_EDGELOG_H__
+#define __GPIO_EDGELOG_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Binary edge log layout (little-endian, append-only):
+ *
+ *   file header
+ *   chunk*  [index block after every GPIO_EDGELOG_INDEX_INTERVAL chunks]
+ *   final index block + trailer (written by gpio_edgelog_close)
+ *
+ * Every block starts with { u32 magic, u32 length } so a reader can hop
+ * from block to block without decoding records. Chunk records are LEB128
+ * varints of (delta_ns << 1 | level), delta relative to the previous
+ * edge (the first record of a chunk is relative to chunk first_ts).
+ */
+#define GPIO_EDGELOG_MAGIC          0x4c455047u     /* "GPEL" */
+#define GPIO_EDGELOG_CHUNK_MAGIC    0x4b435047u     /* "GPCK" */
+#define GPIO_EDGELOG_INDEX_MAGIC    0x58495047u     /* "GPIX" */
+#define GPIO_EDGELOG_TRAILER_MAGIC  0x54455047u     /* "GPET" */
+#define GPIO_EDGELOG_VERSION        1
+
+#define GPIO_EDGELOG_CHUNK_BYTES    16384   /* Max record payload per chunk */
+#define GPIO_EDGELOG_INDEX_INTERVAL 64      /* Chunks per index block */
+
+struct gpio_edgelog_file_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t line;
+    int64_t realtime_offset_ns;     /* CLOCK_REALTIME - CLOCK_MONOTONIC at creation */
+    uint64_t reserved;
+};
+
+struct gpio_edgelog_chunk_header {
+    uint32_t magic;
+    uint32_t length;                /* Payload bytes following this header */
+    uint32_t count;                 /* Records in the payload */
+    uint32_t reserved;
+    uint64_t first_ts;              /* CLOCK_MONOTONIC ns of the first record */
+    uint64_t last_ts;
+};
+
+struct gpio_edgelog_index_entry {
+    uint64_t first_ts;
+    uint64_t last_ts;
+    uint64_t offset;                /* File offset of the chunk header */
+};
+
+struct gpio_edgelog_index_header {
+    uint32_t magic;
+    uint32_t length;                /* Entry bytes following this header */
+    uint32_t count;
+    uint32_t reserved;
+    uint64_t prev_index;            /* Offset of the previous index block, 0 = none */
+};
+
+struct gpio_edgelog_trailer {
+    uint32_t magic;
+    uint32_t length;                /* Always 8 */
+    uint64_t last_index;            /* Offset of the final index block */
+};
+
+/* One decoded edge */
+struct gpio_edge {
+    uint64_t timestamp_ns;
+    int value;
+};
+
+/* Writer state */
+struct gpio_edgelog_writer {
+    int fd;
+    uint64_t offset;                /* Current end of file */
+    uint8_t payload[GPIO_EDGELOG_CHUNK_BYTES];
+    size_t used;
+    uint32_t count;
+    uint64_t first_ts;
+    uint64_t last_ts;
+    uint64_t prev_index;
+    struct gpio_edgelog_index_entry pending[GPIO_EDGELOG_INDEX_INTERVAL];
+    uint32_t npending;
+    uint64_t total_events;
+};
+
+/* mmap-based reader */
+struct gpio_edgelog_reader {
+    int fd;
+    const uint8_t *base;
+    size_t size;
+    int64_t realtime_offset_ns;
+    struct gpio_edgelog_index_entry *dir;   /* All chunks, in file order */
+    size_t nchunks;
+};
+
+/* Sequential decoder over a reader */
+struct gpio_edgelog_iter {
+    const struct gpio_edgelog_reader *reader;
+    size_t chunk;                   /* Next chunk to open */
+    const uint8_t *p;
+    const uint8_t *end;
+    uint32_t remaining;             /* Records left in the current chunk */
+    uint64_t ts;
+    uint64_t from_ns;               /* Skip edges before this timestamp */
+    uint64_t until_ns;              /* Stop after this timestamp */
+    size_t readahead;               /* Bytes to prefetch ahead, 0 = off */
+    size_t prefetched;              /* File offset prefetched up to */
+    size_t released;                /* File offset released up to */
+};
+
+/* Function Prototypes */
+int gpio_edgelog_create(struct gpio_edgelog_writer *writer, const char *path, uint32_t line);
+int gpio_edgelog_append(struct gpio_edgelog_writer *writer, uint64_t timestamp_ns, int value);
+int gpio_edgelog_flush(struct gpio_edgelog_writer *writer);
+int gpio_edgelog_close(struct gpio_edgelog_writer *writer);
+
+int gpio_edgelog_open(struct gpio_edgelog_reader *reader, const char *path);
+void gpio_edgelog_release(struct gpio_edgelog_reader *reader);
+uint64_t gpio_edgelog_first_ts(const struct gpio_edgelog_reader *reader);
+uint64_t gpio_edgelog_last_ts(const struct gpio_edgelog_reader *reader);
+void gpio_edgelog_seek(const struct gpio_edgelog_reader *reader, struct gpio_edgelog_iter *iter,
+                       uint64_t from_ns, uint64_t until_ns);
+int gpio_edgelog_next(struct gpio_edgelog_iter *iter, struct gpio_edge *edge);
+void gpio_edgelog_set_readahead(struct gpio_edgelog_iter *iter, size_t bytes);
+
+#endif /* __GPIO_EDGELOG_H__ */
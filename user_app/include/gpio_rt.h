@@ -0,0 +1,40 @@
+#ifndef __GPIO_RT_H__
+#define __GPIO_RT_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+/* Defaults for --rt mode */
+#define GPIO_RT_DEFAULT_PRIORITY    80
+#define GPIO_RT_STACK_PREFAULT      (256 * 1024)
+
+/* Jitter histogram: bucket N counts wakeups late by [2^(N-1), 2^N) us */
+#define GPIO_RT_HIST_BUCKETS        24
+
+/* Real-time execution settings (filled from the command line) */
+struct gpio_rt_config {
+    int enabled;        /* Non-zero when --rt was given */
+    int priority;       /* SCHED_FIFO priority (1..99) */
+    int cpu;            /* CPU to pin to, -1 = leave affinity alone */
+};
+
+/* Wakeup latency statistics for absolute-deadline sleeps */
+struct gpio_rt_stats {
+    uint64_t samples;
+    int64_t min_ns;
+    int64_t max_ns;
+    int64_t sum_ns;
+    uint64_t buckets[GPIO_RT_HIST_BUCKETS];
+};
+
+/* Function Prototypes */
+int gpio_rt_setup(const struct gpio_rt_config *config);
+void gpio_rt_deadline_init(struct timespec *deadline);
+void gpio_rt_deadline_add(struct timespec *deadline, int64_t ns);
+int gpio_rt_sleep_until(const struct timespec *deadline, struct gpio_rt_stats *stats);
+void gpio_rt_stats_init(struct gpio_rt_stats *stats);
+void gpio_rt_stats_record(struct gpio_rt_stats *stats, int64_t latency_ns);
+void gpio_rt_stats_print(const struct gpio_rt_stats *stats, FILE *out);
+
+#endif /* __GPIO_RT_H__ */
@@ -0,0 +1,49 @@
+#ifndef __GPIO_SHM_RING_H__
+#define __GPIO_SHM_RING_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Default POSIX shared memory name (appears as /dev/shm/gpio_dev_events) */
+#define GPIO_RING_DEFAULT_NAME      "/gpio_dev_events"
+#define GPIO_RING_DEFAULT_CAPACITY  4096    /* Events, power of two */
+
+/* Consumers map the ring read-write (they register as futex waiters) */
+#define GPIO_RING_MODE              0660
+
+#define GPIO_RING_MAGIC             0x47524e47u     /* "GNRG" */
+#define GPIO_RING_VERSION           1
+
+/* Edge event as seen by consumers */
+struct gpio_ring_event {
+    uint64_t timestamp_ns;      /* CLOCK_MONOTONIC */
+    int32_t value;              /* Level after the edge */
+    uint32_t line;              /* Source line */
+    uint64_t lost;              /* Events overwritten before this one */
+};
+
+/* Mapped ring (producer or consumer side) */
+struct gpio_ring {
+    int fd;
+    size_t map_size;
+    struct gpio_ring_header *hdr;
+    struct gpio_ring_slot *slots;
+    uint64_t mask;
+};
+
+/* Per-consumer read position; consumers are invisible to the producer */
+struct gpio_ring_cursor {
+    uint64_t position;
+    uint64_t lost;              /* Total events lost to overruns */
+};
+
+/* Function Prototypes */
+int gpio_ring_create(struct gpio_ring *ring, const char *name, uint32_t capacity);
+int gpio_ring_attach(struct gpio_ring *ring, const char *name);
+void gpio_ring_close(struct gpio_ring *ring);
+void gpio_ring_publish(struct gpio_ring *ring, uint64_t timestamp_ns, int32_t value, uint32_t line);
+void gpio_ring_cursor_init(struct gpio_ring *ring, struct gpio_ring_cursor *cursor);
+int gpio_ring_read(struct gpio_ring *ring, struct gpio_ring_cursor *cursor,
+                   struct gpio_ring_event *event, int timeout_ms);
+
+#endif /* __GPIO_SHM_RING_H__ */
@@ -0,0 +1,96 @@
+#ifndef __GPIO_TRACE_H__
+#define __GPIO_TRACE_H__
+
+#include <stdint.h>
+
+/*
+ * Optional call instrumentation for gpio_control.c, built with
+ * -DGPIO_TRACE (make trace). Without it every macro below expands to
+ * nothing and the library carries no trace code or data.
+ *
+ * Each instrumented call
+ *   - fires USDT probes gpio:call_entry(id) and
+ *     gpio:call_return(id, total_ns, syscall_ns) when <sys/sdt.h> is
+ *     available at build time;
+ *   - adds its total time, and the part spent inside the system call, to
+ *     log2 histograms owned by the calling thread. Only that thread writes
+ *     them, so recording takes no lock and no read-modify-write atomics.
+ *
+ * gpio_trace_dump() prints every thread's histograms; it only uses
+ * write(2), so it may run from a signal handler
+ * (gpio_trace_dump_on_signal).
+ */
+
+/* Instrumented calls, the ones that enter the kernel */
+enum gpio_trace_call {
+    GPIO_TRACE_OPEN_LINE,
+    GPIO_TRACE_CLOSE_DEVICE,
+    GPIO_TRACE_READ_VALUE,
+    GPIO_TRACE_WRITE_VALUE,
+    GPIO_TRACE_SET_DIRECTION,
+    GPIO_TRACE_GET_DIRECTION,
+    GPIO_TRACE_GET_STATE,
+    GPIO_TRACE_COUNTER_ENABLE,
+    GPIO_TRACE_COUNTER_READ,
+    GPIO_TRACE_MAP_STATE,
+    GPIO_TRACE_UNMAP_STATE,
+    GPIO_TRACE_RUN_OPS,
+    GPIO_TRACE_SET_READ_MODE,
+    GPIO_TRACE_SET_LINE_MASK,
+    GPIO_TRACE_SET_READ_TIMEOUT,
+    GPIO_TRACE_SET_WAKEUP,
+    GPIO_TRACE_SET_EDGES,
+    GPIO_TRACE_READ_EVENTS,
+    GPIO_TRACE_GET_EVENT_STATS,
+    GPIO_TRACE_GET_CPU_STATS,
+    GPIO_TRACE_SET_REFLEX,
+    GPIO_TRACE_GET_REFLEX,
+    GPIO_TRACE_SET_GESTURE,
+    GPIO_TRACE_GET_GESTURE,
+    GPIO_TRACE_SET_FILTER,
+    GPIO_TRACE_SET_EVENTFD,
+    GPIO_TRACE_SCHEDULE,
+    GPIO_TRACE_GET_TIMED,
+    GPIO_TRACE_CALLS
+};
+
+#define GPIO_TRACE_BUCKETS  32      /* Bucket b: [2^b, 2^(b+1)) ns, last one open */
+
+/* Function Prototypes (return -1 when built without GPIO_TRACE) */
+int gpio_trace_dump(int fd);
+int gpio_trace_dump_on_signal(int sig);
+
+#ifdef GPIO_TRACE
+
+/* One call in progress; lives on the instrumented function's stack */
+struct gpio_trace_scope {
+    enum gpio_trace_call call;
+    uint64_t start_ns;
+    uint64_t syscall_ns;
+};
+
+uint64_t gpio_trace_now(void);
+struct gpio_trace_scope gpio_trace_enter(enum gpio_trace_call call);
+void gpio_trace_exit(struct gpio_trace_scope *scope);
+
+/* First statement of an instrumented function; records on every return */
+#define GPIO_TRACE_CALL(call) \
+    struct gpio_trace_scope gpio_trace_scope_ \
+        __attribute__((cleanup(gpio_trace_exit))) = gpio_trace_enter(call)
+
+/* Wraps a system call so its time is split out from the library's */
+#define GPIO_SYSCALL(expr) ({ \
+    uint64_t gpio_trace_t0_ = gpio_trace_now(); \
+    __typeof__(expr) gpio_trace_ret_ = (expr); \
+    gpio_trace_scope_.syscall_ns += gpio_trace_now() - gpio_trace_t0_; \
+    gpio_trace_ret_; \
+})
+
+#else
+
+#define GPIO_TRACE_CALL(call)   do { } while (0)
+#define GPIO_SYSCALL(expr)      (expr)
+
+#endif /* GPIO_TRACE */
+
+#endif /* __GPIO_TRACE_H__ */
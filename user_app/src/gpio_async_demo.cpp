@@ -0,0 +1,99 @@
+/*
+ * GPIO Coroutine Demo
+ *
+ * Runs device sequences as coroutines on one thread (gpio_async.hpp)
+ *
+ *   button BUTTON BUZZER SENSOR [COUNT]
+ *       COUNT times: wait for a button press, pulse the buzzer for 50 ms,
+ *       wait 50 ms more, print the sensor level
+ *   sleepers [COUNT]
+ *       COUNT concurrent sequences of timed waits; needs no hardware
+ *
+ * Compile: g++ -Wall -O2 -std=c++20 -I./include -o gpio_async_demo src/gpio_async_demo.cpp
+ *
+ * License: GPL v2
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "gpio_async.hpp"
+
+using namespace std::chrono_literals;
+
+namespace async = gpio::async;
+
+static async::Task pulse(async::Reactor &reactor, gpio::Pin<gpio::Output> &buzzer)
+{
+    buzzer.set();
+    co_await async::sleep_for(reactor, 50ms);
+    buzzer.clear();
+}
+
+static async::Task button_sequence(async::Line &button, gpio::Pin<gpio::Output> &buzzer,
+                                   async::Line &sensor, int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        co_await button.edge(GPIO_EDGE_FALLING);
+        co_await pulse(button.reactor(), buzzer);
+        co_await async::sleep_for(button.reactor(), 50ms);
+        printf("Press %d: sensor reads %d\n", i + 1, sensor.read());
+
+        /* Released before the next round */
+        co_await button.level(1);
+    }
+}
+
+static async::Task sleeper(async::Reactor &reactor, int id, unsigned long *done)
+{
+    int i;
+
+    for (i = 0; i < 10; i++) {
+        co_await async::sleep_for(reactor, std::chrono::microseconds(100 + (id * 37) % 900));
+    }
+    (*done)++;
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t start;
+
+    try {
+        async::Reactor reactor;
+
+        if (argc >= 2 && strcmp(argv[1], "sleepers") == 0) {
+            int count = (argc >= 3) ? atoi(argv[2]) : 10000;
+            unsigned long done = 0;
+            int i;
+
+            start = async::Reactor::now_ns();
+            for (i = 0; i < count; i++) {
+                reactor.spawn(sleeper(reactor, i, &done));
+            }
+            reactor.run();
+
+            printf("SUCCESS: %lu sequences x 10 sleeps on one thread in %.1f ms\n", done,
+                   (double)(async::Reactor::now_ns() - start) / 1e6);
+            return 0;
+        }
+
+        if (argc >= 5 && strcmp(argv[1], "button") == 0) {
+            async::Line button(reactor, atoi(argv[2]));
+            gpio::Pin<gpio::Output> buzzer(atoi(argv[3]));
+            async::Line sensor(reactor, atoi(argv[4]));
+
+            reactor.spawn(button_sequence(button, buzzer, sensor, argc >= 6 ? atoi(argv[5]) : 5));
+            reactor.run();
+            return 0;
+        }
+    } catch (const std::system_error &e) {
+        fprintf(stderr, "ERROR: %s\n", e.what());
+        return 1;
+    }
+
+    fprintf(stderr, "Usage: %s button BUTTON BUZZER SENSOR [COUNT] | sleepers [COUNT]\n", argv[0]);
+    return 1;
+}
@@ -0,0 +1,315 @@
+/*
+ * GPIO Bitmap Decoder
+ *
+ * Turns GPIO_READ_BITMAP planes into edge lists and pulse-width
+ * statistics. A capture is mostly runs of 0x00 or 0xff bytes, so a SIMD
+ * scan (AVX2, SSE2 or NEON, with a scalar fallback) skips each run at
+ * memory bandwidth; only the 64-bit words that hold a transition are
+ * taken apart bit by bit.
+ *
+ * License: GPL v2
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GPIO_BITMAP_X86     1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define GPIO_BITMAP_NEON    1
+#endif
+
+#include "gpio_bitmap.h"
+
+/* Offset of the first byte of p[0..n) that differs from steady, or n */
+typedef size_t (*gpio_bitmap_scan_fn)(const uint8_t *p, size_t n, uint8_t steady);
+
+static size_t gpio_bitmap_scan_scalar(const uint8_t *p, size_t n, uint8_t steady)
+{
+    uint64_t pattern = steady * 0x0101010101010101ULL;
+    uint64_t word;
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        memcpy(&word, p + i, sizeof(word));
+        if (word != pattern) {
+            break;
+        }
+    }
+
+    while (i < n && p[i] == steady) {
+        i++;
+    }
+
+    return i;
+}
+
+#ifdef GPIO_BITMAP_X86
+__attribute__((target("sse2")))
+static size_t gpio_bitmap_scan_sse2(const uint8_t *p, size_t n, uint8_t steady)
+{
+    __m128i pattern = _mm_set1_epi8((char)steady);
+    unsigned int mask;
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        mask = (unsigned int)_mm_movemask_epi8(
+            _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + i)), pattern));
+        if (mask != 0xffff) {
+            return i + (size_t)__builtin_ctz(~mask);
+        }
+    }
+
+    return i + gpio_bitmap_scan_scalar(p + i, n - i, steady);
+}
+
+__attribute__((target("avx2")))
+static size_t gpio_bitmap_scan_avx2(const uint8_t *p, size_t n, uint8_t steady)
+{
+    __m256i pattern = _mm256_set1_epi8((char)steady);
+    __m256i a;
+    __m256i b;
+    unsigned int mask;
+    size_t i = 0;
+
+    /* 64 bytes per test while the run lasts */
+    for (; i + 64 <= n; i += 64) {
+        a = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + i)), pattern);
+        b = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + i + 32)), pattern);
+        if (!_mm256_testc_si256(_mm256_and_si256(a, b), _mm256_set1_epi8(-1))) {
+            break;
+        }
+    }
+
+    for (; i + 32 <= n; i += 32) {
+        mask = (unsigned int)_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + i)), pattern));
+        if (mask != 0xffffffffu) {
+            return i + (size_t)__builtin_ctz(~mask);
+        }
+    }
+
+    return i + gpio_bitmap_scan_scalar(p + i, n - i, steady);
+}
+#endif
+
+#ifdef GPIO_BITMAP_NEON
+static size_t gpio_bitmap_scan_neon(const uint8_t *p, size_t n, uint8_t steady)
+{
+    uint8x16_t pattern = vdupq_n_u8(steady);
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        if (vminvq_u8(vceqq_u8(vld1q_u8(p + i), pattern)) != 0xff) {
+            break;
+        }
+    }
+
+    return i + gpio_bitmap_scan_scalar(p + i, n - i, steady);
+}
+#endif
+
+/* Fastest first */
+static const struct {
+    const char *name;
+    gpio_bitmap_scan_fn scan;
+} gpio_bitmap_kernels[] = {
+#ifdef GPIO_BITMAP_X86
+    { "avx2", gpio_bitmap_scan_avx2 },
+    { "sse2", gpio_bitmap_scan_sse2 },
+#endif
+#ifdef GPIO_BITMAP_NEON
+    { "neon", gpio_bitmap_scan_neon },
+#endif
+    { "scalar", gpio_bitmap_scan_scalar },
+};
+
+#define GPIO_BITMAP_KERNELS (sizeof(gpio_bitmap_kernels) / sizeof(gpio_bitmap_kernels[0]))
+
+static int gpio_bitmap_selected = -1;
+
+static int gpio_bitmap_supported(size_t i)
+{
+#ifdef GPIO_BITMAP_X86
+    __builtin_cpu_init();
+    if (strcmp(gpio_bitmap_kernels[i].name, "avx2") == 0) {
+        return __builtin_cpu_supports("avx2");
+    }
+    if (strcmp(gpio_bitmap_kernels[i].name, "sse2") == 0) {
+        return __builtin_cpu_supports("sse2");
+    }
+#endif
+    (void)i;
+    return 1;
+}
+
+static gpio_bitmap_scan_fn gpio_bitmap_scan(void)
+{
+    size_t i;
+
+    if (gpio_bitmap_selected < 0) {
+        for (i = 0; !gpio_bitmap_supported(i); i++) {
+        }
+        gpio_bitmap_selected = (int)i;
+    }
+
+    return gpio_bitmap_kernels[gpio_bitmap_selected].scan;
+}
+
+/*
+ * gpio_bitmap_kernel
+ *
+ * Name of the scan kernel in use
+ */
+const char *gpio_bitmap_kernel(void)
+{
+    gpio_bitmap_scan();
+    return gpio_bitmap_kernels[gpio_bitmap_selected].name;
+}
+
+/*
+ * gpio_bitmap_use
+ *
+ * Forces a scan kernel ("avx2", "sse2", "neon" or "scalar"), e.g. to
+ * compare them. Returns -1 if it is not built in or the CPU lacks it.
+ */
+int gpio_bitmap_use(const char *name)
+{
+    size_t i;
+
+    for (i = 0; i < GPIO_BITMAP_KERNELS; i++) {
+        if (strcmp(gpio_bitmap_kernels[i].name, name) == 0 && gpio_bitmap_supported(i)) {
+            gpio_bitmap_selected = (int)i;
+            return 0;
+        }
+    }
+
+    fprintf(stderr, "ERROR: Bitmap kernel '%s' not available\n", name);
+    return -1;
+}
+
+void gpio_bitmap_line_init(struct gpio_bitmap_line *line)
+{
+    memset(line, 0, sizeof(*line));
+    line->last_edge = UINT64_MAX;
+    line->level = -1;
+    line->high_min = UINT64_MAX;
+    line->low_min = UINT64_MAX;
+}
+
+/* Up to 8 plane bytes as a word, sample 0 in bit 0 */
+static inline uint64_t gpio_bitmap_load(const uint8_t *p, size_t n)
+{
+    uint64_t word = 0;
+
+    memcpy(&word, p, n);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    return word;
+}
+
+/* Edge at sample at to level; closes the pulse that began at the last edge */
+static inline void gpio_bitmap_edge(struct gpio_bitmap_line *line, uint64_t at, int level)
+{
+    uint64_t width;
+
+    if (level) {
+        line->rising++;
+    } else {
+        line->falling++;
+    }
+
+    if (line->last_edge != UINT64_MAX) {
+        width = at - line->last_edge;
+        if (level) {
+            line->low_pulses++;
+            line->low_sum += width;
+            line->low_min = (width < line->low_min) ? width : line->low_min;
+            line->low_max = (width > line->low_max) ? width : line->low_max;
+        } else {
+            line->high_pulses++;
+            line->high_sum += width;
+            line->high_min = (width < line->high_min) ? width : line->high_min;
+            line->high_max = (width > line->high_max) ? width : line->high_max;
+        }
+    }
+
+    line->last_edge = at;
+}
+
+/*
+ * gpio_bitmap_edges
+ *
+ * Decodes the next plane of a line, updating its statistics. Edges are
+ * sample indices (counted from the line's first decoded sample) of the
+ * first sample at the new level; they alternate in direction.
+ *
+ * Parameters:
+ *   line     - Decoder state (gpio_bitmap_line_init before the first plane)
+ *   plane    - Plane bytes, sample k in bit k % 8 of byte k / 8
+ *   bytes    - Plane length
+ *   edges    - Receives up to capacity edge indices (may be NULL)
+ *   capacity - Room in edges
+ *
+ * Returns: Number of edges in the plane (may exceed capacity)
+ */
+size_t gpio_bitmap_edges(struct gpio_bitmap_line *line, const uint8_t *plane, size_t bytes,
+                         uint64_t *edges, size_t capacity)
+{
+    gpio_bitmap_scan_fn scan = gpio_bitmap_scan();
+    uint64_t valid;
+    uint64_t word;
+    uint64_t diff;
+    uint64_t at;
+    size_t count = 0;
+    size_t pos = 0;
+    size_t skip;
+    size_t n;
+
+    if (bytes == 0) {
+        return 0;
+    }
+
+    if (line->level < 0) {
+        line->level = plane[0] & 1;
+    }
+
+    while (pos < bytes) {
+        /* pos stays word aligned: steady bytes are skipped in whole words */
+        skip = scan(plane + pos, bytes - pos, line->level ? 0xff : 0x00) & ~(size_t)7;
+        if (line->level) {
+            line->high_samples += (uint64_t)skip * 8;
+        }
+        pos += skip;
+        if (pos >= bytes) {
+            break;
+        }
+
+        n = (bytes - pos < 8) ? bytes - pos : 8;
+        word = gpio_bitmap_load(plane + pos, n);
+        valid = (n == 8) ? ~0ULL : (1ULL << (n * 8)) - 1;
+
+        /* Bit k set where sample k differs from sample k - 1 */
+        diff = (word ^ ((word << 1) | (uint64_t)line->level)) & valid;
+        line->high_samples += (uint64_t)__builtin_popcountll(word & valid);
+
+        while (diff != 0) {
+            at = line->samples + pos * 8 + (uint64_t)__builtin_ctzll(diff);
+            if (count < capacity) {
+                edges[count] = at;
+            }
+            count++;
+            gpio_bitmap_edge(line, at, (int)((word >> __builtin_ctzll(diff)) & 1));
+            diff &= diff - 1;
+        }
+
+        line->level = (int)((word >> (n * 8 - 1)) & 1);
+        pos += n;
+    }
+
+    line->samples += (uint64_t)bytes * 8;
+    return count;
+}
@@ -11,24 +11,13 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <string.h>
 #include <errno.h>
+#include <stddef.h>
 
 #include "gpio_control.h"
-
-/* Macro for IOCTL commands - mirrors kernel definitions */
-#define GPIO_IOCTL_SET_VALUE    _IOW('g', 1, int)
-#define GPIO_IOCTL_GET_VALUE    _IOR('g', 2, int)
-#define GPIO_IOCTL_SET_DIRECTION _IOW('g', 3, int)
-#define GPIO_IOCTL_GET_DIRECTION _IOR('g', 4, int)
-
-/* GPIO Direction constants */
-#define GPIO_DIRECTION_INPUT    0
-#define GPIO_DIRECTION_OUTPUT   1
-
-/* GPIO Value constants */
-#define GPIO_VALUE_LOW          0
-#define GPIO_VALUE_HIGH         1
+#include "gpio_trace.h"
 
 /*
  * gpio_open_device
@@ -39,15 +28,45 @@
  */
 int gpio_open_device(void)
 {
+    return gpio_open_line(0);
+}
+
+/*
+ * gpio_open_line
+ * 
+ * Opens the device file of one line. The driver creates one node per
+ * Device Tree entry: line 0 is GPIO_DEVICE_PATH, line N is GPIO_DEVICE_PATH "N".
+ * 
+ * Parameters:
+ *   line - Line (minor) number
+ * 
+ * Returns: File descriptor on success, -1 on error
+ */
+int gpio_open_line(int line)
+{
+    char path[64];
     int fd;
     
-    fd = open(GPIO_DEVICE_PATH, O_RDWR);
+    GPIO_TRACE_CALL(GPIO_TRACE_OPEN_LINE);
+    
+    if (line < 0 || line >= GPIO_MAX_DEVICES) {
+        fprintf(stderr, "ERROR: Invalid GPIO line: %d\n", line);
+        return -1;
+    }
+    
+    if (line == 0) {
+        snprintf(path, sizeof(path), "%s", GPIO_DEVICE_PATH);
+    } else {
+        snprintf(path, sizeof(path), "%s%d", GPIO_DEVICE_PATH, line);
+    }
+    
+    fd = GPIO_SYSCALL(open(path, O_RDWR));
     if (fd < 0) {
-        fprintf(stderr, "ERROR: Cannot open %s: %s\n", GPIO_DEVICE_PATH, strerror(errno));
+        fprintf(stderr, "ERROR: Cannot open %s: %s\n", path, strerror(errno));
         return -1;
     }
     
-    printf("SUCCESS: Opened GPIO device: %s (fd=%d)\n", GPIO_DEVICE_PATH, fd);
+    printf("SUCCESS: Opened GPIO device: %s (fd=%d)\n", path, fd);
     
     return fd;
 }
@@ -64,12 +83,14 @@ int gpio_open_device(void)
  */
 int gpio_close_device(int fd)
 {
+    GPIO_TRACE_CALL(GPIO_TRACE_CLOSE_DEVICE);
+    
     if (fd < 0) {
         fprintf(stderr, "ERROR: Invalid file descriptor: %d\n", fd);
         return -1;
     }
     
-    if (close(fd) < 0) {
+    if (GPIO_SYSCALL(close(fd)) < 0) {
         fprintf(stderr, "ERROR: Cannot close GPIO device: %s\n", strerror(errno));
         return -1;
     }
@@ -95,6 +116,8 @@ int gpio_read_value(int fd, uint8_t *value)
     ssize_t ret;
     unsigned char gpio_val;
     
+    GPIO_TRACE_CALL(GPIO_TRACE_READ_VALUE);
+    
     if (fd < 0) {
         fprintf(stderr, "ERROR: Invalid file descriptor: %d\n", fd);
         return -1;
@@ -105,7 +128,7 @@ int gpio_read_value(int fd, uint8_t *value)
         return -1;
     }
     
-    ret = read(fd, &gpio_val, 1);
+    ret = GPIO_SYSCALL(read(fd, &gpio_val, 1));
     if (ret < 0) {
         fprintf(stderr, "ERROR: Cannot read GPIO value: %s\n", strerror(errno));
         return -1;
@@ -138,12 +161,14 @@ int gpio_write_value(int fd, uint8_t value)
     ssize_t ret;
     unsigned char gpio_val = (value ? 1 : 0);
     
+    GPIO_TRACE_CALL(GPIO_TRACE_WRITE_VALUE);
+    
     if (fd < 0) {
         fprintf(stderr, "ERROR: Invalid file descriptor: %d\n", fd);
         return -1;
     }
     
-    ret = write(fd, &gpio_val, 1);
+    ret = GPIO_SYSCALL(write(fd, &gpio_val, 1));
     if (ret < 0) {
         fprintf(stderr, "ERROR: Cannot write GPIO value: %s\n", strerror(errno));
         return -1;
@@ -175,12 +200,14 @@ int gpio_set_direction(int fd, uint8_t direction)
     int ret;
     int dir_val = (direction ? GPIO_DIRECTION_OUTPUT : GPIO_DIRECTION_INPUT);
     
+    GPIO_TRACE_CALL(GPIO_TRACE_SET_DIRECTION);
+    
     if (fd < 0) {
         fprintf(stderr, "ERROR: Invalid file descriptor: %d\n", fd);
         return -1;
     }
     
-    ret = ioctl(fd, GPIO_IOCTL_SET_DIRECTION, &dir_val);
+    ret = GPIO_SYSCALL(ioctl(fd, GPIO_IOCTL_SET_DIRECTION, &dir_val));
     if (ret < 0) {
         fprintf(stderr, "ERROR: Cannot set GPIO direction: %s\n", strerror(errno));
         return -1;
@@ -208,6 +235,8 @@ int gpio_get_direction(int fd, uint8_t *direction)
     int ret;
     int dir_val;
     
+    GPIO_TRACE_CALL(GPIO_TRACE_GET_DIRECTION);
+    
     if (fd < 0) {
         fprintf(stderr, "ERROR: Invalid file descriptor: %d\n", fd);
         return -1;
@@ -218,7 +247,7 @@ int gpio_get_direction(int fd, uint8_t *direction)
         return -1;
     }
     
-    ret = ioctl(fd, GPIO_IOCTL_GET_DIRECTION, &dir_val);
+    ret = GPIO_SYSCALL(ioctl(fd, GPIO_IOCTL_GET_DIRECTION, &dir_val));
     if (ret < 0) {
         fprintf(stderr, "ERROR: Cannot get GPIO direction: %s\n", strerror(errno));
         return -1;
@@ -231,40 +260,870 @@ int gpio_get_direction(int fd, uint8_t *direction)
     return 0;
 }
 
+/*
+ * gpio_get_state
+ * 
+ * Reads value, direction, trigger, edge counters and the last edge time
+ * in a single ioctl
+ * 
+ * Parameters:
+ *   fd    - File descriptor
+ *   state - State to fill; state->size tells how much the driver filled
+ * 
+ * Returns: 0 on success, -1 on error
+ */
+int gpio_get_state(int fd, struct gpio_state *state)
+{
+    GPIO_TRACE_CALL(GPIO_TRACE_GET_STATE);
+    
+    if (fd < 0 || state == NULL) {
+        fprintf(stderr, "ERROR: Invalid state arguments\n");
+        return -1;
+    }
+    
+    memset(state, 0, sizeof(*state));
+    state->size = sizeof(*state);
+    
+    if (GPIO_SYSCALL(ioctl(fd, GPIO_IOCTL_GET_STATE, state)) < 0) {
+        fprintf(stderr, "ERROR: Cannot get GPIO state: %s\n", strerror(errno));
+        return -1;
+    }
+    
+    return 0;
+}
+
 /*
  * gpio_print_status
  * 
- * Prints the current GPIO status (value and direction)
+ * Prints the current GPIO status from one state snapshot
  * 
  * Parameters:
  *   fd - File descriptor
  */
 void gpio_print_status(int fd)
 {
-    int ret;
-    uint8_t value = 0;
-    uint8_t direction = 0;
+    static const char *const triggers[] = { "none", "rising", "falling", "both" };
+    struct gpio_state state;
+    
+    printf("\n=== GPIO Status ===\n");
+    
+    if (gpio_get_state(fd, &state) != 0) {
+        printf("State: <error reading>\n");
+        printf("===================\n\n");
+        return;
+    }
+    
+    printf("Line: %d (GPIO %u)\n", state.line, state.gpio);
+    printf("Value: %s\n", state.value ? "HIGH (1)" : "LOW (0)");
+    printf("Direction: %s%s\n", state.direction ? "OUTPUT" : "INPUT",
+           (state.flags & GPIO_STATE_EXPANDER) ? " (expander)" : "");
+    printf("Trigger: %s%s%s%s\n",
+           (state.flags & GPIO_STATE_POLLED) ? "polled" : triggers[state.trigger & GPIO_EDGE_BOTH],
+           (state.flags & GPIO_STATE_COUNTER) ? ", counter" : "",
+           (state.flags & GPIO_STATE_REFLEX) ? ", reflex" : "",
+           (state.flags & GPIO_STATE_GESTURE) ? ", gestures" : "");
+    printf("Edges: %llu (%llu rising, %llu falling)\n",
+           (unsigned long long)state.edges, (unsigned long long)state.rising,
+           (unsigned long long)state.falling);
+    if (state.last_edge_ns != 0) {
+        printf("Last edge: %llu.%09llu s (CLOCK_MONOTONIC)\n",
+               (unsigned long long)(state.last_edge_ns / 1000000000ULL),
+               (unsigned long long)(state.last_edge_ns % 1000000000ULL));
+    }
+    
+    printf("===================\n\n");
+}
+
+/*
+ * gpio_counter_enable
+ * 
+ * Switches the driver's in-kernel edge counter on or off. Enabling resets
+ * the counts; the GPIO must be an input.
+ * 
+ * Parameters:
+ *   fd     - File descriptor
+ *   enable - Non-zero to start counting, 0 to stop
+ * 
+ * Returns: 0 on success, -1 on error
+ */
+int gpio_counter_enable(int fd, int enable)
+{
+    int mode = enable ? 1 : 0;
+    
+    GPIO_TRACE_CALL(GPIO_TRACE_COUNTER_ENABLE);
     
     if (fd < 0) {
         fprintf(stderr, "ERROR: Invalid file descriptor: %d\n", fd);
-        return;
+        return -1;
     }
     
-    printf("\n=== GPIO Status ===\n");
+    if (GPIO_SYSCALL(ioctl(fd, GPIO_IOCTL_SET_COUNTER, &mode)) < 0) {
+        fprintf(stderr, "ERROR: Cannot %s counter mode: %s\n",
+                enable ? "enable" : "disable", strerror(errno));
+        return -1;
+    }
     
-    ret = gpio_read_value(fd, &value);
-    if (ret == 0) {
-        printf("Value: %s\n", value ? "HIGH (1)" : "LOW (0)");
-    } else {
-        printf("Value: <error reading>\n");
+    return 0;
+}
+
+/*
+ * gpio_counter_read
+ * 
+ * Reads edge counts, rolling frequency and duty cycle from the driver
+ * 
+ * Parameters:
+ *   fd   - File descriptor
+ *   info - Counter snapshot to fill
+ * 
+ * Returns: 0 on success, -1 on error
+ */
+int gpio_counter_read(int fd, struct gpio_counter_info *info)
+{
+    GPIO_TRACE_CALL(GPIO_TRACE_COUNTER_READ);
+    
+    if (fd < 0 || info == NULL) {
+        fprintf(stderr, "ERROR: Invalid counter arguments\n");
+        return -1;
     }
     
-    ret = gpio_get_direction(fd, &direction);
-    if (ret == 0) {
-        printf("Direction: %s\n", direction ? "OUTPUT" : "INPUT");
-    } else {
-        printf("Direction: <error reading>\n");
+    if (GPIO_SYSCALL(ioctl(fd, GPIO_IOCTL_GET_COUNTER, info)) < 0) {
+        fprintf(stderr, "ERROR: Cannot read counter: %s\n", strerror(errno));
+        return -1;
     }
     
-    printf("===================\n\n");
+    return 0;
+}
+
+/*
+ * gpio_map_state
+ * 
+ * Maps the driver's read-only shared state page
+ * 
+ * Parameters:
+ *   fd - File descriptor
+ * 
+ * Returns: Mapped page on success, NULL on error
+ */
+const struct gpio_shared_state *gpio_map_state(int fd)
+{
+    void *map;
+    
+    GPIO_TRACE_CALL(GPIO_TRACE_MAP_STATE);
+    
+    map = GPIO_SYSCALL(mmap(NULL, sizeof(struct gpio_shared_state), PROT_READ, MAP_SHARED, fd, 0));
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "ERROR: Cannot map GPIO shared state: %s\n", strerror(errno));
+        return NULL;
+    }
+    
+    if (((const struct gpio_shared_state *)map)->version != GPIO_SHARED_STATE_VERSION) {
+        fprintf(stderr, "ERROR: Unsupported shared state version %u\n",
+                ((const struct gpio_shared_state *)map)->version);
+        GPIO_SYSCALL(munmap(map, sizeof(struct gpio_shared_state)));
+        return NULL;
+    }
+    
+    return map;
+}
+
+/*
+ * gpio_unmap_state
+ * 
+ * Releases a mapping returned by gpio_map_state
+ * 
+ * Parameters:
+ *   state - Mapped page (may be NULL)
+ */
+void gpio_unmap_state(const struct gpio_shared_state *state)
+{
+    GPIO_TRACE_CALL(GPIO_TRACE_UNMAP_STATE);
+    
+    if (state != NULL) {
+        GPIO_SYSCALL(munmap((void *)state, sizeof(struct gpio_shared_state)));
+    }
+}
+
+/*
+ * gpio_read_state
+ * 
+ * Takes a consistent copy of the shared state page, retrying while the
+ * driver is in the middle of an update
+ * 
+ * Parameters:
+ *   state    - Mapped page
+ *   snapshot - Copy to fill
+ */
+void gpio_read_state(const struct gpio_shared_state *state, struct gpio_shared_state *snapshot)
+{
+    uint32_t seq;
+    
+    for (;;) {
+        seq = __atomic_load_n(&state->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) {
+            continue;
+        }
+        
+        memcpy(snapshot, (const void *)state, sizeof(*snapshot));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        
+        if (__atomic_load_n(&state->seq, __ATOMIC_RELAXED) == seq) {
+            snapshot->seq = seq;
+            return;
+        }
+    }
+}
+
+/*
+ * gpio_run_ops
+ * 
+ * Runs a list of set/get/wait/delay/toggle operations in one ioctl.
+ * Results and completion timestamps are written back into ops.
+ * 
+ * Parameters:
+ *   fd    - File descriptor
+ *   ops   - Operations (updated in place)
+ *   count - Number of operations (at most GPIO_OPS_MAX)
+ *   flags - GPIO_OPS_ATOMIC to run with preemption disabled
+ *   list  - Optional: receives completed count, error and duration
+ * 
+ * Returns: 0 if every op completed, -1 on error
+ */
+int gpio_run_ops(int fd, struct gpio_op *ops, uint32_t count, uint32_t flags,
+                 struct gpio_op_list *list)
+{
+    struct gpio_op_list local;
+    
+    GPIO_TRACE_CALL(GPIO_TRACE_RUN_OPS);
+    
+    if (fd < 0 || ops == NULL || count == 0) {
+        fprintf(stderr, "ERROR: Invalid operation list\n");
+        return -1;
+    }
+    
+    if (list == NULL) {
+        list = &local;
+    }
+    
+    memset(list, 0, sizeof(*list));
+    list->ops = (uint64_t)(uintptr_t)ops;
+    list->count = count;
+    list->flags = flags;
+    
+    if (GPIO_SYSCALL(ioctl(fd, GPIO_IOCTL_RUN_OPS, list)) < 0) {
+        fprintf(stderr, "ERROR: Cannot run operation list: %s\n", strerror(errno));
+        return -1;
+    }
+    
+    if (list->error != 0) {
+        fprintf(stderr, "ERROR: Operation %u failed: %s\n",
+                list->completed - 1, strerror(-list->error));
+        return -1;
+    }
+    
+    return 0;
+}
+
+/*
+ * gpio_set_read_mode
+ * 
+ * Chooses what read() returns on this file descriptor
+ * 
+ * Parameters:
+ *   fd   - File descriptor
+ *   mode - GPIO_READ_VALUE (1-byte level) or GPIO_READ_EVENTS (struct gpio_event)
+ * 
+ * Returns: 0 on success, -1 on error
+ */
+int gpio_set_read_mode(int fd, int mode)
+{
+    GPIO_TRACE_CALL(GPIO_TRACE_SET_READ_MODE);
+    
+    if (GPIO_SYSCALL(ioctl(fd, GPIO_IOCTL_SET_READ_MODE, &mode)) < 0) {
+        fprintf(stderr, "ERROR: Cannot set read mode: %s\n", strerror(errno));
+        return -1;
+    }
+    
+    return 0;
+}
+
+/*
+ * gpio_set_line_mask
+ * 
+ * Chooses which lines' edges this file descriptor receives
+ * 
+ * Parameters:
+ *   fd   - File descriptor
+ *   mask - Bit N selects line N (the opened line only by default)
+ * 
+ * Returns: 0 on success, -1 on error
+ */
+int gpio_set_line_mask(int fd, uint32_t mask)
+{
+    GPIO_TRACE_CALL(GPIO_TRACE_SET_LINE_MASK);
+    
+    if (GPIO_SYSCALL(ioctl(fd, GPIO_IOCTL_SET_LINE_MASK, &mask)) < 0) {
+        fprintf(stderr, "ERROR: Cannot set line mask: %s\n", strerror(errno));
+        return -1;
+    }
+    
+    return 0;
+}
+
+/*
+ * gpio_set_read_timeout
+ * 
+ * Sets how long an event-mode read() blocks before failing with ETIMEDOUT
+ * 
+ * Parameters:
+ *   fd         - File descriptor
+ *   timeout_ms - Milliseconds, GPIO_TIMEOUT_INFINITE or GPIO_TIMEOUT_NONE
+ * 
+ * Returns: 0 on success, -1 on error
+ */
+int gpio_set_read_timeout(int fd, int timeout_ms)
+{
+    GPIO_TRACE_CALL(GPIO_TRACE_SET_READ_TIMEOUT);
+    
+    if (GPIO_SYSCALL(ioctl(fd, GPIO_IOCTL_SET_READ_TIMEOUT, &timeout_ms)) < 0) {
+        fprintf(stderr, "ERROR: Cannot set read timeout: %s\n", strerror(errno));
+        return -1;
+    }
+    
+    return 0;
+}
+
+/*
+ * gpio_set_wakeup
+ * 
+ * Batches event delivery: a blocked read() or poll() returns once
+ * watermark events are pending, or max_latency_us after the first one
+ * 
+ * Parameters:
+ *   fd             - File descriptor
+ *   watermark      - Events to wait for (1 = every event)
+ *   max_latency_us - Upper bound on delivery delay, 0 = none
+ * 
+ * Returns: 0 on success, -1 on error
+ */
+int gpio_set_wakeup(int fd, uint32_t watermark, uint32_t max_latency_us)
+{
+    struct gpio_wakeup wakeup;
+    
+    GPIO_TRACE_CALL(GPIO_TRACE_SET_WAKEUP);
+    
+    wakeup.watermark = watermark;
+    wakeup.max_latency_us = max_latency_us;
+    
+    if (GPIO_SYSCALL(ioctl(fd, GPIO_IOCTL_SET_WAKEUP, &wakeup)) < 0) {
+        fprintf(stderr, "ERROR: Cannot set wakeup batching: %s\n", strerror(errno));
+        return -1;
+    }
+    
+    return 0;
+}
+
+/*
+ * gpio_set_edges
+ * 
+ * Chooses which edges of the line the driver records as events. This is
+ * a property of the line, shared by every process that has it open.
+ * 
+ * Parameters:
+ *   fd    - File descriptor
+ *   edges - GPIO_EDGE_RISING, GPIO_EDGE_FALLING or GPIO_EDGE_BOTH
+ * 
+ * Returns: 0 on success, -1 on error
+ */
+int gpio_set_edges(int fd, int edges)
+{
+    GPIO_TRACE_CALL(GPIO_TRACE_SET_EDGES);
+    
+    if (GPIO_SYSCALL(ioctl(fd, GPIO_IOCTL_SET_EDGES, &edges)) < 0) {
+        fprintf(stderr, "ERROR: Cannot set event edges: %s\n", strerror(errno));
+        return -1;
+    }
+    
+    return 0;
+}
+
+/*
+ * gpio_read_events
+ * 
+ * Reads edge events (file must be in GPIO_READ_EVENTS mode). Blocks until
+ * at least one event arrives, unless the descriptor is non-blocking or a
+ * read timeout was set.
+ * 
+ * Parameters:
+ *   fd         - File descriptor
+ *   events     - Buffer for events
+ *   max_events - Buffer capacity
+ * 
+ * Returns: Number of events (0 on timeout, signal or EAGAIN), -1 on error
+ */
+int gpio_read_events(int fd, struct gpio_event *events, int max_events)
+{
+    ssize_t ret;
+    
+    GPIO_TRACE_CALL(GPIO_TRACE_READ_EVENTS);
+    
+    ret = GPIO_SYSCALL(read(fd, events, (size_t)max_events * sizeof(*events)));
+    if (ret < 0) {
+        if (errno == EAGAIN || errno == EINTR || errno == ETIMEDOUT) {
+            return 0;
+        }
+        fprintf(stderr, "ERROR: Cannot read GPIO events: %s\n", strerror(errno));
+        return -1;
+    }
+    
+    return (int)(ret / sizeof(*events));
+}
+
+/*
+ * gpio_get_event_stats
+ * 
+ * Reads this file's delivery and overrun counters
+ * 
+ * Parameters:
+ *   fd    - File descriptor
+ *   stats - Counters to fill
+ * 
+ * Returns: 0 on success, -1 on error
+ */
+int gpio_get_event_stats(int fd, struct gpio_event_stats *stats)
+{
+    GPIO_TRACE_CALL(GPIO_TRACE_GET_EVENT_STATS);
+    
+    if (GPIO_SYSCALL(ioctl(fd, GPIO_IOCTL_GET_EVENT_STATS, stats)) < 0) {
+        fprintf(stderr, "ERROR: Cannot get event stats: %s\n", strerror(errno));
+        return -1;
+    }
+    
+    return 0;
+}
+
+/*
+ * gpio_get_cpu_stats
+ * 
+ * Reads the per-CPU event counters (events recorded by each CPU's IRQs
+ * and how many of them this file lost)
+ * 
+ * Parameters:
+ *   fd       - File descriptor
+ *   stats    - Array to fill
+ *   capacity - Entries in stats
+ * 
+ * Returns: Number of possible CPUs (may exceed capacity), -1 on error
+ */
+int gpio_get_cpu_stats(int fd, struct gpio_cpu_stats *stats, int capacity)
+{
+    struct gpio_cpu_stats_list list;
+    
+    GPIO_TRACE_CALL(GPIO_TRACE_GET_CPU_STATS);
+    
+    memset(&list, 0, sizeof(list));
+    list.stats = (uint64_t)(uintptr_t)stats;
+    list.count = (uint32_t)capacity;
+    
+    if (GPIO_SYSCALL(ioctl(fd, GPIO_IOCTL_GET_CPU_STATS, &list)) < 0) {
+        fprintf(stderr, "ERROR: Cannot get per-CPU event stats: %s\n", strerror(errno));
+        return -1;
+    }
+    
+    return (int)list.count;
+}
+
+/*
+ * gpio_set_reflex
+ * 
+ * Installs a reflex rule on the line behind fd. The driver applies it from
+ * its IRQ handler, so the reaction does not depend on userspace scheduling.
+ * 
+ * Parameters:
+ *   fd   - File descriptor of the source (input) line
+ *   rule - Rule; action GPIO_REFLEX_NONE removes the current rule
+ * 
+ * Returns: 0 on success, -1 on error
+ */
+int gpio_set_reflex(int fd, const struct gpio_reflex *rule)
+{
+    GPIO_TRACE_CALL(GPIO_TRACE_SET_REFLEX);
+    
+    if (fd < 0 || rule == NULL) {
+        fprintf(stderr, "ERROR: Invalid reflex arguments\n");
+        return -1;
+    }
+    
+    if (GPIO_SYSCALL(ioctl(fd, GPIO_IOCTL_SET_REFLEX, rule)) < 0) {
+        fprintf(stderr, "ERROR: Cannot set reflex: %s\n", strerror(errno));
+        return -1;
+    }
+    
+    return 0;
+}
+
+/*
+ * gpio_get_reflex
+ * 
+ * Reads the reflex rule of the line behind fd
+ * 
+ * Parameters:
+ *   fd   - File descriptor
+ *   rule - Rule to fill (target_line is -1 while a DT target is unbound)
+ * 
+ * Returns: 0 on success, -1 on error
+ */
+int gpio_get_reflex(int fd, struct gpio_reflex *rule)
+{
+    GPIO_TRACE_CALL(GPIO_TRACE_GET_REFLEX);
+    
+    if (fd < 0 || rule == NULL) {
+        fprintf(stderr, "ERROR: Invalid reflex arguments\n");
+        return -1;
+    }
+    
+    if (GPIO_SYSCALL(ioctl(fd, GPIO_IOCTL_GET_REFLEX, rule)) < 0) {
+        fprintf(stderr, "ERROR: Cannot get reflex: %s\n", strerror(errno));
+        return -1;
+    }
+    
+    return 0;
+}
+
+/*
+ * gpio_set_gesture
+ * 
+ * Configures the driver's gesture layer on the line behind fd. While it is
+ * enabled, reads return PRESS/RELEASE/LONG_PRESS/REPEAT/DOUBLE_CLICK events
+ * for the line instead of raw edges.
+ * 
+ * Parameters:
+ *   fd      - File descriptor of the button (input) line
+ *   gesture - Settings; flags without GPIO_GESTURE_ENABLE turn it off
+ * 
+ * Returns: 0 on success, -1 on error
+ */
+int gpio_set_gesture(int fd, const struct gpio_gesture *gesture)
+{
+    GPIO_TRACE_CALL(GPIO_TRACE_SET_GESTURE);
+    
+    if (fd < 0 || gesture == NULL) {
+        fprintf(stderr, "ERROR: Invalid gesture arguments\n");
+        return -1;
+    }
+    
+    if (GPIO_SYSCALL(ioctl(fd, GPIO_IOCTL_SET_GESTURE, gesture)) < 0) {
+        fprintf(stderr, "ERROR: Cannot set gestures: %s\n", strerror(errno));
+        return -1;
+    }
+    
+    return 0;
+}
+
+/*
+ * gpio_get_gesture
+ * 
+ * Reads the gesture settings of the line behind fd
+ * 
+ * Parameters:
+ *   fd      - File descriptor
+ *   gesture - Settings to fill
+ * 
+ * Returns: 0 on success, -1 on error
+ */
+int gpio_get_gesture(int fd, struct gpio_gesture *gesture)
+{
+    GPIO_TRACE_CALL(GPIO_TRACE_GET_GESTURE);
+    
+    if (fd < 0 || gesture == NULL) {
+        fprintf(stderr, "ERROR: Invalid gesture arguments\n");
+        return -1;
+    }
+    
+    if (GPIO_SYSCALL(ioctl(fd, GPIO_IOCTL_GET_GESTURE, gesture)) < 0) {
+        fprintf(stderr, "ERROR: Cannot get gestures: %s\n", strerror(errno));
+        return -1;
+    }
+    
+    return 0;
+}
+
+/*
+ * gpio_event_name
+ * 
+ * Parameters:
+ *   type - GPIO_EVENT_* value of an event record
+ * 
+ * Returns: Short lowercase name, "unknown" for other values
+ */
+const char *gpio_event_name(uint16_t type)
+{
+    static const char *const names[] = {
+        "unknown", "rising", "falling", "press", "release", "long", "repeat", "double"
+    };
+    
+    return (type < sizeof(names) / sizeof(names[0])) ? names[type] : names[0];
+}
+
+/*
+ * gpio_set_filter
+ * 
+ * Attaches a classic BPF program to fd's event stream; the driver runs it
+ * on every event before the event counts for this file, so rejected
+ * events never wake the reader. Unread events are discarded.
+ * 
+ * Parameters:
+ *   fd    - File descriptor
+ *   insns - Program over struct gpio_filter_ctx (NULL with count 0 detaches)
+ *   count - Instructions, at most GPIO_FILTER_MAX_INSNS
+ * 
+ * Returns: 0 on success, -1 on error (EINVAL: rejected by the verifier)
+ */
+int gpio_set_filter(int fd, const struct sock_filter *insns, uint32_t count)
+{
+    struct gpio_filter filter;
+    
+    GPIO_TRACE_CALL(GPIO_TRACE_SET_FILTER);
+    
+    if (fd < 0 || (insns == NULL && count != 0)) {
+        fprintf(stderr, "ERROR: Invalid filter arguments\n");
+        return -1;
+    }
+    
+    memset(&filter, 0, sizeof(filter));
+    filter.insns = (uint64_t)(uintptr_t)insns;
+    filter.count = count;
+    
+    if (GPIO_SYSCALL(ioctl(fd, GPIO_IOCTL_SET_FILTER, &filter)) < 0) {
+        fprintf(stderr, "ERROR: Cannot set event filter: %s\n", strerror(errno));
+        return -1;
+    }
+    
+    return 0;
+}
+
+/*
+ * gpio_set_eventfd
+ * 
+ * Has the driver count edges of the line into an eventfd; every edge
+ * adds one to its counter
+ * 
+ * Parameters:
+ *   fd    - File descriptor of the GPIO device
+ *   efd   - eventfd to signal, or -1 to drop the registration for edges
+ *   edges - GPIO_EDGE_RISING, GPIO_EDGE_FALLING or GPIO_EDGE_BOTH
+ * 
+ * Returns: 0 on success, -1 on failure
+ */
+int gpio_set_eventfd(int fd, int efd, uint32_t edges)
+{
+    struct gpio_eventfd req;
+    
+    GPIO_TRACE_CALL(GPIO_TRACE_SET_EVENTFD);
+    
+    if (fd < 0 || edges == 0 || edges > GPIO_EDGE_BOTH) {
+        fprintf(stderr, "ERROR: Invalid eventfd arguments\n");
+        return -1;
+    }
+    
+    memset(&req, 0, sizeof(req));
+    req.fd = efd;
+    req.edges = edges;
+    
+    if (GPIO_SYSCALL(ioctl(fd, GPIO_IOCTL_SET_EVENTFD, &req)) < 0) {
+        fprintf(stderr, "ERROR: Cannot set eventfd: %s\n", strerror(errno));
+        return -1;
+    }
+    
+    return 0;
+}
+
+/*
+ * gpio_filter_compile
+ * 
+ * Builds a filter program from comma-separated terms, all of which must
+ * hold for an event to be kept:
+ *   rising, falling, press, ... - event type (names of gpio_event_name)
+ *   line=N                      - events of line N
+ *   min=US / max=US             - duration_ns at least / at most US us
+ *   every=N                     - every Nth event passing the terms before
+ * 
+ * Parameters:
+ *   spec     - Term list, e.g. "falling,min=500"
+ *   insns    - Output program
+ *   capacity - Room in insns
+ * 
+ * Returns: Instruction count, or -1 on a bad term or too long a program
+ */
+int gpio_filter_compile(const char *spec, struct sock_filter *insns, int capacity)
+{
+    char buf[256];
+    char *save = NULL;
+    char *term;
+    char *end;
+    unsigned long arg;
+    int n = 0;
+    int first_jump = -1;
+    int slot = 0;
+    int type;
+    int i;
+    
+    if (spec == NULL || strlen(spec) >= sizeof(buf)) {
+        return -1;
+    }
+    strcpy(buf, spec);
+    
+/* Conditional jumps leave jf (or jt) 0xff until the reject index is known */
+#define EMIT(c, val, t, f) do {                                     \
+        if (n >= capacity) {                                        \
+            return -1;                                              \
+        }                                                           \
+        insns[n].code = (c);                                        \
+        insns[n].jt = (t);                                          \
+        insns[n].jf = (f);                                          \
+        insns[n].k = (val);                                         \
+        n++;                                                        \
+    } while (0)
+    
+    for (term = strtok_r(buf, ",", &save); term != NULL; term = strtok_r(NULL, ",", &save)) {
+        if (first_jump < 0) {
+            first_jump = n;
+        }
+        
+        for (type = 1; type < 8 && strcmp(term, gpio_event_name((uint16_t)type)) != 0; type++) {
+        }
+        if (type < 8) {
+            EMIT(BPF_LD | BPF_H | BPF_ABS, offsetof(struct gpio_filter_ctx, event.type), 0, 0);
+            EMIT(BPF_JMP | BPF_JEQ | BPF_K, (uint32_t)type, 0, 0xff);
+            continue;
+        }
+        
+        end = strchr(term, '=');
+        if (end == NULL) {
+            return -1;
+        }
+        *end++ = '\0';
+        arg = strtoul(end, &end, 0);
+        if (*end != '\0') {
+            return -1;
+        }
+        
+        if (strcmp(term, "line") == 0) {
+            EMIT(BPF_LD | BPF_H | BPF_ABS, offsetof(struct gpio_filter_ctx, event.line), 0, 0);
+            EMIT(BPF_JMP | BPF_JEQ | BPF_K, (uint32_t)arg, 0, 0xff);
+        } else if (strcmp(term, "min") == 0) {
+            EMIT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct gpio_filter_ctx, duration_us), 0, 0);
+            EMIT(BPF_JMP | BPF_JGE | BPF_K, (uint32_t)arg, 0, 0xff);
+        } else if (strcmp(term, "max") == 0) {
+            EMIT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct gpio_filter_ctx, duration_us), 0, 0);
+            EMIT(BPF_JMP | BPF_JGT | BPF_K, (uint32_t)arg, 0xff, 0);
+        } else if (strcmp(term, "every") == 0 && arg != 0 && slot < GPIO_FILTER_MEMWORDS) {
+            /* M[slot] counts events up to arg, then the event passes and it restarts */
+            EMIT(BPF_LD | BPF_MEM, (uint32_t)slot, 0, 0);
+            EMIT(BPF_ALU | BPF_ADD | BPF_K, 1, 0, 0);
+            EMIT(BPF_ST, (uint32_t)slot, 0, 0);
+            EMIT(BPF_JMP | BPF_JGE | BPF_K, (uint32_t)arg, 0, 0xff);
+            EMIT(BPF_LD | BPF_IMM, 0, 0, 0);
+            EMIT(BPF_ST, (uint32_t)slot, 0, 0);
+            slot++;
+        } else {
+            return -1;
+        }
+    }
+    
+    EMIT(BPF_RET | BPF_K, 1, 0, 0);
+    EMIT(BPF_RET | BPF_K, 0, 0, 0);
+    
+#undef EMIT
+    
+    /* Point the placeholders at the final RET 0 */
+    for (i = (first_jump < 0) ? n : first_jump; i < n; i++) {
+        if (BPF_CLASS(insns[i].code) != BPF_JMP) {
+            continue;
+        }
+        if (insns[i].jt == 0xff) {
+            insns[i].jt = (uint8_t)(n - 1 - (i + 1));
+        }
+        if (insns[i].jf == 0xff) {
+            insns[i].jf = (uint8_t)(n - 1 - (i + 1));
+        }
+    }
+    
+    return n;
+}
+
+/*
+ * gpio_schedule
+ * 
+ * Queues level changes at absolute CLOCK_MONOTONIC times; the driver
+ * applies them from an hrtimer. Each change's id is written back, and
+ * with GPIO_TIMED_WAIT also its result and firing time.
+ * 
+ * Parameters:
+ *   fd      - File descriptor of an output line
+ *   changes - at_ns and value set (updated in place)
+ *   count   - Number of changes (at most GPIO_TIMED_MAX)
+ *   flags   - GPIO_TIMED_WAIT to return after the last change fired
+ * 
+ * Returns: 0 on success, -1 on failure (errno EINTR: the wait was
+ *          interrupted, the changes stay queued and their ids are valid)
+ */
+int gpio_schedule(int fd, struct gpio_timed *changes, uint32_t count, uint32_t flags)
+{
+    struct gpio_timed_list list;
+    
+    GPIO_TRACE_CALL(GPIO_TRACE_SCHEDULE);
+    
+    if (fd < 0 || changes == NULL || count == 0 || count > GPIO_TIMED_MAX) {
+        fprintf(stderr, "ERROR: Invalid timed change list\n");
+        return -1;
+    }
+    
+    memset(&list, 0, sizeof(list));
+    list.changes = (uint64_t)(uintptr_t)changes;
+    list.count = count;
+    list.flags = flags;
+    
+    if (GPIO_SYSCALL(ioctl(fd, GPIO_IOCTL_SCHEDULE, &list)) < 0) {
+        if (errno != EINTR) {
+            fprintf(stderr, "ERROR: Cannot schedule changes: %s\n", strerror(errno));
+        }
+        return -1;
+    }
+    
+    return 0;
+}
+
+/*
+ * gpio_get_timed
+ * 
+ * Looks up the result and firing time of scheduled changes by id
+ * 
+ * Parameters:
+ *   fd      - File descriptor of the line they were scheduled on
+ *   changes - id set (result and fired_ns updated in place)
+ *   count   - Number of changes (at most GPIO_TIMED_MAX)
+ * 
+ * Returns: 0 on success, -1 on failure
+ */
+int gpio_get_timed(int fd, struct gpio_timed *changes, uint32_t count)
+{
+    struct gpio_timed_list list;
+    
+    GPIO_TRACE_CALL(GPIO_TRACE_GET_TIMED);
+    
+    if (fd < 0 || changes == NULL || count == 0 || count > GPIO_TIMED_MAX) {
+        fprintf(stderr, "ERROR: Invalid timed change list\n");
+        return -1;
+    }
+    
+    memset(&list, 0, sizeof(list));
+    list.changes = (uint64_t)(uintptr_t)changes;
+    list.count = count;
+    
+    if (GPIO_SYSCALL(ioctl(fd, GPIO_IOCTL_GET_TIMED, &list)) < 0) {
+        fprintf(stderr, "ERROR: Cannot query timed changes: %s\n", strerror(errno));
+        return -1;
+    }
+    
+    return 0;
 }
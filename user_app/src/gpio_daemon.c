@@ -0,0 +1,697 @@
+/*
+ * GPIO Daemon
+ *
+ * Owns /dev/gpio_dev and serves many clients over a Unix SOCK_SEQPACKET
+ * socket. Requests that arrive together are run as one round, in arrival
+ * order: redundant direction/value changes are skipped using a cached
+ * copy of the line state, and back-to-back reads share a single sample.
+ * Level changes are fanned out to subscribed clients, straight from the
+ * driver's edge events when the line has an interrupt and by sampling
+ * otherwise.
+ *
+ * License: GPL v2
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+
+#include "gpio_control.h"
+#include "gpio_daemon.h"
+
+/* Level sampling interval for event fan-out while subscribers exist */
+#define GPIOD_SAMPLE_INTERVAL_MS    10
+
+/* epoll tag of the device fd (0 is the listener, 1..N are clients) */
+#define GPIOD_TAG_DEVICE            0xffffffffu
+
+/* Connected client */
+struct gpiod_client {
+    int fd;
+    int subscribed;
+};
+
+/* One queued request of the current round */
+struct gpiod_pending {
+    int client;
+    struct gpiod_msg msg;
+};
+
+/* Server state */
+struct gpiod_server {
+    int dev_fd;
+    int listen_fd;
+    int epoll_fd;
+    struct gpiod_client clients[GPIOD_MAX_CLIENTS];
+    int subscribers;
+    int direction;              /* Cached line direction */
+    int value;                  /* Cached line level, -1 = unknown */
+    int irq_events;             /* Device fd delivers edge events */
+    unsigned long events_dropped;
+    struct gpiod_pending batch[GPIOD_MAX_BATCH];
+    int batch_len;
+};
+
+static uint64_t gpiod_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * gpiod_drop_client
+ *
+ * Closes a client connection and frees its slot
+ */
+static void gpiod_drop_client(struct gpiod_server *srv, int index)
+{
+    struct gpiod_client *cl = &srv->clients[index];
+
+    if (cl->fd < 0) {
+        return;
+    }
+
+    if (cl->subscribed) {
+        srv->subscribers--;
+    }
+
+    epoll_ctl(srv->epoll_fd, EPOLL_CTL_DEL, cl->fd, NULL);
+    close(cl->fd);
+    cl->fd = -1;
+    cl->subscribed = 0;
+}
+
+/*
+ * gpiod_send
+ *
+ * Sends one message without blocking the daemon. Replies to a client
+ * that cannot keep up close the connection; events are dropped instead.
+ */
+static void gpiod_send(struct gpiod_server *srv, int index, const struct gpiod_msg *msg)
+{
+    struct gpiod_client *cl = &srv->clients[index];
+
+    if (cl->fd < 0) {
+        return;
+    }
+
+    if (send(cl->fd, msg, sizeof(*msg), MSG_DONTWAIT | MSG_NOSIGNAL) < 0) {
+        if (errno == EAGAIN && msg->op == GPIOD_OP_EVENT) {
+            srv->events_dropped++;
+            return;
+        }
+        gpiod_drop_client(srv, index);
+    }
+}
+
+static void gpiod_reply(struct gpiod_server *srv, struct gpiod_pending *req,
+                        int status, int32_t arg, uint64_t timestamp_ns)
+{
+    struct gpiod_msg reply = req->msg;
+
+    reply.status = (uint8_t)status;
+    reply.arg = arg;
+    reply.timestamp_ns = timestamp_ns;
+    gpiod_send(srv, req->client, &reply);
+}
+
+/*
+ * gpiod_fan_out
+ *
+ * Sends a level-change notification to every subscriber
+ */
+static void gpiod_fan_out(struct gpiod_server *srv, int value, uint64_t timestamp_ns)
+{
+    struct gpiod_msg event;
+    int i;
+
+    memset(&event, 0, sizeof(event));
+    event.op = GPIOD_OP_EVENT;
+    event.arg = value;
+    event.timestamp_ns = timestamp_ns;
+
+    for (i = 0; i < GPIOD_MAX_CLIENTS; i++) {
+        if (srv->clients[i].fd >= 0 && srv->clients[i].subscribed) {
+            gpiod_send(srv, i, &event);
+        }
+    }
+}
+
+/*
+ * gpiod_sample
+ *
+ * Reads the line once and notifies subscribers if the level changed
+ *
+ * Returns: 0 on success, errno value on error
+ */
+static int gpiod_sample(struct gpiod_server *srv)
+{
+    int value;
+
+    if (ioctl(srv->dev_fd, GPIO_IOCTL_GET_VALUE, &value) < 0) {
+        return errno;
+    }
+
+    if (srv->value >= 0 && value != srv->value && srv->subscribers > 0) {
+        gpiod_fan_out(srv, value, gpiod_now_ns());
+    }
+    srv->value = value;
+
+    return 0;
+}
+
+/*
+ * gpiod_drain_events
+ *
+ * Reads every queued edge event from the non-blocking device fd and
+ * notifies subscribers of each level change, stamped with the IRQ time
+ */
+static void gpiod_drain_events(struct gpiod_server *srv)
+{
+    struct gpio_event events[64];
+    ssize_t n;
+    int value;
+    int i;
+
+    for (;;) {
+        n = read(srv->dev_fd, events, sizeof(events));
+        if (n <= 0) {
+            if (n < 0 && errno != EAGAIN && errno != EINTR) {
+                fprintf(stderr, "ERROR: Cannot read GPIO events: %s\n", strerror(errno));
+            }
+            return;
+        }
+
+        for (i = 0; i < (int)(n / sizeof(events[0])); i++) {
+            value = events[i].type == GPIO_EVENT_RISING;
+            /* Own writes were already announced by gpiod_write */
+            if (value != srv->value && srv->subscribers > 0) {
+                gpiod_fan_out(srv, value, events[i].timestamp_ns);
+            }
+            srv->value = value;
+        }
+    }
+}
+
+/*
+ * gpiod_watch_events
+ *
+ * Switches the device fd to non-blocking edge-event reads and adds it to
+ * the epoll set, so level changes wake the daemon instead of being polled
+ *
+ * Lines without an interrupt deliver events too (the driver polls them)
+ *
+ * Returns: 0 on success, -1 if the driver cannot deliver events
+ */
+static int gpiod_watch_events(struct gpiod_server *srv)
+{
+    struct epoll_event ev;
+    int edges = GPIO_EDGE_BOTH;
+    int mode = GPIO_READ_EVENTS;
+    int flags;
+
+    flags = fcntl(srv->dev_fd, F_GETFL);
+    if (flags < 0 || fcntl(srv->dev_fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        return -1;
+    }
+
+    if (ioctl(srv->dev_fd, GPIO_IOCTL_SET_EDGES, &edges) < 0 ||
+        ioctl(srv->dev_fd, GPIO_IOCTL_SET_READ_MODE, &mode) < 0) {
+        fcntl(srv->dev_fd, F_SETFL, flags);
+        return -1;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u32 = GPIOD_TAG_DEVICE;
+    if (epoll_ctl(srv->epoll_fd, EPOLL_CTL_ADD, srv->dev_fd, &ev) < 0) {
+        mode = GPIO_READ_VALUE;
+        ioctl(srv->dev_fd, GPIO_IOCTL_SET_READ_MODE, &mode);
+        fcntl(srv->dev_fd, F_SETFL, flags);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * gpiod_set_direction
+ *
+ * Applies one direction request, skipped if the line already has it
+ *
+ * Returns: 0 on success, errno value on error
+ */
+static int gpiod_set_direction(struct gpiod_server *srv, int direction)
+{
+    if (direction == srv->direction) {
+        return 0;
+    }
+
+    if (ioctl(srv->dev_fd, GPIO_IOCTL_SET_DIRECTION, &direction) < 0) {
+        return errno;
+    }
+
+    srv->direction = direction;
+    /* The driver drives a new output low; an input is unknown until sampled */
+    srv->value = (direction == GPIO_DIRECTION_OUTPUT) ? GPIO_VALUE_LOW : -1;
+
+    return 0;
+}
+
+/*
+ * gpiod_write
+ *
+ * Applies one write request, skipped if the line already has the level
+ *
+ * Returns: 0 on success, errno value on error
+ */
+static int gpiod_write(struct gpiod_server *srv, int value)
+{
+    if (srv->direction != GPIO_DIRECTION_OUTPUT) {
+        return EACCES;
+    }
+
+    if (value == srv->value) {
+        return 0;
+    }
+
+    if (ioctl(srv->dev_fd, GPIO_IOCTL_SET_VALUE, &value) < 0) {
+        return errno;
+    }
+
+    if (srv->subscribers > 0) {
+        gpiod_fan_out(srv, value, gpiod_now_ns());
+    }
+    srv->value = value;
+
+    return 0;
+}
+
+/*
+ * gpiod_run_batch
+ *
+ * Executes one round of requests in arrival order, so a 1-then-0 write
+ * pair still pulses the line and a write after a direction change sees
+ * the new direction. Only requests that cannot change what a client
+ * observes are merged: a direction or level the line already has is not
+ * written again, and a run of reads with no write or direction change in
+ * between shares one sample. Each reply carries that request's own result.
+ */
+static void gpiod_run_batch(struct gpiod_server *srv)
+{
+    int read_status = 0;
+    int sampled = 0;
+    int status;
+    int i;
+
+    for (i = 0; i < srv->batch_len; i++) {
+        struct gpiod_pending *req = &srv->batch[i];
+        struct gpiod_client *cl = &srv->clients[req->client];
+
+        switch (req->msg.op) {
+        case GPIOD_OP_SET_DIRECTION:
+            status = gpiod_set_direction(srv, req->msg.arg ? GPIO_DIRECTION_OUTPUT
+                                                           : GPIO_DIRECTION_INPUT);
+            sampled = 0;
+            gpiod_reply(srv, req, status, srv->direction, gpiod_now_ns());
+            break;
+        case GPIOD_OP_WRITE:
+            status = gpiod_write(srv, req->msg.arg ? GPIO_VALUE_HIGH : GPIO_VALUE_LOW);
+            sampled = 0;
+            gpiod_reply(srv, req, status, srv->value, gpiod_now_ns());
+            break;
+        case GPIOD_OP_READ:
+            if (!sampled) {
+                read_status = gpiod_sample(srv);
+                sampled = 1;
+            }
+            gpiod_reply(srv, req, read_status, srv->value, gpiod_now_ns());
+            break;
+        case GPIOD_OP_GET_DIRECTION:
+            gpiod_reply(srv, req, 0, srv->direction, gpiod_now_ns());
+            break;
+        case GPIOD_OP_SUBSCRIBE:
+            if (cl->fd >= 0 && !cl->subscribed) {
+                cl->subscribed = 1;
+                srv->subscribers++;
+            }
+            gpiod_reply(srv, req, 0, srv->value, gpiod_now_ns());
+            break;
+        case GPIOD_OP_UNSUBSCRIBE:
+            if (cl->fd >= 0 && cl->subscribed) {
+                cl->subscribed = 0;
+                srv->subscribers--;
+            }
+            gpiod_reply(srv, req, 0, 0, gpiod_now_ns());
+            break;
+        default:
+            gpiod_reply(srv, req, EINVAL, 0, gpiod_now_ns());
+            break;
+        }
+    }
+
+    srv->batch_len = 0;
+}
+
+/*
+ * gpiod_accept
+ *
+ * Accepts all pending connections
+ */
+static void gpiod_accept(struct gpiod_server *srv)
+{
+    struct epoll_event ev;
+    int fd;
+    int i;
+
+    while ((fd = accept4(srv->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        for (i = 0; i < GPIOD_MAX_CLIENTS; i++) {
+            if (srv->clients[i].fd < 0) {
+                break;
+            }
+        }
+
+        if (i == GPIOD_MAX_CLIENTS) {
+            fprintf(stderr, "WARNING: Client limit reached, rejecting connection\n");
+            close(fd);
+            continue;
+        }
+
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.u32 = (uint32_t)i + 1;   /* 0 is the listening socket */
+        if (epoll_ctl(srv->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            close(fd);
+            continue;
+        }
+
+        srv->clients[i].fd = fd;
+        srv->clients[i].subscribed = 0;
+    }
+}
+
+/*
+ * gpiod_collect
+ *
+ * Drains queued requests of one client into the current batch
+ */
+static void gpiod_collect(struct gpiod_server *srv, int index)
+{
+    struct gpiod_client *cl = &srv->clients[index];
+    struct gpiod_msg msg;
+    ssize_t len;
+    int n;
+
+    for (n = 0; n < GPIOD_MAX_PER_CLIENT && srv->batch_len < GPIOD_MAX_BATCH; n++) {
+        len = recv(cl->fd, &msg, sizeof(msg), MSG_DONTWAIT);
+        if (len < 0 && errno == EAGAIN) {
+            return;
+        }
+        if (len <= 0) {
+            gpiod_drop_client(srv, index);
+            return;
+        }
+        if ((size_t)len != sizeof(msg)) {
+            continue;   /* Malformed packet */
+        }
+
+        srv->batch[srv->batch_len].client = index;
+        srv->batch[srv->batch_len].msg = msg;
+        srv->batch_len++;
+    }
+}
+
+/*
+ * gpiod_listen
+ *
+ * Creates the listening socket at socket_path
+ *
+ * Returns: Socket descriptor on success, -1 on error
+ */
+static int gpiod_listen(const char *socket_path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "ERROR: Socket path too long: %s\n", socket_path);
+        return -1;
+    }
+
+    fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        fprintf(stderr, "ERROR: Cannot create socket: %s\n", strerror(errno));
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path);
+    unlink(socket_path);
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(fd, 128) < 0) {
+        fprintf(stderr, "ERROR: Cannot listen on %s: %s\n", socket_path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    chmod(socket_path, 0660);
+
+    return fd;
+}
+
+/*
+ * gpiod_serve
+ *
+ * Runs the daemon until *keep_running becomes zero
+ *
+ * Parameters:
+ *   dev_fd       - Open GPIO device
+ *   socket_path  - Unix socket to listen on
+ *   keep_running - Cleared by the caller's signal handler
+ *
+ * Returns: 0 on success, -1 on error
+ */
+int gpiod_serve(int dev_fd, const char *socket_path, volatile int *keep_running)
+{
+    static struct gpiod_server srv;
+    struct epoll_event events[64];
+    struct epoll_event ev;
+    int need_accept;
+    int nready;
+    int i;
+
+    memset(&srv, 0, sizeof(srv));
+    srv.dev_fd = dev_fd;
+    srv.value = -1;
+    for (i = 0; i < GPIOD_MAX_CLIENTS; i++) {
+        srv.clients[i].fd = -1;
+    }
+
+    if (ioctl(dev_fd, GPIO_IOCTL_GET_DIRECTION, &srv.direction) < 0) {
+        fprintf(stderr, "ERROR: Cannot get GPIO direction: %s\n", strerror(errno));
+        return -1;
+    }
+    gpiod_sample(&srv);
+
+    srv.listen_fd = gpiod_listen(socket_path);
+    if (srv.listen_fd < 0) {
+        return -1;
+    }
+
+    srv.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (srv.epoll_fd < 0) {
+        fprintf(stderr, "ERROR: Cannot create epoll instance: %s\n", strerror(errno));
+        close(srv.listen_fd);
+        return -1;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u32 = 0;
+    epoll_ctl(srv.epoll_fd, EPOLL_CTL_ADD, srv.listen_fd, &ev);
+
+    srv.irq_events = gpiod_watch_events(&srv) == 0;
+
+    printf("SUCCESS: GPIO daemon listening on %s (%s)\n", socket_path,
+           srv.irq_events ? "edge events" : "sampling");
+
+    while (*keep_running) {
+        nready = epoll_wait(srv.epoll_fd, events, 64,
+                            srv.subscribers > 0 && !srv.irq_events ?
+                            GPIOD_SAMPLE_INTERVAL_MS : 1000);
+        if (nready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "ERROR: epoll_wait failed: %s\n", strerror(errno));
+            break;
+        }
+
+        need_accept = 0;
+        for (i = 0; i < nready; i++) {
+            if (events[i].data.u32 == 0) {
+                need_accept = 1;
+            } else if (events[i].data.u32 == GPIOD_TAG_DEVICE) {
+                gpiod_drain_events(&srv);
+            } else {
+                gpiod_collect(&srv, (int)events[i].data.u32 - 1);
+            }
+        }
+
+        if (srv.batch_len > 0) {
+            gpiod_run_batch(&srv);
+        } else if (srv.subscribers > 0 && !srv.irq_events) {
+            gpiod_sample(&srv);
+        }
+
+        /* After the batch, so a freed client slot is never reused mid-round */
+        if (need_accept) {
+            gpiod_accept(&srv);
+        }
+    }
+
+    for (i = 0; i < GPIOD_MAX_CLIENTS; i++) {
+        gpiod_drop_client(&srv, i);
+    }
+    close(srv.epoll_fd);
+    close(srv.listen_fd);
+    unlink(socket_path);
+
+    printf("GPIO daemon stopped (%lu events dropped)\n", srv.events_dropped);
+
+    return 0;
+}
+
+/*
+ * gpiod_connect
+ *
+ * Connects to a running daemon
+ *
+ * Returns: Socket descriptor on success, -1 on error
+ */
+int gpiod_connect(const char *socket_path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "ERROR: Socket path too long: %s\n", socket_path);
+        return -1;
+    }
+
+    fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        fprintf(stderr, "ERROR: Cannot create socket: %s\n", strerror(errno));
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path);
+
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "ERROR: Cannot connect to %s: %s\n", socket_path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/*
+ * gpiod_request
+ *
+ * Sends one request and waits for its reply. Event notifications that
+ * arrive in between are discarded; use a dedicated connection for
+ * subscriptions.
+ *
+ * Parameters:
+ *   sock   - Connected daemon socket
+ *   op     - GPIOD_OP_* request
+ *   arg    - Request argument
+ *   result - Reply argument (may be NULL)
+ *
+ * Returns: 0 on success, -1 on error (errno set)
+ */
+int gpiod_request(int sock, uint8_t op, int32_t arg, int32_t *result)
+{
+    static uint32_t next_seq = 1;
+    struct gpiod_msg msg;
+    uint32_t seq = next_seq++;
+    ssize_t len;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.op = op;
+    msg.seq = seq;
+    msg.arg = arg;
+
+    if (send(sock, &msg, sizeof(msg), MSG_NOSIGNAL) < 0) {
+        return -1;
+    }
+
+    for (;;) {
+        len = recv(sock, &msg, sizeof(msg), 0);
+        if (len < 0) {
+            return -1;
+        }
+        if (len == 0) {
+            errno = ECONNRESET;
+            return -1;
+        }
+        if ((size_t)len == sizeof(msg) && msg.op != GPIOD_OP_EVENT && msg.seq == seq) {
+            break;
+        }
+    }
+
+    if (msg.status != 0) {
+        errno = msg.status;
+        return -1;
+    }
+
+    if (result != NULL) {
+        *result = msg.arg;
+    }
+
+    return 0;
+}
+
+/*
+ * gpiod_next_event
+ *
+ * Waits for the next event notification on a subscribed connection
+ *
+ * Returns: 0 on success, -1 on error (errno set)
+ */
+int gpiod_next_event(int sock, struct gpiod_msg *event)
+{
+    ssize_t len;
+
+    for (;;) {
+        len = recv(sock, event, sizeof(*event), 0);
+        if (len < 0) {
+            return -1;
+        }
+        if (len == 0) {
+            errno = ECONNRESET;
+            return -1;
+        }
+        if ((size_t)len == sizeof(*event) && event->op == GPIOD_OP_EVENT) {
+            return 0;
+        }
+    }
+}
@@ -0,0 +1,658 @@
+/*
+ * GPIO Binary Edge Log
+ *
+ * Append-only recording of edge events: varint delta-encoded records in
+ * chunks, periodic index blocks for seeking, and an mmap-based reader
+ * that locates a time range from the index without decoding the records
+ * in front of it. See gpio_edgelog.h for the on-disk layout.
+ *
+ * License: GPL v2
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "gpio_edgelog.h"
+
+/* Longest LEB128 encoding of a 64-bit value */
+#define GPIO_EDGELOG_VARINT_MAX     10
+
+static int gpio_edgelog_write_all(struct gpio_edgelog_writer *writer,
+                                  struct iovec *iov, int iovcnt)
+{
+    ssize_t ret;
+    size_t total = 0;
+    int i;
+
+    for (i = 0; i < iovcnt; i++) {
+        total += iov[i].iov_len;
+    }
+
+    ret = writev(writer->fd, iov, iovcnt);
+    if (ret < 0 || (size_t)ret != total) {
+        fprintf(stderr, "ERROR: Cannot write edge log: %s\n",
+                ret < 0 ? strerror(errno) : "short write");
+        return -1;
+    }
+
+    writer->offset += total;
+    return 0;
+}
+
+/*
+ * gpio_edgelog_write_index
+ *
+ * Writes an index block for the chunks flushed since the previous one
+ */
+static int gpio_edgelog_write_index(struct gpio_edgelog_writer *writer)
+{
+    struct gpio_edgelog_index_header hdr;
+    struct iovec iov[2];
+    uint64_t offset = writer->offset;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = GPIO_EDGELOG_INDEX_MAGIC;
+    hdr.length = writer->npending * sizeof(struct gpio_edgelog_index_entry);
+    hdr.count = writer->npending;
+    hdr.prev_index = writer->prev_index;
+
+    iov[0].iov_base = &hdr;
+    iov[0].iov_len = sizeof(hdr);
+    iov[1].iov_base = writer->pending;
+    iov[1].iov_len = hdr.length;
+
+    if (gpio_edgelog_write_all(writer, iov, 2) != 0) {
+        return -1;
+    }
+
+    writer->prev_index = offset;
+    writer->npending = 0;
+
+    return 0;
+}
+
+/*
+ * gpio_edgelog_create
+ *
+ * Creates (truncates) an edge log and writes its file header
+ *
+ * Parameters:
+ *   writer - Writer state to initialize
+ *   path   - Output file
+ *   line   - Source line recorded in the header
+ *
+ * Returns: 0 on success, -1 on error
+ */
+int gpio_edgelog_create(struct gpio_edgelog_writer *writer, const char *path, uint32_t line)
+{
+    struct gpio_edgelog_file_header hdr;
+    struct timespec mono;
+    struct timespec real;
+    struct iovec iov;
+
+    memset(writer, 0, sizeof(*writer));
+
+    writer->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (writer->fd < 0) {
+        fprintf(stderr, "ERROR: Cannot create %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+    clock_gettime(CLOCK_REALTIME, &real);
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = GPIO_EDGELOG_MAGIC;
+    hdr.version = GPIO_EDGELOG_VERSION;
+    hdr.header_size = sizeof(hdr);
+    hdr.line = line;
+    hdr.realtime_offset_ns = (int64_t)(real.tv_sec - mono.tv_sec) * 1000000000LL +
+                             (real.tv_nsec - mono.tv_nsec);
+
+    iov.iov_base = &hdr;
+    iov.iov_len = sizeof(hdr);
+    if (gpio_edgelog_write_all(writer, &iov, 1) != 0) {
+        close(writer->fd);
+        writer->fd = -1;
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * gpio_edgelog_flush
+ *
+ * Writes the chunk being assembled (if any) and, every
+ * GPIO_EDGELOG_INDEX_INTERVAL chunks, an index block
+ *
+ * Returns: 0 on success, -1 on error
+ */
+int gpio_edgelog_flush(struct gpio_edgelog_writer *writer)
+{
+    struct gpio_edgelog_chunk_header hdr;
+    struct gpio_edgelog_index_entry *entry;
+    struct iovec iov[2];
+    uint64_t offset = writer->offset;
+
+    if (writer->count == 0) {
+        return 0;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = GPIO_EDGELOG_CHUNK_MAGIC;
+    hdr.length = (uint32_t)writer->used;
+    hdr.count = writer->count;
+    hdr.first_ts = writer->first_ts;
+    hdr.last_ts = writer->last_ts;
+
+    iov[0].iov_base = &hdr;
+    iov[0].iov_len = sizeof(hdr);
+    iov[1].iov_base = writer->payload;
+    iov[1].iov_len = writer->used;
+
+    if (gpio_edgelog_write_all(writer, iov, 2) != 0) {
+        return -1;
+    }
+
+    entry = &writer->pending[writer->npending++];
+    entry->first_ts = writer->first_ts;
+    entry->last_ts = writer->last_ts;
+    entry->offset = offset;
+
+    writer->used = 0;
+    writer->count = 0;
+
+    if (writer->npending == GPIO_EDGELOG_INDEX_INTERVAL) {
+        return gpio_edgelog_write_index(writer);
+    }
+
+    return 0;
+}
+
+/*
+ * gpio_edgelog_append
+ *
+ * Appends one edge; timestamps must not go backwards
+ *
+ * Returns: 0 on success, -1 on error
+ */
+int gpio_edgelog_append(struct gpio_edgelog_writer *writer, uint64_t timestamp_ns, int value)
+{
+    uint64_t delta;
+    uint64_t v;
+
+    if (writer->count > 0 && writer->used + GPIO_EDGELOG_VARINT_MAX > GPIO_EDGELOG_CHUNK_BYTES) {
+        if (gpio_edgelog_flush(writer) != 0) {
+            return -1;
+        }
+    }
+
+    if (writer->count == 0) {
+        writer->first_ts = timestamp_ns;
+        writer->last_ts = timestamp_ns;
+    }
+
+    delta = (timestamp_ns > writer->last_ts) ? timestamp_ns - writer->last_ts : 0;
+    v = (delta << 1) | (value ? 1 : 0);
+
+    do {
+        uint8_t byte = v & 0x7f;
+
+        v >>= 7;
+        writer->payload[writer->used++] = byte | (v ? 0x80 : 0);
+    } while (v != 0);
+
+    writer->last_ts += delta;
+    writer->count++;
+    writer->total_events++;
+
+    return 0;
+}
+
+/*
+ * gpio_edgelog_close
+ *
+ * Flushes pending records, writes the final index block and the trailer
+ * that lets readers find the index from the end of the file
+ *
+ * Returns: 0 on success, -1 on error
+ */
+int gpio_edgelog_close(struct gpio_edgelog_writer *writer)
+{
+    struct gpio_edgelog_trailer trailer;
+    struct iovec iov;
+    int ret = 0;
+
+    if (writer->fd < 0) {
+        return -1;
+    }
+
+    if (gpio_edgelog_flush(writer) != 0) {
+        ret = -1;
+    } else if ((writer->npending > 0 || writer->prev_index == 0) &&
+               gpio_edgelog_write_index(writer) != 0) {
+        ret = -1;
+    } else {
+        memset(&trailer, 0, sizeof(trailer));
+        trailer.magic = GPIO_EDGELOG_TRAILER_MAGIC;
+        trailer.length = sizeof(trailer.last_index);
+        trailer.last_index = writer->prev_index;
+
+        iov.iov_base = &trailer;
+        iov.iov_len = sizeof(trailer);
+        ret = gpio_edgelog_write_all(writer, &iov, 1);
+    }
+
+    close(writer->fd);
+    writer->fd = -1;
+
+    return ret;
+}
+
+/*
+ * gpio_edgelog_chunk_valid
+ *
+ * Checks that a chunk header and its payload at offset lie inside the log
+ */
+static int gpio_edgelog_chunk_valid(const struct gpio_edgelog_reader *reader, uint64_t offset)
+{
+    struct gpio_edgelog_chunk_header hdr;
+
+    if (offset > reader->size || reader->size - offset < sizeof(hdr)) {
+        return 0;
+    }
+    memcpy(&hdr, reader->base + offset, sizeof(hdr));
+
+    return hdr.magic == GPIO_EDGELOG_CHUNK_MAGIC &&
+           hdr.length <= reader->size - offset - sizeof(hdr);
+}
+
+/*
+ * gpio_edgelog_load_index
+ *
+ * Builds the chunk directory from the index chain of a cleanly closed log
+ *
+ * Returns: 0 on success, -1 if the trailer or index chain is unusable
+ */
+static int gpio_edgelog_load_index(struct gpio_edgelog_reader *reader)
+{
+    struct gpio_edgelog_trailer trailer;
+    struct gpio_edgelog_index_header hdr;
+    uint64_t offset;
+    size_t total = 0;
+    size_t fill;
+    size_t hops = 0;
+
+    if (reader->size < sizeof(struct gpio_edgelog_file_header) + sizeof(trailer)) {
+        return -1;
+    }
+
+    memcpy(&trailer, reader->base + reader->size - sizeof(trailer), sizeof(trailer));
+    if (trailer.magic != GPIO_EDGELOG_TRAILER_MAGIC || trailer.length != sizeof(trailer.last_index)) {
+        return -1;
+    }
+
+    /* First pass: validate the chain and count chunks */
+    for (offset = trailer.last_index; offset != 0; offset = hdr.prev_index) {
+        if (offset > reader->size || reader->size - offset < sizeof(hdr) ||
+            ++hops > reader->size / sizeof(hdr)) {
+            return -1;
+        }
+        memcpy(&hdr, reader->base + offset, sizeof(hdr));
+        if (hdr.magic != GPIO_EDGELOG_INDEX_MAGIC ||
+            hdr.length != hdr.count * sizeof(struct gpio_edgelog_index_entry) ||
+            hdr.length > reader->size - offset - sizeof(hdr) ||
+            (hdr.prev_index != 0 && hdr.prev_index >= offset)) {
+            return -1;
+        }
+        total += hdr.count;
+    }
+
+    reader->dir = calloc(total ? total : 1, sizeof(*reader->dir));
+    if (reader->dir == NULL) {
+        return -1;
+    }
+
+    /* Second pass: blocks are walked newest first, so fill from the back */
+    fill = total;
+    for (offset = trailer.last_index; offset != 0; offset = hdr.prev_index) {
+        memcpy(&hdr, reader->base + offset, sizeof(hdr));
+        fill -= hdr.count;
+        memcpy(&reader->dir[fill], reader->base + offset + sizeof(hdr), hdr.length);
+    }
+
+    /* Entries come from the file too: every chunk must fit inside it */
+    for (fill = 0; fill < total; fill++) {
+        if (!gpio_edgelog_chunk_valid(reader, reader->dir[fill].offset)) {
+            return -1;
+        }
+    }
+
+    reader->nchunks = total;
+    return 0;
+}
+
+/*
+ * gpio_edgelog_scan_blocks
+ *
+ * Builds the chunk directory by hopping over block headers; used for logs
+ * that were not closed (recording still running, or a crash). A torn
+ * block at the end of the file terminates the scan.
+ *
+ * Returns: 0 on success, -1 on error
+ */
+static int gpio_edgelog_scan_blocks(struct gpio_edgelog_reader *reader, size_t start)
+{
+    struct gpio_edgelog_chunk_header hdr;
+    size_t capacity = 256;
+    size_t offset = start;
+    void *grown;
+
+    reader->dir = calloc(capacity, sizeof(*reader->dir));
+    if (reader->dir == NULL) {
+        return -1;
+    }
+    reader->nchunks = 0;
+
+    while (offset + 8 <= reader->size) {
+        uint32_t magic;
+        uint32_t length;
+        size_t hdr_size;
+
+        memcpy(&magic, reader->base + offset, 4);
+        memcpy(&length, reader->base + offset + 4, 4);
+
+        if (magic == GPIO_EDGELOG_CHUNK_MAGIC) {
+            hdr_size = sizeof(struct gpio_edgelog_chunk_header);
+        } else if (magic == GPIO_EDGELOG_INDEX_MAGIC) {
+            hdr_size = sizeof(struct gpio_edgelog_index_header);
+        } else if (magic == GPIO_EDGELOG_TRAILER_MAGIC) {
+            hdr_size = 8;
+        } else {
+            break;
+        }
+
+        if (offset + hdr_size + length > reader->size) {
+            break;
+        }
+
+        if (magic == GPIO_EDGELOG_CHUNK_MAGIC) {
+            if (reader->nchunks == capacity) {
+                capacity *= 2;
+                grown = realloc(reader->dir, capacity * sizeof(*reader->dir));
+                if (grown == NULL) {
+                    return -1;
+                }
+                reader->dir = grown;
+            }
+            memcpy(&hdr, reader->base + offset, sizeof(hdr));
+            reader->dir[reader->nchunks].first_ts = hdr.first_ts;
+            reader->dir[reader->nchunks].last_ts = hdr.last_ts;
+            reader->dir[reader->nchunks].offset = offset;
+            reader->nchunks++;
+        }
+
+        offset += hdr_size + length;
+    }
+
+    return 0;
+}
+
+/*
+ * gpio_edgelog_open
+ *
+ * Maps an edge log read-only and builds its chunk directory
+ *
+ * Returns: 0 on success, -1 on error
+ */
+int gpio_edgelog_open(struct gpio_edgelog_reader *reader, const char *path)
+{
+    struct gpio_edgelog_file_header hdr;
+    struct stat st;
+    void *addr;
+
+    memset(reader, 0, sizeof(*reader));
+
+    reader->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (reader->fd < 0) {
+        fprintf(stderr, "ERROR: Cannot open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    if (fstat(reader->fd, &st) < 0 || (size_t)st.st_size < sizeof(hdr)) {
+        fprintf(stderr, "ERROR: %s is not an edge log\n", path);
+        close(reader->fd);
+        return -1;
+    }
+
+    addr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, reader->fd, 0);
+    if (addr == MAP_FAILED) {
+        fprintf(stderr, "ERROR: Cannot map %s: %s\n", path, strerror(errno));
+        close(reader->fd);
+        return -1;
+    }
+    reader->base = addr;
+    reader->size = (size_t)st.st_size;
+
+    memcpy(&hdr, reader->base, sizeof(hdr));
+    if (hdr.magic != GPIO_EDGELOG_MAGIC || hdr.version != GPIO_EDGELOG_VERSION ||
+        hdr.header_size < sizeof(hdr) || hdr.header_size > reader->size) {
+        fprintf(stderr, "ERROR: %s is not a version %d edge log\n", path, GPIO_EDGELOG_VERSION);
+        gpio_edgelog_release(reader);
+        return -1;
+    }
+    reader->realtime_offset_ns = hdr.realtime_offset_ns;
+
+    if (gpio_edgelog_load_index(reader) != 0) {
+        free(reader->dir);
+        reader->dir = NULL;
+        if (gpio_edgelog_scan_blocks(reader, hdr.header_size) != 0) {
+            fprintf(stderr, "ERROR: Cannot index %s\n", path);
+            gpio_edgelog_release(reader);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * gpio_edgelog_release
+ *
+ * Unmaps a log opened with gpio_edgelog_open
+ */
+void gpio_edgelog_release(struct gpio_edgelog_reader *reader)
+{
+    free(reader->dir);
+    reader->dir = NULL;
+    reader->nchunks = 0;
+
+    if (reader->base != NULL) {
+        munmap((void *)reader->base, reader->size);
+        reader->base = NULL;
+    }
+    if (reader->fd >= 0) {
+        close(reader->fd);
+        reader->fd = -1;
+    }
+}
+
+uint64_t gpio_edgelog_first_ts(const struct gpio_edgelog_reader *reader)
+{
+    return reader->nchunks ? reader->dir[0].first_ts : 0;
+}
+
+uint64_t gpio_edgelog_last_ts(const struct gpio_edgelog_reader *reader)
+{
+    return reader->nchunks ? reader->dir[reader->nchunks - 1].last_ts : 0;
+}
+
+/*
+ * gpio_edgelog_seek
+ *
+ * Positions an iterator on the first edge at or after from_ns. Only the
+ * chunk directory is searched; records before the target chunk are
+ * never touched.
+ *
+ * Parameters:
+ *   reader   - Open log
+ *   iter     - Iterator to initialize
+ *   from_ns  - First timestamp of interest (0 = start of log)
+ *   until_ns - Last timestamp of interest (UINT64_MAX = end of log)
+ */
+void gpio_edgelog_seek(const struct gpio_edgelog_reader *reader, struct gpio_edgelog_iter *iter,
+                       uint64_t from_ns, uint64_t until_ns)
+{
+    size_t lo = 0;
+    size_t hi = reader->nchunks;
+
+    /* First chunk whose last edge is not before from_ns */
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (reader->dir[mid].last_ts < from_ns) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    memset(iter, 0, sizeof(*iter));
+    iter->reader = reader;
+    iter->chunk = lo;
+    iter->from_ns = from_ns;
+    iter->until_ns = until_ns;
+}
+
+/*
+ * gpio_edgelog_set_readahead
+ *
+ * Enables streaming mode for long sequential reads: the iterator keeps
+ * about 'bytes' of the log ahead of the decode position paged in
+ * (MADV_WILLNEED) and releases chunks it has finished with
+ * (MADV_DONTNEED), so memory use stays bounded by the window rather than
+ * the file size.
+ */
+void gpio_edgelog_set_readahead(struct gpio_edgelog_iter *iter, size_t bytes)
+{
+    iter->readahead = bytes;
+    iter->prefetched = 0;
+    iter->released = 0;
+}
+
+/*
+ * gpio_edgelog_stream
+ *
+ * Readahead bookkeeping when the iterator moves to a new chunk
+ */
+static void gpio_edgelog_stream(struct gpio_edgelog_iter *iter, size_t offset)
+{
+    const struct gpio_edgelog_reader *reader = iter->reader;
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t start;
+    size_t end;
+
+    /* Drop fully consumed pages behind the current chunk */
+    start = offset & ~(page - 1);
+    if (start > iter->released) {
+        madvise((void *)(reader->base + iter->released), start - iter->released, MADV_DONTNEED);
+        iter->released = start;
+    }
+
+    /* Top the prefetch window up once it is half used */
+    end = offset + iter->readahead;
+    if (end > reader->size) {
+        end = reader->size;
+    }
+    if (iter->prefetched < offset + iter->readahead / 2 && iter->prefetched < end) {
+        start = (iter->prefetched > start ? iter->prefetched : start) & ~(page - 1);
+        madvise((void *)(reader->base + start), end - start, MADV_WILLNEED);
+        iter->prefetched = end;
+    }
+}
+
+/*
+ * gpio_edgelog_next
+ *
+ * Decodes the next edge in range
+ *
+ * Returns: 1 if an edge was produced, 0 at the end of the range or log
+ */
+int gpio_edgelog_next(struct gpio_edgelog_iter *iter, struct gpio_edge *edge)
+{
+    const struct gpio_edgelog_reader *reader = iter->reader;
+    struct gpio_edgelog_chunk_header hdr;
+    const uint8_t *base;
+    uint64_t v;
+    int shift;
+
+    for (;;) {
+        while (iter->remaining == 0) {
+            if (iter->chunk >= reader->nchunks) {
+                return 0;
+            }
+
+            if (!gpio_edgelog_chunk_valid(reader, reader->dir[iter->chunk].offset)) {
+                iter->chunk++;
+                continue;
+            }
+
+            if (iter->readahead != 0) {
+                gpio_edgelog_stream(iter, reader->dir[iter->chunk].offset);
+            }
+
+            base = reader->base + reader->dir[iter->chunk].offset;
+            memcpy(&hdr, base, sizeof(hdr));
+            iter->chunk++;
+
+            if (hdr.first_ts > iter->until_ns) {
+                iter->chunk = reader->nchunks;
+                return 0;
+            }
+
+            iter->p = base + sizeof(hdr);
+            iter->end = iter->p + hdr.length;
+            iter->remaining = hdr.count;
+            iter->ts = hdr.first_ts;
+        }
+
+        v = 0;
+        shift = 0;
+        do {
+            if (iter->p >= iter->end || shift > 63) {
+                iter->remaining = 0;    /* Corrupt chunk: skip the rest of it */
+                break;
+            }
+            v |= (uint64_t)(*iter->p & 0x7f) << shift;
+            shift += 7;
+        } while (*iter->p++ & 0x80);
+
+        if (iter->remaining == 0) {
+            continue;
+        }
+        iter->remaining--;
+        iter->ts += v >> 1;
+
+        if (iter->ts > iter->until_ns) {
+            iter->remaining = 0;
+            iter->chunk = reader->nchunks;
+            return 0;
+        }
+        if (iter->ts < iter->from_ns) {
+            continue;
+        }
+
+        edge->timestamp_ns = iter->ts;
+        edge->value = (int)(v & 1);
+        return 1;
+    }
+}
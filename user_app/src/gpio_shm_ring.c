@@ -0,0 +1,361 @@
+/*
+ * GPIO Shared-Memory Event Ring
+ *
+ * Single-producer, multi-consumer edge event ring in POSIX shared memory.
+ * The producer never learns about consumers: it writes a slot under a
+ * per-slot sequence number, advances the head and only enters the kernel
+ * (FUTEX_WAKE) when some consumer is actually asleep. Each consumer keeps
+ * a private cursor, detects overruns from the slot sequence numbers and
+ * sleeps on the shared futex word when it has caught up.
+ *
+ * License: GPL v2
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "gpio_shm_ring.h"
+
+/* Shared header, followed by the slot array */
+struct gpio_ring_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity;
+    uint32_t slot_size;
+    uint64_t head;              /* Next position the producer writes */
+    uint32_t futex_word;        /* Bumped on every publish */
+    uint32_t waiters;           /* Consumers currently in FUTEX_WAIT */
+    uint8_t pad[32];            /* Keep slots off the header cache line */
+};
+
+/* seq = 2 * position + 1 while being written, 2 * position + 2 when valid */
+struct gpio_ring_slot {
+    uint64_t seq;
+    uint64_t timestamp_ns;
+    int32_t value;
+    uint32_t line;
+};
+
+static long gpio_ring_futex(uint32_t *addr, int op, uint32_t val, const struct timespec *timeout)
+{
+    return syscall(SYS_futex, addr, op, val, timeout, NULL, 0);
+}
+
+static int gpio_ring_map(struct gpio_ring *ring, int fd, size_t size)
+{
+    void *addr;
+
+    addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        fprintf(stderr, "ERROR: Cannot map event ring: %s\n", strerror(errno));
+        return -1;
+    }
+
+    ring->fd = fd;
+    ring->map_size = size;
+    ring->hdr = addr;
+    ring->slots = (struct gpio_ring_slot *)(ring->hdr + 1);
+
+    return 0;
+}
+
+/*
+ * gpio_ring_create
+ *
+ * Creates (or replaces) a shared-memory ring for publishing events.
+ * Consumers still attached to a replaced ring see no further events.
+ *
+ * Parameters:
+ *   ring     - Ring handle to initialize
+ *   name     - POSIX shared memory name (e.g. GPIO_RING_DEFAULT_NAME)
+ *   capacity - Number of events, rounded up to a power of two
+ *
+ * Returns: 0 on success, -1 on error
+ */
+int gpio_ring_create(struct gpio_ring *ring, const char *name, uint32_t capacity)
+{
+    uint32_t slots = 1;
+    size_t size;
+    int fd;
+
+    ring->fd = -1;
+    ring->hdr = NULL;
+
+    while (slots < capacity && slots < (1u << 30)) {
+        slots <<= 1;
+    }
+    size = sizeof(struct gpio_ring_header) + (size_t)slots * sizeof(struct gpio_ring_slot);
+
+    shm_unlink(name);
+    fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, GPIO_RING_MODE);
+    if (fd < 0) {
+        fprintf(stderr, "ERROR: Cannot create shared memory %s: %s\n", name, strerror(errno));
+        return -1;
+    }
+
+    /* Not subject to the umask, like the daemon socket */
+    if (fchmod(fd, GPIO_RING_MODE) < 0) {
+        fprintf(stderr, "ERROR: Cannot set mode of shared memory %s: %s\n", name, strerror(errno));
+        close(fd);
+        shm_unlink(name);
+        return -1;
+    }
+
+    if (ftruncate(fd, (off_t)size) < 0) {
+        fprintf(stderr, "ERROR: Cannot size shared memory %s: %s\n", name, strerror(errno));
+        close(fd);
+        shm_unlink(name);
+        return -1;
+    }
+
+    if (gpio_ring_map(ring, fd, size) != 0) {
+        close(fd);
+        shm_unlink(name);
+        return -1;
+    }
+
+    ring->mask = slots - 1;
+    ring->hdr->version = GPIO_RING_VERSION;
+    ring->hdr->capacity = slots;
+    ring->hdr->slot_size = sizeof(struct gpio_ring_slot);
+    /* Publish the magic last: attach() refuses a half-initialized ring */
+    __atomic_store_n(&ring->hdr->magic, GPIO_RING_MAGIC, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+/*
+ * gpio_ring_attach
+ *
+ * Maps an existing ring as a consumer
+ *
+ * Returns: 0 on success, -1 on error
+ */
+int gpio_ring_attach(struct gpio_ring *ring, const char *name)
+{
+    struct gpio_ring_header *hdr;
+    struct stat st;
+    int fd;
+
+    ring->fd = -1;
+    ring->hdr = NULL;
+
+    fd = shm_open(name, O_RDWR | O_CLOEXEC, 0);
+    if (fd < 0) {
+        fprintf(stderr, "ERROR: Cannot open shared memory %s: %s\n", name, strerror(errno));
+        return -1;
+    }
+
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(struct gpio_ring_header)) {
+        fprintf(stderr, "ERROR: Shared memory %s is not an event ring\n", name);
+        close(fd);
+        return -1;
+    }
+
+    if (gpio_ring_map(ring, fd, (size_t)st.st_size) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    hdr = ring->hdr;
+    if (__atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE) != GPIO_RING_MAGIC ||
+        hdr->version != GPIO_RING_VERSION ||
+        hdr->slot_size != sizeof(struct gpio_ring_slot) ||
+        hdr->capacity == 0 || (hdr->capacity & (hdr->capacity - 1)) != 0 ||
+        sizeof(*hdr) + (size_t)hdr->capacity * sizeof(struct gpio_ring_slot) > ring->map_size) {
+        fprintf(stderr, "ERROR: Shared memory %s has an incompatible layout\n", name);
+        gpio_ring_close(ring);
+        return -1;
+    }
+
+    ring->mask = hdr->capacity - 1;
+
+    return 0;
+}
+
+/*
+ * gpio_ring_close
+ *
+ * Unmaps a ring (the shared memory object itself is left in place)
+ */
+void gpio_ring_close(struct gpio_ring *ring)
+{
+    if (ring->hdr != NULL) {
+        munmap(ring->hdr, ring->map_size);
+        ring->hdr = NULL;
+    }
+    if (ring->fd >= 0) {
+        close(ring->fd);
+        ring->fd = -1;
+    }
+}
+
+/*
+ * gpio_ring_publish
+ *
+ * Appends one event. Wait-free; makes a syscall only if a consumer sleeps.
+ * Must only be called from the single producer.
+ */
+void gpio_ring_publish(struct gpio_ring *ring, uint64_t timestamp_ns, int32_t value, uint32_t line)
+{
+    struct gpio_ring_header *hdr = ring->hdr;
+    uint64_t pos = __atomic_load_n(&hdr->head, __ATOMIC_RELAXED);
+    struct gpio_ring_slot *slot = &ring->slots[pos & ring->mask];
+
+    __atomic_store_n(&slot->seq, 2 * pos + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    __atomic_store_n(&slot->timestamp_ns, timestamp_ns, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->value, value, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->line, line, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&slot->seq, 2 * pos + 2, __ATOMIC_RELEASE);
+    __atomic_store_n(&hdr->head, pos + 1, __ATOMIC_RELEASE);
+
+    __atomic_add_fetch(&hdr->futex_word, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&hdr->waiters, __ATOMIC_SEQ_CST) != 0) {
+        gpio_ring_futex(&hdr->futex_word, FUTEX_WAKE, INT_MAX, NULL);
+    }
+}
+
+/*
+ * gpio_ring_cursor_init
+ *
+ * Positions a new consumer at the current head (only new events are seen)
+ */
+void gpio_ring_cursor_init(struct gpio_ring *ring, struct gpio_ring_cursor *cursor)
+{
+    cursor->position = __atomic_load_n(&ring->hdr->head, __ATOMIC_ACQUIRE);
+    cursor->lost = 0;
+}
+
+/*
+ * gpio_ring_try_read
+ *
+ * Copies the event at the cursor if one is available
+ *
+ * Returns: 1 if an event was read, 0 if the consumer has caught up
+ */
+static int gpio_ring_try_read(struct gpio_ring *ring, struct gpio_ring_cursor *cursor,
+                              struct gpio_ring_event *event)
+{
+    struct gpio_ring_header *hdr = ring->hdr;
+    uint64_t capacity = ring->mask + 1;
+    struct gpio_ring_slot *slot;
+    uint64_t lost = 0;
+    uint64_t head;
+    uint64_t seq;
+
+    for (;;) {
+        head = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+        if (head - cursor->position > capacity) {
+            /* Producer lapped us: skip to the oldest event still in the ring */
+            lost += head - capacity - cursor->position;
+            cursor->position = head - capacity;
+        }
+
+        if (cursor->position == head) {
+            cursor->lost += lost;
+            return 0;
+        }
+
+        slot = &ring->slots[cursor->position & ring->mask];
+
+        seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        if (seq == 2 * cursor->position + 2) {
+            event->timestamp_ns = __atomic_load_n(&slot->timestamp_ns, __ATOMIC_RELAXED);
+            event->value = __atomic_load_n(&slot->value, __ATOMIC_RELAXED);
+            event->line = __atomic_load_n(&slot->line, __ATOMIC_RELAXED);
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+            if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq) {
+                cursor->position++;
+                cursor->lost += lost;
+                event->lost = lost;
+                return 1;
+            }
+        }
+
+        /* Slot reused while we looked at it: count it lost and re-sync */
+        lost++;
+        cursor->position++;
+    }
+}
+
+/*
+ * gpio_ring_read
+ *
+ * Returns the next event for this consumer, sleeping on the ring's futex
+ * when none is pending
+ *
+ * Parameters:
+ *   ring       - Attached ring
+ *   cursor     - Consumer cursor
+ *   event      - Filled with the event; event->lost reports overruns
+ *   timeout_ms - Maximum wait, negative to wait forever
+ *
+ * Returns: 1 on event, 0 on timeout, -1 on error (errno set, EINTR on signal)
+ */
+int gpio_ring_read(struct gpio_ring *ring, struct gpio_ring_cursor *cursor,
+                   struct gpio_ring_event *event, int timeout_ms)
+{
+    struct gpio_ring_header *hdr = ring->hdr;
+    struct timespec deadline;
+    struct timespec now;
+    struct timespec rel;
+    uint32_t word;
+    long ret;
+
+    if (timeout_ms >= 0) {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_nsec -= 1000000000L;
+            deadline.tv_sec++;
+        }
+    }
+
+    for (;;) {
+        word = __atomic_load_n(&hdr->futex_word, __ATOMIC_SEQ_CST);
+
+        if (gpio_ring_try_read(ring, cursor, event)) {
+            return 1;
+        }
+
+        if (timeout_ms >= 0) {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            rel.tv_sec = deadline.tv_sec - now.tv_sec;
+            rel.tv_nsec = deadline.tv_nsec - now.tv_nsec;
+            if (rel.tv_nsec < 0) {
+                rel.tv_nsec += 1000000000L;
+                rel.tv_sec--;
+            }
+            if (rel.tv_sec < 0) {
+                return 0;
+            }
+        }
+
+        __atomic_add_fetch(&hdr->waiters, 1, __ATOMIC_SEQ_CST);
+        /* A publish after the load of word changes it and FUTEX_WAIT returns */
+        ret = gpio_ring_futex(&hdr->futex_word, FUTEX_WAIT, word,
+                              timeout_ms >= 0 ? &rel : NULL);
+        __atomic_sub_fetch(&hdr->waiters, 1, __ATOMIC_SEQ_CST);
+
+        if (ret < 0 && errno != EAGAIN && errno != ETIMEDOUT) {
+            return -1;
+        }
+    }
+}
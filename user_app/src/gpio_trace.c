@@ -0,0 +1,298 @@
+/*
+ * GPIO Library Call Tracing
+ *
+ * Per-thread latency histograms and USDT probes for the calls of
+ * gpio_control.c; see gpio_trace.h. Compiled to two stubs unless
+ * GPIO_TRACE is defined.
+ *
+ * License: GPL v2
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+
+#include "gpio_trace.h"
+
+#ifndef GPIO_TRACE
+
+int gpio_trace_dump(int fd)
+{
+    (void)fd;
+    return -1;
+}
+
+int gpio_trace_dump_on_signal(int sig)
+{
+    (void)sig;
+    return -1;
+}
+
+#else
+
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define GPIO_TRACE_USDT     1
+#endif
+#endif
+
+#ifdef GPIO_TRACE_USDT
+#define GPIO_PROBE_ENTRY(call)              DTRACE_PROBE1(gpio, call_entry, call)
+#define GPIO_PROBE_RETURN(call, total, sys) DTRACE_PROBE3(gpio, call_return, call, total, sys)
+#else
+#define GPIO_PROBE_ENTRY(call)              do { } while (0)
+#define GPIO_PROBE_RETURN(call, total, sys) do { } while (0)
+#endif
+
+static const char *const gpio_trace_names[GPIO_TRACE_CALLS] = {
+    "gpio_open_line", "gpio_close_device", "gpio_read_value", "gpio_write_value",
+    "gpio_set_direction", "gpio_get_direction", "gpio_get_state", "gpio_counter_enable",
+    "gpio_counter_read", "gpio_map_state", "gpio_unmap_state", "gpio_run_ops",
+    "gpio_set_read_mode", "gpio_set_line_mask", "gpio_set_read_timeout", "gpio_set_wakeup",
+    "gpio_set_edges", "gpio_read_events", "gpio_get_event_stats", "gpio_get_cpu_stats",
+    "gpio_set_reflex", "gpio_get_reflex", "gpio_set_gesture", "gpio_get_gesture",
+    "gpio_set_filter", "gpio_set_eventfd", "gpio_schedule", "gpio_get_timed",
+};
+
+/* Histograms of one thread; written by it alone, read by dumps */
+struct gpio_trace_thread {
+    struct gpio_trace_thread *next;
+    long tid;
+    uint64_t total[GPIO_TRACE_CALLS][GPIO_TRACE_BUCKETS];
+    uint64_t syscall[GPIO_TRACE_CALLS][GPIO_TRACE_BUCKETS];
+};
+
+/* Every thread that ever made a call; threads are never unlinked */
+static struct gpio_trace_thread *gpio_trace_threads;
+static __thread struct gpio_trace_thread *gpio_trace_self;
+
+uint64_t gpio_trace_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static struct gpio_trace_thread *gpio_trace_thread(void)
+{
+    struct gpio_trace_thread *self = gpio_trace_self;
+
+    if (self == NULL) {
+        self = calloc(1, sizeof(*self));
+        if (self == NULL) {
+            return NULL;
+        }
+        self->tid = (long)syscall(SYS_gettid);
+
+        /* Lock-free push; dumps walk the list from any thread */
+        self->next = __atomic_load_n(&gpio_trace_threads, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&gpio_trace_threads, &self->next, self, 1,
+                                            __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        }
+        gpio_trace_self = self;
+    }
+
+    return self;
+}
+
+static unsigned int gpio_trace_bucket(uint64_t ns)
+{
+    unsigned int b = (ns != 0) ? 63 - (unsigned int)__builtin_clzll(ns) : 0;
+
+    return (b < GPIO_TRACE_BUCKETS) ? b : GPIO_TRACE_BUCKETS - 1;
+}
+
+/* Single writer: a plain increment published with a relaxed store */
+static void gpio_trace_count(uint64_t *counter)
+{
+    __atomic_store_n(counter, *counter + 1, __ATOMIC_RELAXED);
+}
+
+struct gpio_trace_scope gpio_trace_enter(enum gpio_trace_call call)
+{
+    struct gpio_trace_scope scope;
+
+    GPIO_PROBE_ENTRY(call);
+    scope.call = call;
+    scope.syscall_ns = 0;
+    scope.start_ns = gpio_trace_now();
+    return scope;
+}
+
+void gpio_trace_exit(struct gpio_trace_scope *scope)
+{
+    struct gpio_trace_thread *self;
+    uint64_t total = gpio_trace_now() - scope->start_ns;
+
+    GPIO_PROBE_RETURN(scope->call, total, scope->syscall_ns);
+
+    self = gpio_trace_thread();
+    if (self != NULL) {
+        gpio_trace_count(&self->total[scope->call][gpio_trace_bucket(total)]);
+        gpio_trace_count(&self->syscall[scope->call][gpio_trace_bucket(scope->syscall_ns)]);
+    }
+}
+
+/*
+ * Dump output is built with these instead of stdio, which is not
+ * async-signal-safe
+ */
+struct gpio_trace_out {
+    int fd;
+    size_t used;
+    char buf[512];
+};
+
+static void gpio_trace_flush(struct gpio_trace_out *out)
+{
+    ssize_t n;
+    size_t done = 0;
+
+    while (done < out->used) {
+        n = write(out->fd, out->buf + done, out->used - done);
+        if (n <= 0) {
+            break;
+        }
+        done += (size_t)n;
+    }
+    out->used = 0;
+}
+
+static void gpio_trace_puts(struct gpio_trace_out *out, const char *s)
+{
+    while (*s != '\0') {
+        if (out->used == sizeof(out->buf)) {
+            gpio_trace_flush(out);
+        }
+        out->buf[out->used++] = *s++;
+    }
+}
+
+/* Right-aligned in width columns */
+static void gpio_trace_putu(struct gpio_trace_out *out, uint64_t value, int width)
+{
+    char digits[24];
+    int n = 0;
+
+    do {
+        digits[n++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+
+    while (width-- > n) {
+        gpio_trace_puts(out, " ");
+    }
+    while (n > 0) {
+        char c[2] = { digits[--n], '\0' };
+
+        gpio_trace_puts(out, c);
+    }
+}
+
+/* Upper bound in ns of the bucket holding the given fraction of calls */
+static uint64_t gpio_trace_percentile(const uint64_t *hist, uint64_t count, uint64_t permille)
+{
+    uint64_t rank = (count * permille + 999) / 1000;
+    uint64_t seen = 0;
+    unsigned int b;
+
+    /* Counts move while we read; the last bucket catches any shortfall */
+    for (b = 0; b < GPIO_TRACE_BUCKETS - 1; b++) {
+        seen += __atomic_load_n(&hist[b], __ATOMIC_RELAXED);
+        if (seen >= rank) {
+            break;
+        }
+    }
+
+    return 1ULL << (b + 1);
+}
+
+/*
+ * gpio_trace_dump
+ *
+ * Writes, per thread and call, the call count and p50/p99/max of the
+ * total and the system-call time (bucket upper bounds, ns)
+ *
+ * Parameters:
+ *   fd - Where to write, e.g. STDERR_FILENO
+ *
+ * Returns: 0 (-1 when built without GPIO_TRACE)
+ */
+int gpio_trace_dump(int fd)
+{
+    struct gpio_trace_thread *thread;
+    struct gpio_trace_out out;
+    uint64_t count;
+    unsigned int call;
+    unsigned int b;
+
+    out.fd = fd;
+    out.used = 0;
+
+    for (thread = __atomic_load_n(&gpio_trace_threads, __ATOMIC_ACQUIRE); thread != NULL;
+         thread = thread->next) {
+        gpio_trace_puts(&out, "gpio trace: thread ");
+        gpio_trace_putu(&out, (uint64_t)thread->tid, 0);
+        gpio_trace_puts(&out, "\n  call                     count   p50 ns   p99 ns   max ns"
+                              " | syscall p50      p99      max\n");
+
+        for (call = 0; call < GPIO_TRACE_CALLS; call++) {
+            count = 0;
+            for (b = 0; b < GPIO_TRACE_BUCKETS; b++) {
+                count += __atomic_load_n(&thread->total[call][b], __ATOMIC_RELAXED);
+            }
+            if (count == 0) {
+                continue;
+            }
+
+            gpio_trace_puts(&out, "  ");
+            gpio_trace_puts(&out, gpio_trace_names[call]);
+            gpio_trace_putu(&out, count, 30 - (int)strlen(gpio_trace_names[call]));
+            gpio_trace_putu(&out, gpio_trace_percentile(thread->total[call], count, 500), 9);
+            gpio_trace_putu(&out, gpio_trace_percentile(thread->total[call], count, 990), 9);
+            gpio_trace_putu(&out, gpio_trace_percentile(thread->total[call], count, 1000), 9);
+            gpio_trace_puts(&out, " |");
+            gpio_trace_putu(&out, gpio_trace_percentile(thread->syscall[call], count, 500), 12);
+            gpio_trace_putu(&out, gpio_trace_percentile(thread->syscall[call], count, 990), 9);
+            gpio_trace_putu(&out, gpio_trace_percentile(thread->syscall[call], count, 1000), 9);
+            gpio_trace_puts(&out, "\n");
+        }
+    }
+
+    gpio_trace_flush(&out);
+    return 0;
+}
+
+static void gpio_trace_signal(int sig)
+{
+    (void)sig;
+    gpio_trace_dump(STDERR_FILENO);
+}
+
+/*
+ * gpio_trace_dump_on_signal
+ *
+ * Dumps the histograms to stderr whenever sig (e.g. SIGUSR1) arrives
+ *
+ * Returns: 0 on success, -1 on failure or without GPIO_TRACE
+ */
+int gpio_trace_dump_on_signal(int sig)
+{
+    struct sigaction sa;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = gpio_trace_signal;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+
+    return (sigaction(sig, &sa, NULL) == 0) ? 0 : -1;
+}
+
+#endif /* GPIO_TRACE */
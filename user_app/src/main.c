@@ -4,24 +4,65 @@
  * Demonstrates GPIO control from user space using the GPIO device driver
  * Supports LED control, button monitoring, and buzzer control
  * 
- * Compile: gcc -Wall -O2 -I./include -o gpio_app src/main.c src/gpio_control.c
+ * Compile: gcc -Wall -O2 -I./include -o gpio_app src/main.c src/gpio_control.c src/gpio_rt.c
  * Usage: ./gpio_app [options]
  * 
  * License: GPL v2
  */
 
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <signal.h>
 #include <time.h>
+#include <errno.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
 
 #include "gpio_control.h"
+#include "gpio_rt.h"
+#include "gpio_daemon.h"
+#include "gpio_shm_ring.h"
+#include "gpio_edgelog.h"
+#include "gpio_bitmap.h"
+#include "gpio_trace.h"
+
+/* Timing periods */
+#define BLINK_HALF_PERIOD_NS    1000000000LL   /* 1s on, 1s off */
+#define MAX_CPU_STATS           256            /* CPUs shown by the events command */
+#define EVENT_WAIT_MS           1000           /* Blocking read timeout, bounds Ctrl+C latency */
+#define COUNTER_REPORT_NS       1000000000LL   /* Counter readout interval */
+
+/* Pipe between the device and the archive file; 32768 events */
+#define ARCHIVE_PIPE_BYTES      (1024 * 1024)
+
+/* Replay streams the log through this much prefetched file data */
+#define REPLAY_READAHEAD_BYTES  (1024 * 1024)
 
 /* Global flag for signal handling */
 static int keep_running = 1;
 
+/* Real-time mode settings and wakeup jitter statistics */
+static struct gpio_rt_config rt_config = { 0, GPIO_RT_DEFAULT_PRIORITY, -1 };
+static struct gpio_rt_stats rt_stats;
+
+/* Device line to open (--line) */
+static int gpio_line = 0;
+
+/* Names of reflex actions and edges (index = value) */
+static const char *const reflex_actions[] = { "none", "set", "clear", "toggle", "pulse" };
+static const char *const reflex_edges[] = { "none", "rising", "falling", "both" };
+
+/* Shared-memory event ring that monitor publishes into (--shm) */
+static const char *shm_name = NULL;
+static struct gpio_ring shm_ring = { -1, 0, NULL, NULL, 0 };
+
 /* Signal handler for graceful shutdown */
 static void signal_handler(int sig)
 {
@@ -29,142 +70,1233 @@ static void signal_handler(int sig)
     keep_running = 0;
 }
 
+/*
+ * Sleep until deadline, resuming after signals that do not stop the run
+ * (clock_nanosleep with TIMER_ABSTIME is never restarted, even with
+ * SA_RESTART, so e.g. a SIGUSR1 trace dump would otherwise cut it short)
+ */
+static int sleep_until(const struct timespec *deadline, struct gpio_rt_stats *stats)
+{
+    while (gpio_rt_sleep_until(deadline, stats) != 0) {
+        if (errno != EINTR || !keep_running) {
+            return -1;
+        }
+    }
+    
+    return 0;
+}
+
 /*
  * Display help message
  */
 void print_help(const char *program_name)
 {
     printf("GPIO Device Driver User Application\n");
-    printf("Usage: %s [COMMAND] [OPTION]\n\n", program_name);
+    printf("Usage: %s [OPTIONS] [COMMAND] [OPTION]\n\n", program_name);
+    printf("Options:\n");
+    printf("  --rt[=PRIO]     Real-time mode: mlockall, SCHED_FIFO PRIO (default %d),\n",
+           GPIO_RT_DEFAULT_PRIORITY);
+    printf("                  jitter histogram at exit (monitor: edge to wakeup)\n");
+    printf("  --cpu=N         Pin to CPU N (with --rt)\n");
+    printf("  --line=N        Use /dev/gpio_devN instead of /dev/gpio_dev\n");
+    printf("  --shm[=NAME]    Publish monitor edges to a shared-memory ring\n");
+    printf("                  (default %s)\n\n", GPIO_RING_DEFAULT_NAME);
     printf("Commands:\n");
     printf("  read            Read GPIO value once\n");
     printf("  write VALUE     Write VALUE to GPIO (0=Low, 1=High)\n");
     printf("  blink [COUNT]   Blink LED (default 10 times)\n");
     printf("  monitor [TIME]  Monitor GPIO for TIME seconds (default 10)\n");
+    printf("  events [TIME] [MASK] [BATCH[:LATENCY_US]] [FILTER]\n");
+    printf("                  Stream IRQ edge events (MASK = line bitmask, default own line;\n");
+    printf("                  BATCH = wake once per BATCH events, at most LATENCY_US late;\n");
+    printf("                  FILTER = in-driver filter terms, e.g. falling,min=500,every=10)\n");
+    printf("  counter [TIME]  Count edges in the driver, print frequency/duty each second\n");
+    printf("  ops [atomic] STEP...\n");
+    printf("                  Run steps in one ioctl: set=N get toggle delay=NS wait=L[,NS]\n");
+    printf("  reflex [TARGET ACTION [EDGE [PULSE_US]]] | reflex off\n");
+    printf("                  Show/set an in-driver reaction on line TARGET\n");
+    printf("                  (ACTION set|clear|toggle|pulse, EDGE rising|falling|both)\n");
+    printf("  gesture [LONG_MS [REPEAT_MS [DOUBLE_MS [low]]]] | gesture off\n");
+    printf("                  Show/set button gestures; events then reports\n");
+    printf("                  press/release/long/repeat/double instead of edges\n");
+    printf("  notify [TIME] [EDGE]\n");
+    printf("                  Count rising|falling|both edges through an eventfd\n");
+    printf("  schedule AT STEP_US VALUE...\n");
+    printf("                  Drive VALUEs at AT (CLOCK_MONOTONIC ns, or +MS from now),\n");
+    printf("                  STEP_US apart, from a driver timer; print firing times\n");
     printf("  setdir DIR      Set GPIO direction (0=input, 1=output)\n");
     printf("  getdir          Get GPIO current direction\n");
     printf("  status          Show GPIO status\n");
     printf("  interactive     Interactive mode (menu-driven)\n");
+    printf("  daemon [SOCKET] Serve clients over a Unix socket (default %s)\n",
+           GPIOD_SOCKET_PATH);
+    printf("  remote SOCKET CMD [ARG]\n");
+    printf("                  Send read/write/setdir/getdir/subscribe to a daemon\n");
+    printf("  record FILE [TIME]\n");
+    printf("                  Record edges to a binary edge log (default 10 s, 0 = forever)\n");
+    printf("  dump FILE [FROM [TO]]\n");
+    printf("                  Print a recorded edge log (seconds from its start)\n");
+    printf("  replay FILE [FROM [TO]]\n");
+    printf("                  Play a recorded edge log onto the GPIO with original timing\n");
+    printf("  archive FILE [TIME] [MASK] [BATCH[:LATENCY_US]]\n");
+    printf("                  Splice raw edge events to FILE without copying them\n");
+    printf("                  through user space (0 = until Ctrl+C)\n");
+    printf("  capture FILE [SAMPLES] [MASK]\n");
+    printf("                  Capture lines (bitmask, default own line) as packed bitmaps\n");
+    printf("  decode FILE [LINE [KERNEL]]\n");
+    printf("                  Pulse statistics of a capture; edges of LINE (-1 = none);\n");
+    printf("                  KERNEL avx2|sse2|neon|scalar (default fastest)\n");
+    printf("  shm-monitor [NAME] [TIME]\n");
+    printf("                  Consume edges from a shared-memory ring\n");
     printf("  help            Display this help message\n");
     printf("\nExamples:\n");
     printf("  %s read\n", program_name);
     printf("  %s write 1\n", program_name);
     printf("  %s blink 5\n", program_name);
     printf("  %s monitor 20\n", program_name);
+    printf("  %s --rt=90 --cpu=1 blink 100\n", program_name);
+    printf("  %s remote %s write 1\n", program_name, GPIOD_SOCKET_PATH);
+    printf("  %s --line=2 reflex 0 toggle falling\n", program_name);
+    printf("  %s --line=2 gesture 800 200 300 low\n", program_name);
     printf("  %s interactive\n", program_name);
 }
 
 /*
- * Read GPIO value once
+ * Read GPIO value once
+ */
+int cmd_read_value(int fd)
+{
+    uint8_t value = 0;
+    int ret;
+    
+    printf("Reading GPIO value...\n");
+    ret = gpio_read_value(fd, &value);
+    
+    if (ret == 0) {
+        printf("GPIO Value: %s\n", value ? "HIGH (1)" : "LOW (0)");
+        return 0;
+    }
+    
+    return -1;
+}
+
+/*
+ * Write GPIO value
+ */
+int cmd_write_value(int fd, int value)
+{
+    printf("Writing GPIO value: %d\n", value);
+    
+    if (gpio_set_direction(fd, 1) != 0) {  /* Set to output */
+        fprintf(stderr, "ERROR: Failed to set GPIO direction to output\n");
+        return -1;
+    }
+    
+    return gpio_write_value(fd, (uint8_t)value);
+}
+
+/*
+ * Blink LED (toggle GPIO on and off)
+ */
+int cmd_blink_led(int fd, int count)
+{
+    struct timespec deadline;
+    int i;
+    
+    printf("Blinking LED %d times...\n", count);
+    
+    if (gpio_set_direction(fd, 1) != 0) {  /* Set to output */
+        fprintf(stderr, "ERROR: Failed to set GPIO direction to output\n");
+        return -1;
+    }
+    
+    /* Absolute deadlines: a late wakeup does not shift later edges */
+    gpio_rt_deadline_init(&deadline);
+    
+    for (i = 0; i < count && keep_running; i++) {
+        printf("Blink %d: ON\n", i + 1);
+        if (gpio_write_value(fd, 1) != 0) {
+            return -1;
+        }
+        
+        gpio_rt_deadline_add(&deadline, BLINK_HALF_PERIOD_NS);
+        if (sleep_until(&deadline, &rt_stats) != 0 || !keep_running) break;
+        
+        printf("Blink %d: OFF\n", i + 1);
+        if (gpio_write_value(fd, 0) != 0) {
+            return -1;
+        }
+        
+        gpio_rt_deadline_add(&deadline, BLINK_HALF_PERIOD_NS);
+        if (sleep_until(&deadline, &rt_stats) != 0) break;
+    }
+    
+    printf("LED blinking complete\n");
+    return 0;
+}
+
+/*
+ * Record one observed level change to the shared ring and the edge log
+ */
+static int publish_edge(struct gpio_edgelog_writer *log, uint64_t timestamp_ns, int value)
+{
+    printf("GPIO value changed: %s\n", value ? "HIGH (1)" : "LOW (0)");
+    if (shm_ring.hdr != NULL) {
+        gpio_ring_publish(&shm_ring, timestamp_ns, value, 0);
+    }
+    if (log != NULL && gpio_edgelog_append(log, timestamp_ns, value) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Watch the GPIO for level changes, optionally recording them to an edge log
+ * Sleeps in read() until the driver reports an edge and uses its timestamp;
+ * lines without an interrupt are polled by the driver, not here. The time
+ * from the first edge of a batch to the wakeup goes into rt_stats.
+ */
+static int monitor_edges(int fd, int duration, struct gpio_edgelog_writer *log)
+{
+    struct gpio_event events[64];
+    struct timespec start;
+    struct timespec now;
+    uint8_t value;
+    int n;
+    int i;
+    
+    if (gpio_set_direction(fd, 0) != 0) {  /* Set to input */
+        fprintf(stderr, "ERROR: Failed to set GPIO direction to input\n");
+        return -1;
+    }
+    
+    if (gpio_set_edges(fd, GPIO_EDGE_BOTH) != 0 ||
+        gpio_set_read_timeout(fd, EVENT_WAIT_MS) != 0) {
+        return -1;
+    }
+    
+    /* Initial level, then switch the file over to edge events */
+    if (gpio_read_value(fd, &value) != 0) {
+        return -1;
+    }
+    
+    if (gpio_set_read_mode(fd, GPIO_READ_EVENTS) != 0) {
+        return -1;
+    }
+    
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (publish_edge(log, (uint64_t)start.tv_sec * 1000000000ULL + (uint64_t)start.tv_nsec,
+                     value) != 0) {
+        goto fail;
+    }
+    
+    while (keep_running) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (duration > 0 && now.tv_sec - start.tv_sec >= duration) {
+            printf("Monitoring time elapsed\n");
+            break;
+        }
+        
+        n = gpio_read_events(fd, events, 64);
+        if (n < 0) {
+            goto fail;
+        }
+        
+        if (n > 0) {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            gpio_rt_stats_record(&rt_stats,
+                                 (int64_t)((uint64_t)now.tv_sec * 1000000000ULL +
+                                           (uint64_t)now.tv_nsec - events[0].timestamp_ns));
+        }
+        
+        for (i = 0; i < n; i++) {
+            if (publish_edge(log, events[i].timestamp_ns,
+                             events[i].type == GPIO_EVENT_RISING) != 0) {
+                goto fail;
+            }
+        }
+    }
+    
+    gpio_set_read_mode(fd, GPIO_READ_VALUE);
+    return 0;
+    
+fail:
+    gpio_set_read_mode(fd, GPIO_READ_VALUE);
+    return -1;
+}
+
+/*
+ * Monitor GPIO value for changes
+ */
+int cmd_monitor_gpio(int fd, int duration)
+{
+    int ret;
+    
+    printf("Monitoring GPIO for %d seconds (press Ctrl+C to stop)...\n", duration);
+    
+    ret = monitor_edges(fd, duration, NULL);
+    
+    printf("Monitoring stopped\n");
+    return ret;
+}
+
+/*
+ * Count edges in the driver and report frequency and duty cycle once per
+ * second from the shared state page (no per-edge wakeups)
+ */
+int cmd_counter_gpio(int fd, int duration)
+{
+    const struct gpio_shared_state *state;
+    struct gpio_shared_state snap;
+    struct gpio_counter_info info;
+    struct timespec deadline;
+    struct timespec now;
+    uint64_t now_ns;
+    uint64_t prev_edges = 0;
+    long ticks = 0;
+    
+    if (gpio_set_direction(fd, 0) != 0) {  /* Set to input */
+        fprintf(stderr, "ERROR: Failed to set GPIO direction to input\n");
+        return -1;
+    }
+    
+    state = gpio_map_state(fd);
+    if (state == NULL) {
+        return -1;
+    }
+    
+    if (gpio_counter_enable(fd, 1) != 0) {
+        gpio_unmap_state(state);
+        return -1;
+    }
+    
+    printf("Counting edges for %d seconds (press Ctrl+C to stop)...\n", duration);
+    
+    gpio_rt_deadline_init(&deadline);
+    
+    while (keep_running && (duration <= 0 || ticks < duration)) {
+        gpio_rt_deadline_add(&deadline, COUNTER_REPORT_NS);
+        if (sleep_until(&deadline, &rt_stats) != 0) {
+            break;
+        }
+        ticks++;
+        
+        /* Clock after the snapshot, so last_edge_ns <= now_ns */
+        gpio_read_state(state, &snap);
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        now_ns = (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+        
+        /* Same rule as the driver: no edge for two periods means stopped */
+        if (snap.period_ns == 0 || now_ns - snap.last_edge_ns > 2 * snap.period_ns) {
+            printf("edges=%llu (+%llu)  signal stopped\n",
+                   (unsigned long long)snap.edges,
+                   (unsigned long long)(snap.edges - prev_edges));
+        } else {
+            printf("edges=%llu (+%llu)  freq=%.3f Hz  period=%.1f us  duty=%.1f%%\n",
+                   (unsigned long long)snap.edges,
+                   (unsigned long long)(snap.edges - prev_edges),
+                   1e9 / (double)snap.period_ns, snap.period_ns / 1000.0,
+                   100.0 * (double)snap.high_ns / (double)snap.period_ns);
+        }
+        prev_edges = snap.edges;
+    }
+    
+    if (gpio_counter_read(fd, &info) == 0) {
+        printf("Total: %llu rising, %llu falling, %llu.%03llu Hz, duty %u.%u%%\n",
+               (unsigned long long)info.rising, (unsigned long long)info.falling,
+               (unsigned long long)(info.frequency_millihz / 1000),
+               (unsigned long long)(info.frequency_millihz % 1000),
+               info.duty_permille / 10, info.duty_permille % 10);
+    }
+    
+    gpio_counter_enable(fd, 0);
+    gpio_unmap_state(state);
+    
+    printf("Counting stopped\n");
+    return 0;
+}
+
+/*
+ * Run a batched operation list given as command-line steps:
+ *   set=N  get  toggle  delay=NS  wait=LEVEL[,TIMEOUT_NS]
+ */
+int cmd_run_ops(int fd, int argc, char *argv[])
+{
+    static const char *const names[] = { "?", "set", "get", "wait", "delay", "toggle" };
+    struct gpio_op ops[GPIO_OPS_MAX];
+    struct gpio_op_list list;
+    uint32_t flags = 0;
+    uint32_t count = 0;
+    char *comma;
+    int ret;
+    int i;
+    
+    memset(ops, 0, sizeof(ops));
+    memset(&list, 0, sizeof(list));
+    
+    for (i = 0; i < argc; i++) {
+        struct gpio_op *op = &ops[count];
+        
+        if (strcmp(argv[i], "atomic") == 0) {
+            flags |= GPIO_OPS_ATOMIC;
+            continue;
+        }
+        
+        if (count == GPIO_OPS_MAX) {
+            fprintf(stderr, "ERROR: At most %d steps\n", GPIO_OPS_MAX);
+            return -1;
+        }
+        
+        if (strncmp(argv[i], "set=", 4) == 0) {
+            op->code = GPIO_OP_SET;
+            op->arg = atoi(argv[i] + 4);
+        } else if (strcmp(argv[i], "get") == 0) {
+            op->code = GPIO_OP_GET;
+        } else if (strcmp(argv[i], "toggle") == 0) {
+            op->code = GPIO_OP_TOGGLE;
+        } else if (strncmp(argv[i], "delay=", 6) == 0) {
+            op->code = GPIO_OP_DELAY_NS;
+            op->ns = strtoull(argv[i] + 6, NULL, 0);
+        } else if (strncmp(argv[i], "wait=", 5) == 0) {
+            op->code = GPIO_OP_WAIT_LEVEL;
+            op->arg = atoi(argv[i] + 5);
+            comma = strchr(argv[i], ',');
+            op->ns = (comma != NULL) ? strtoull(comma + 1, NULL, 0) : 1000000ULL;
+        } else {
+            fprintf(stderr, "ERROR: Unknown step '%s'\n", argv[i]);
+            return -1;
+        }
+        count++;
+    }
+    
+    if (count == 0) {
+        fprintf(stderr, "ERROR: ops command requires at least one step\n");
+        return -1;
+    }
+    
+    ret = gpio_run_ops(fd, ops, count, flags, &list);
+    
+    for (i = 0; i < (int)list.completed; i++) {
+        printf("  %3d %-6s result=%-3d +%llu ns\n", i, names[ops[i].code], ops[i].result,
+               (unsigned long long)(ops[i].timestamp_ns - ops[0].timestamp_ns));
+    }
+    printf("%u/%u steps in %llu ns%s\n", list.completed, count,
+           (unsigned long long)list.duration_ns, (flags & GPIO_OPS_ATOMIC) ? " (atomic)" : "");
+    
+    return ret;
+}
+
+/*
+ * Look up a name in a reflex name table
+ */
+static int reflex_lookup(const char *const *names, int count, const char *name)
+{
+    int i;
+    
+    for (i = 1; i < count; i++) {
+        if (strcmp(names[i], name) == 0) {
+            return i;
+        }
+    }
+    
+    return -1;
+}
+
+/*
+ * Show or change the reflex rule of the opened line
+ */
+int cmd_reflex(int fd, int argc, char *argv[])
+{
+    struct gpio_reflex rule;
+    
+    memset(&rule, 0, sizeof(rule));
+    
+    if (argc == 0) {
+        if (gpio_get_reflex(fd, &rule) != 0) {
+            return -1;
+        }
+        if (rule.action == GPIO_REFLEX_NONE || rule.action > GPIO_REFLEX_PULSE) {
+            printf("No reflex on line %d\n", gpio_line);
+        } else {
+            printf("Reflex on line %d: %s edge -> %s line %d",
+                   gpio_line, reflex_edges[rule.edge & GPIO_EDGE_BOTH],
+                   reflex_actions[rule.action], rule.target_line);
+            if (rule.action == GPIO_REFLEX_PULSE) {
+                printf(" for %u us", rule.pulse_us);
+            }
+            printf("%s\n", rule.target_line < 0 ? " (target not probed)" : "");
+        }
+        return 0;
+    }
+    
+    if (argc == 1 && strcmp(argv[0], "off") == 0) {
+        rule.action = GPIO_REFLEX_NONE;
+        return gpio_set_reflex(fd, &rule);
+    }
+    
+    if (argc < 2) {
+        fprintf(stderr, "ERROR: reflex requires TARGET and ACTION arguments\n");
+        return -1;
+    }
+    
+    rule.target_line = atoi(argv[0]);
+    rule.action = reflex_lookup(reflex_actions, 5, argv[1]);
+    rule.edge = (argc >= 3) ? reflex_lookup(reflex_edges, 4, argv[2]) : GPIO_EDGE_FALLING;
+    rule.pulse_us = (argc >= 4) ? (uint32_t)atoi(argv[3]) : 1000;
+    
+    if ((int)rule.action < 0 || (int)rule.edge < 0) {
+        fprintf(stderr, "ERROR: Unknown reflex action or edge\n");
+        return -1;
+    }
+    
+    if (gpio_set_reflex(fd, &rule) != 0) {
+        return -1;
+    }
+    
+    printf("SUCCESS: Line %d %s edge now %ss line %d\n", gpio_line,
+           reflex_edges[rule.edge], reflex_actions[rule.action], rule.target_line);
+    return 0;
+}
+
+/*
+ * Show or change the gesture settings of the opened line
+ */
+int cmd_gesture(int fd, int argc, char *argv[])
+{
+    struct gpio_gesture g;
+    
+    memset(&g, 0, sizeof(g));
+    
+    if (argc == 0) {
+        if (gpio_get_gesture(fd, &g) != 0) {
+            return -1;
+        }
+        if (!(g.flags & GPIO_GESTURE_ENABLE)) {
+            printf("No gestures on line %d\n", gpio_line);
+        } else {
+            printf("Gestures on line %d: debounce %u ms, long press %u ms, repeat %u ms, "
+                   "double click %u ms%s\n", gpio_line, g.debounce_ms, g.long_press_ms,
+                   g.repeat_ms, g.double_click_ms,
+                   (g.flags & GPIO_GESTURE_ACTIVE_LOW) ? ", active low" : "");
+        }
+        return 0;
+    }
+    
+    if (argc == 1 && strcmp(argv[0], "off") == 0) {
+        return gpio_set_gesture(fd, &g);
+    }
+    
+    g.flags = GPIO_GESTURE_ENABLE;
+    g.debounce_ms = GPIO_GESTURE_DEBOUNCE_MS;
+    g.long_press_ms = (uint32_t)atoi(argv[0]);
+    g.repeat_ms = (argc >= 2) ? (uint32_t)atoi(argv[1]) : 0;
+    g.double_click_ms = (argc >= 3) ? (uint32_t)atoi(argv[2]) : GPIO_GESTURE_DOUBLE_CLICK_MS;
+    if (argc >= 4 && strcmp(argv[3], "low") == 0) {
+        g.flags |= GPIO_GESTURE_ACTIVE_LOW;
+    }
+    
+    if (gpio_set_direction(fd, GPIO_DIRECTION_INPUT) != 0 || gpio_set_gesture(fd, &g) != 0) {
+        return -1;
+    }
+    
+    printf("SUCCESS: Line %d now reports gestures (read them with 'events')\n", gpio_line);
+    return 0;
+}
+
+/*
+ * Count edges through an eventfd the driver signals; a single read
+ * returns every edge since the previous one
+ */
+int cmd_notify(int fd, int duration, const char *edge)
+{
+    struct pollfd pfd;
+    struct timespec start;
+    struct timespec now;
+    uint64_t edges;
+    uint64_t total = 0;
+    int efd;
+    int e;
+    
+    e = (edge != NULL) ? reflex_lookup(reflex_edges, 4, edge) : GPIO_EDGE_BOTH;
+    if (e < 0) {
+        fprintf(stderr, "ERROR: Unknown edge '%s'\n", edge);
+        return -1;
+    }
+    
+    efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (efd < 0) {
+        fprintf(stderr, "ERROR: Cannot create eventfd: %s\n", strerror(errno));
+        return -1;
+    }
+    
+    if (gpio_set_eventfd(fd, efd, (uint32_t)e) != 0) {
+        close(efd);
+        return -1;
+    }
+    
+    printf("Counting %s edges for %d seconds (press Ctrl+C to stop)...\n",
+           reflex_edges[e], duration);
+    
+    pfd.fd = efd;
+    pfd.events = POLLIN;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    
+    while (keep_running) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (duration > 0 && now.tv_sec - start.tv_sec >= duration) {
+            break;
+        }
+        
+        if (poll(&pfd, 1, EVENT_WAIT_MS) <= 0) {
+            continue;
+        }
+        
+        if (read(efd, &edges, sizeof(edges)) == (ssize_t)sizeof(edges)) {
+            total += edges;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            printf("[%ld.%09ld] %llu edge(s), %llu total\n", (long)now.tv_sec, now.tv_nsec,
+                   (unsigned long long)edges, (unsigned long long)total);
+        }
+    }
+    
+    /* Closing the device would drop it as well */
+    gpio_set_eventfd(fd, -1, (uint32_t)e);
+    close(efd);
+    return 0;
+}
+
+/*
+ * Stream edge events recorded by the driver's IRQ handler. Every process
+ * running this gets its own copy of the stream.
+ */
+int cmd_events(int fd, int duration, uint32_t mask, const char *batch, const char *filter)
+{
+    static struct gpio_cpu_stats cpu_stats[MAX_CPU_STATS];
+    struct sock_filter prog[GPIO_FILTER_MAX_INSNS];
+    int count;
+    int ncpus;
+    unsigned long watermark;
+    unsigned long latency_us = 0;
+    char *end;
+    struct gpio_event events[64];
+    struct gpio_event_stats stats;
+    struct timespec start;
+    struct timespec now;
+    int n;
+    int i;
+    
+    if (gpio_set_read_mode(fd, GPIO_READ_EVENTS) != 0) {
+        return -1;
+    }
+    
+    if (mask != 0 && gpio_set_line_mask(fd, mask) != 0) {
+        return -1;
+    }
+    
+    /* Block in read(), waking at least once a second to check the clock */
+    if (gpio_set_read_timeout(fd, EVENT_WAIT_MS) != 0) {
+        return -1;
+    }
+    
+    if (batch != NULL) {
+        watermark = strtoul(batch, &end, 0);
+        if (*end == ':') {
+            latency_us = strtoul(end + 1, &end, 0);
+        }
+        if (*end != '\0' || gpio_set_wakeup(fd, watermark, latency_us) != 0) {
+            fprintf(stderr, "ERROR: Invalid batch '%s' (BATCH[:LATENCY_US])\n", batch);
+            return -1;
+        }
+    }
+    
+    /* Unwanted events are dropped in the driver, before they can wake us */
+    if (filter != NULL) {
+        count = gpio_filter_compile(filter, prog, GPIO_FILTER_MAX_INSNS);
+        if (count < 0) {
+            fprintf(stderr, "ERROR: Invalid filter '%s'\n", filter);
+            return -1;
+        }
+        if (gpio_set_filter(fd, prog, (uint32_t)count) != 0) {
+            return -1;
+        }
+    }
+    
+    printf("Reading edge events for %d seconds (press Ctrl+C to stop)...\n", duration);
+    
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    
+    while (keep_running) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (duration > 0 && now.tv_sec - start.tv_sec >= duration) {
+            break;
+        }
+        
+        n = gpio_read_events(fd, events, 64);
+        if (n < 0) {
+            return -1;
+        }
+        
+        for (i = 0; i < n; i++) {
+            if (events[i].lost != 0) {
+                printf("  ... %u events lost (reader too slow)\n", events[i].lost);
+            }
+            printf("[%llu.%09llu] line %u %-7s +%llu us (cpu %u, #%u)\n",
+                   (unsigned long long)(events[i].timestamp_ns / 1000000000ULL),
+                   (unsigned long long)(events[i].timestamp_ns % 1000000000ULL),
+                   events[i].line, gpio_event_name(events[i].type),
+                   (unsigned long long)(events[i].duration_ns / 1000),
+                   events[i].cpu, events[i].seqno);
+        }
+    }
+    
+    if (gpio_get_event_stats(fd, &stats) == 0) {
+        printf("Delivered %llu events, %llu lost to overruns\n",
+               (unsigned long long)stats.delivered, (unsigned long long)stats.overruns);
+    }
+    
+    /* Per-CPU split, only CPUs whose IRQs recorded anything */
+    ncpus = gpio_get_cpu_stats(fd, cpu_stats, MAX_CPU_STATS);
+    for (i = 0; i < ncpus && i < MAX_CPU_STATS; i++) {
+        if (cpu_stats[i].recorded != 0) {
+            printf("  cpu %u: %llu recorded, %llu dropped\n", cpu_stats[i].cpu,
+                   (unsigned long long)cpu_stats[i].recorded,
+                   (unsigned long long)cpu_stats[i].dropped);
+        }
+    }
+    
+    gpio_set_read_mode(fd, GPIO_READ_VALUE);
+    return 0;
+}
+
+/*
+ * Queue level changes at absolute CLOCK_MONOTONIC times and report when
+ * the driver applied them. Processes given the same absolute AT drive
+ * their lines together, each within the hrtimer latency.
+ */
+int cmd_schedule(int fd, const char *at, unsigned long step_us, int count, char *values[])
+{
+    struct gpio_timed changes[GPIO_TIMED_MAX];
+    struct timespec now;
+    uint64_t start_ns;
+    int64_t late;
+    int i;
+    
+    if (count <= 0 || count > GPIO_TIMED_MAX) {
+        fprintf(stderr, "ERROR: Give 1 to %d values\n", GPIO_TIMED_MAX);
+        return -1;
+    }
+    
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (at[0] == '+') {
+        start_ns = (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec +
+                   strtoull(at + 1, NULL, 0) * 1000000ULL;
+    } else {
+        start_ns = strtoull(at, NULL, 0);
+    }
+    
+    memset(changes, 0, sizeof(changes));
+    for (i = 0; i < count; i++) {
+        changes[i].at_ns = start_ns + (uint64_t)i * step_us * 1000ULL;
+        changes[i].value = atoi(values[i]) ? 1 : 0;
+    }
+    
+    printf("Scheduling %d change(s) from %llu ns, %lu us apart...\n", count,
+           (unsigned long long)start_ns, step_us);
+    
+    if (gpio_schedule(fd, changes, (uint32_t)count, GPIO_TIMED_WAIT) != 0) {
+        if (errno != EINTR) {
+            return -1;
+        }
+        /* Interrupted: the changes still fire, report what we know so far */
+        if (gpio_get_timed(fd, changes, (uint32_t)count) != 0) {
+            return -1;
+        }
+    }
+    
+    for (i = 0; i < count; i++) {
+        if (changes[i].result != 0) {
+            printf("  #%llu value %d at %llu: %s\n", (unsigned long long)changes[i].id,
+                   changes[i].value, (unsigned long long)changes[i].at_ns,
+                   strerror(-changes[i].result));
+            continue;
+        }
+        late = (int64_t)(changes[i].fired_ns - changes[i].at_ns);
+        printf("  #%llu value %d at %llu: fired %llu (%+lld ns)\n",
+               (unsigned long long)changes[i].id, changes[i].value,
+               (unsigned long long)changes[i].at_ns, (unsigned long long)changes[i].fired_ns,
+               (long long)late);
+    }
+    
+    return 0;
+}
+
+/*
+ * Archive raw struct gpio_event records to a file. Events are spliced
+ * from the device into a pipe and from the pipe into the file, so they
+ * never pass through a user buffer; with a batch watermark the process
+ * wakes once per batch rather than per event.
+ */
+int cmd_archive_events(int fd, const char *path, int duration, uint32_t mask,
+                       const char *batch)
+{
+    unsigned long watermark;
+    unsigned long latency_us = 0;
+    unsigned long long bytes = 0;
+    struct timespec start;
+    struct timespec now;
+    char *end;
+    ssize_t n;
+    ssize_t m;
+    int pipefd[2];
+    int ret = 0;
+    int out;
+    
+    if (gpio_set_read_mode(fd, GPIO_READ_EVENTS) != 0) {
+        return -1;
+    }
+    
+    if ((mask != 0 && gpio_set_line_mask(fd, mask) != 0) ||
+        gpio_set_read_timeout(fd, EVENT_WAIT_MS) != 0) {
+        gpio_set_read_mode(fd, GPIO_READ_VALUE);
+        return -1;
+    }
+    
+    if (batch != NULL) {
+        watermark = strtoul(batch, &end, 0);
+        if (*end == ':') {
+            latency_us = strtoul(end + 1, &end, 0);
+        }
+        if (*end != '\0' || gpio_set_wakeup(fd, watermark, latency_us) != 0) {
+            fprintf(stderr, "ERROR: Invalid batch '%s' (BATCH[:LATENCY_US])\n", batch);
+            gpio_set_read_mode(fd, GPIO_READ_VALUE);
+            return -1;
+        }
+    }
+    
+    if (pipe2(pipefd, O_CLOEXEC) != 0) {
+        fprintf(stderr, "ERROR: Cannot create pipe: %s\n", strerror(errno));
+        gpio_set_read_mode(fd, GPIO_READ_VALUE);
+        return -1;
+    }
+    
+    /* Best effort: a bigger pipe takes a whole batch in one splice */
+    fcntl(pipefd[1], F_SETPIPE_SZ, ARCHIVE_PIPE_BYTES);
+    
+    out = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out < 0) {
+        fprintf(stderr, "ERROR: Cannot create %s: %s\n", path, strerror(errno));
+        close(pipefd[0]);
+        close(pipefd[1]);
+        gpio_set_read_mode(fd, GPIO_READ_VALUE);
+        return -1;
+    }
+    
+    printf("Archiving edge events to %s for %d seconds (press Ctrl+C to stop)...\n",
+           path, duration);
+    
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    
+    while (keep_running) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (duration > 0 && now.tv_sec - start.tv_sec >= duration) {
+            break;
+        }
+        
+        /* Blocks like read(): until the wakeup condition or the read timeout */
+        n = splice(fd, NULL, pipefd[1], NULL, ARCHIVE_PIPE_BYTES, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (n < 0) {
+            if (errno == ETIMEDOUT || errno == EAGAIN || errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "ERROR: Cannot splice events: %s\n", strerror(errno));
+            ret = -1;
+            break;
+        }
+        
+        while (n > 0) {
+            m = splice(pipefd[0], NULL, out, NULL, (size_t)n, SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (m <= 0) {
+                if (m < 0 && errno == EINTR) {
+                    continue;
+                }
+                fprintf(stderr, "ERROR: Cannot write %s: %s\n", path,
+                        m < 0 ? strerror(errno) : "short write");
+                ret = -1;
+                break;
+            }
+            n -= m;
+            bytes += (unsigned long long)m;
+        }
+        if (ret != 0) {
+            break;
+        }
+    }
+    
+    if (close(out) != 0) {
+        fprintf(stderr, "ERROR: Cannot write %s: %s\n", path, strerror(errno));
+        ret = -1;
+    }
+    close(pipefd[0]);
+    close(pipefd[1]);
+    
+    gpio_set_read_mode(fd, GPIO_READ_VALUE);
+    
+    printf("Archived %llu events (%llu bytes)\n",
+           bytes / sizeof(struct gpio_event), bytes);
+    return ret;
+}
+
+/*
+ * Record GPIO edges to a binary edge log
  */
-int cmd_read_value(int fd)
+int cmd_record_gpio(int fd, const char *path, int duration)
 {
-    uint8_t value = 0;
+    static struct gpio_edgelog_writer log;
     int ret;
     
-    printf("Reading GPIO value...\n");
-    ret = gpio_read_value(fd, &value);
+    if (gpio_edgelog_create(&log, path, 0) != 0) {
+        return -1;
+    }
     
-    if (ret == 0) {
-        printf("GPIO Value: %s\n", value ? "HIGH (1)" : "LOW (0)");
-        return 0;
+    printf("Recording GPIO edges to %s for %d seconds (press Ctrl+C to stop)...\n",
+           path, duration);
+    
+    ret = monitor_edges(fd, duration, &log);
+    
+    if (gpio_edgelog_close(&log) != 0) {
+        ret = -1;
     }
     
-    return -1;
+    printf("Recording stopped (%llu edges)\n", (unsigned long long)log.total_events);
+    return ret;
 }
 
 /*
- * Write GPIO value
+ * Replay a binary edge log onto the GPIO with the recorded timing.
+ * Each edge is applied at an absolute CLOCK_MONOTONIC deadline derived
+ * from its recorded offset; the lateness of every write is collected in
+ * a timing error histogram.
  */
-int cmd_write_value(int fd, int value)
+int cmd_replay_edgelog(int fd, const char *path, double from_s, double to_s)
 {
-    printf("Writing GPIO value: %d\n", value);
+    struct gpio_edgelog_reader reader;
+    struct gpio_edgelog_iter iter;
+    struct gpio_edge edge;
+    struct gpio_rt_stats error_stats;
+    struct timespec start_time;
+    struct timespec deadline;
+    struct timespec now;
+    uint64_t start;
+    uint64_t first_ns;
+    uint64_t until_ns = UINT64_MAX;
+    uint64_t count = 0;
+    int value;
+    int ret = 0;
+    
+    if (gpio_edgelog_open(&reader, path) != 0) {
+        return -1;
+    }
+    
+    start = gpio_edgelog_first_ts(&reader);
+    first_ns = start + (uint64_t)(from_s * 1e9);
+    if (to_s >= 0) {
+        until_ns = start + (uint64_t)(to_s * 1e9);
+    }
     
     if (gpio_set_direction(fd, 1) != 0) {  /* Set to output */
         fprintf(stderr, "ERROR: Failed to set GPIO direction to output\n");
+        gpio_edgelog_release(&reader);
         return -1;
     }
     
-    return gpio_write_value(fd, (uint8_t)value);
+    gpio_edgelog_seek(&reader, &iter, first_ns, until_ns);
+    gpio_edgelog_set_readahead(&iter, REPLAY_READAHEAD_BYTES);
+    gpio_rt_stats_init(&error_stats);
+    
+    printf("Replaying %s (press Ctrl+C to stop)...\n", path);
+    
+    /* Decode one edge ahead so decoding happens while waiting */
+    if (!gpio_edgelog_next(&iter, &edge)) {
+        printf("No edges in range\n");
+        gpio_edgelog_release(&reader);
+        return 0;
+    }
+    
+    first_ns = edge.timestamp_ns;
+    gpio_rt_deadline_init(&start_time);
+    
+    do {
+        deadline = start_time;
+        gpio_rt_deadline_add(&deadline, (int64_t)(edge.timestamp_ns - first_ns));
+        
+        /* Never drive an edge early: signals other than Ctrl+C resume the wait */
+        if (sleep_until(&deadline, NULL) != 0) {
+            if (keep_running) {
+                fprintf(stderr, "ERROR: Cannot sleep until the next edge: %s\n", strerror(errno));
+                ret = -1;
+            }
+            break;
+        }
+        
+        value = edge.value;
+        if (ioctl(fd, GPIO_IOCTL_SET_VALUE, &value) < 0) {
+            fprintf(stderr, "ERROR: Cannot set GPIO value: %s\n", strerror(errno));
+            ret = -1;
+            break;
+        }
+        
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        gpio_rt_stats_record(&error_stats,
+                             (int64_t)(now.tv_sec - deadline.tv_sec) * 1000000000LL +
+                             (now.tv_nsec - deadline.tv_nsec));
+        count++;
+    } while (keep_running && gpio_edgelog_next(&iter, &edge));
+    
+    printf("Replay %s (%llu edges)\n", keep_running ? "complete" : "stopped",
+           (unsigned long long)count);
+    gpio_rt_stats_print(&error_stats, stdout);
+    
+    gpio_edgelog_release(&reader);
+    return ret;
 }
 
 /*
- * Blink LED (toggle GPIO on and off)
+ * Print edges of a binary edge log, optionally limited to a time range
+ * given in seconds from the start of the log (does not open the device)
  */
-int cmd_blink_led(int fd, int count)
+int cmd_dump_edgelog(const char *path, double from_s, double to_s)
 {
-    int i;
+    struct gpio_edgelog_reader reader;
+    struct gpio_edgelog_iter iter;
+    struct gpio_edge edge;
+    uint64_t start;
+    uint64_t from_ns;
+    uint64_t until_ns = UINT64_MAX;
+    uint64_t count = 0;
     
-    printf("Blinking LED %d times...\n", count);
+    if (gpio_edgelog_open(&reader, path) != 0) {
+        return -1;
+    }
     
-    if (gpio_set_direction(fd, 1) != 0) {  /* Set to output */
-        fprintf(stderr, "ERROR: Failed to set GPIO direction to output\n");
+    start = gpio_edgelog_first_ts(&reader);
+    from_ns = start + (uint64_t)(from_s * 1e9);
+    if (to_s >= 0) {
+        until_ns = start + (uint64_t)(to_s * 1e9);
+    }
+    
+    printf("Edge log %s: %zu chunks, %.3f s\n", path, reader.nchunks,
+           (gpio_edgelog_last_ts(&reader) - start) / 1e9);
+    
+    gpio_edgelog_seek(&reader, &iter, from_ns, until_ns);
+    while (keep_running && gpio_edgelog_next(&iter, &edge)) {
+        printf("%14.6f s  %s\n", (edge.timestamp_ns - start) / 1e9,
+               edge.value ? "HIGH (1)" : "LOW (0)");
+        count++;
+    }
+    
+    printf("%llu edges\n", (unsigned long long)count);
+    gpio_edgelog_release(&reader);
+    return 0;
+}
+
+/*
+ * Capture the lines of mask as packed bitmaps (GPIO_READ_BITMAP); one
+ * block per read(), so samples are contiguous within a block only
+ */
+int cmd_capture_bitmap(int fd, const char *path, uint64_t samples, uint32_t mask)
+{
+    static uint8_t block[GPIO_MAX_DEVICES * (GPIO_BITMAP_MAX_SAMPLES / 8)];
+    struct gpio_bitmap_file_header hdr;
+    struct timespec before;
+    struct timespec after;
+    uint64_t read_ns = 0;
+    size_t length;
+    ssize_t n;
+    int ret = 0;
+    int out;
+    
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = GPIO_BITMAP_FILE_MAGIC;
+    hdr.version = GPIO_BITMAP_FILE_VERSION;
+    hdr.header_size = sizeof(hdr);
+    hdr.line_mask = mask;
+    hdr.plane_bytes = GPIO_BITMAP_MAX_SAMPLES / 8;
+    length = (size_t)__builtin_popcount(mask) * hdr.plane_bytes;
+    
+    if (gpio_set_read_mode(fd, GPIO_READ_BITMAP) != 0 || gpio_set_line_mask(fd, mask) != 0) {
         return -1;
     }
     
-    for (i = 0; i < count && keep_running; i++) {
-        printf("Blink %d: ON\n", i + 1);
-        if (gpio_write_value(fd, 1) != 0) {
-            return -1;
+    out = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0 || write(out, &hdr, sizeof(hdr)) != (ssize_t)sizeof(hdr)) {
+        fprintf(stderr, "ERROR: Cannot create %s: %s\n", path, strerror(errno));
+        if (out >= 0) {
+            close(out);
         }
-        
-        sleep(1);
-        
-        if (!keep_running) break;
-        
-        printf("Blink %d: OFF\n", i + 1);
-        if (gpio_write_value(fd, 0) != 0) {
-            return -1;
+        gpio_set_read_mode(fd, GPIO_READ_VALUE);
+        return -1;
+    }
+    
+    printf("Capturing %llu samples of lines 0x%x to %s (press Ctrl+C to stop)...\n",
+           (unsigned long long)samples, mask, path);
+    
+    while (keep_running && hdr.blocks * GPIO_BITMAP_MAX_SAMPLES < samples) {
+        clock_gettime(CLOCK_MONOTONIC, &before);
+        n = read(fd, block, length);
+        clock_gettime(CLOCK_MONOTONIC, &after);
+        if (n != (ssize_t)length) {
+            fprintf(stderr, "ERROR: Bitmap read failed: %s\n",
+                    n < 0 ? strerror(errno) : "short read");
+            ret = -1;
+            break;
         }
+        read_ns += (uint64_t)(after.tv_sec - before.tv_sec) * 1000000000ULL +
+                   (uint64_t)after.tv_nsec - (uint64_t)before.tv_nsec;
         
-        sleep(1);
+        if (write(out, block, length) != (ssize_t)length) {
+            fprintf(stderr, "ERROR: Cannot write %s: %s\n", path, strerror(errno));
+            ret = -1;
+            break;
+        }
+        hdr.blocks++;
     }
     
-    printf("LED blinking complete\n");
-    return 0;
+    if (hdr.blocks != 0) {
+        hdr.sample_ps = read_ns * 1000 / (hdr.blocks * GPIO_BITMAP_MAX_SAMPLES);
+    }
+    if (pwrite(out, &hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr)) {
+        fprintf(stderr, "ERROR: Cannot write %s: %s\n", path, strerror(errno));
+        ret = -1;
+    }
+    close(out);
+    
+    gpio_set_read_mode(fd, GPIO_READ_VALUE);
+    
+    printf("Captured %llu blocks, %.1f ns per sample\n", (unsigned long long)hdr.blocks,
+           hdr.sample_ps / 1000.0);
+    return ret;
 }
 
 /*
- * Monitor GPIO value for changes
+ * Decode a bitmap capture: pulse statistics of every line and, for
+ * show_line >= 0, that line's edges
  */
-int cmd_monitor_gpio(int fd, int duration)
+int cmd_decode_bitmap(const char *path, int show_line, const char *kernel)
 {
-    uint8_t prev_value = 0xFF;  /* Invalid initial value */
-    uint8_t curr_value = 0;
-    time_t start_time, current_time;
-    int ret;
+    static uint64_t edges[GPIO_BITMAP_MAX_SAMPLES];
+    static struct gpio_bitmap_line lines[GPIO_MAX_DEVICES];
+    const struct gpio_bitmap_file_header *hdr;
+    const uint8_t *plane;
+    struct gpio_bitmap_line *line;
+    struct timespec start;
+    struct timespec end;
+    struct stat st;
+    double sample_us;
+    double seconds;
+    uint64_t b;
+    uint64_t base;
+    uint64_t k;
+    size_t n;
+    size_t e;
+    void *map;
+    int minors[GPIO_MAX_DEVICES];
+    int nlines = 0;
+    int fd;
+    int i;
     
-    printf("Monitoring GPIO for %d seconds (press Ctrl+C to stop)...\n", duration);
+    if (kernel != NULL && gpio_bitmap_use(kernel) != 0) {
+        return -1;
+    }
     
-    if (gpio_set_direction(fd, 0) != 0) {  /* Set to input */
-        fprintf(stderr, "ERROR: Failed to set GPIO direction to input\n");
+    fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(*hdr)) {
+        fprintf(stderr, "ERROR: Cannot open %s: %s\n", path, fd < 0 ? strerror(errno) : "too short");
+        if (fd >= 0) {
+            close(fd);
+        }
         return -1;
     }
     
-    time(&start_time);
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "ERROR: Cannot map %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
     
-    while (keep_running) {
-        time(&current_time);
-        
-        if (duration > 0 && (current_time - start_time) >= duration) {
-            printf("Monitoring time elapsed\n");
-            break;
+    hdr = map;
+    for (i = 0; i < GPIO_MAX_DEVICES; i++) {
+        if (hdr->line_mask & (1u << i)) {
+            minors[nlines++] = i;
         }
-        
-        ret = gpio_read_value(fd, &curr_value);
-        if (ret != 0) {
-            return -1;
+    }
+    
+    if (hdr->magic != GPIO_BITMAP_FILE_MAGIC || hdr->version != GPIO_BITMAP_FILE_VERSION ||
+        hdr->plane_bytes == 0 || hdr->plane_bytes > GPIO_BITMAP_MAX_SAMPLES / 8 ||
+        hdr->header_size + hdr->blocks * nlines * hdr->plane_bytes > (uint64_t)st.st_size) {
+        fprintf(stderr, "ERROR: %s is not a complete bitmap capture\n", path);
+        munmap(map, st.st_size);
+        return -1;
+    }
+    
+    sample_us = hdr->sample_ps / 1e6;
+    for (i = 0; i < nlines; i++) {
+        gpio_bitmap_line_init(&lines[i]);
+    }
+    
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    
+    for (b = 0; b < hdr->blocks && keep_running; b++) {
+        for (i = 0; i < nlines; i++) {
+            line = &lines[i];
+            plane = (const uint8_t *)map + hdr->header_size +
+                    (b * nlines + i) * hdr->plane_bytes;
+            base = line->samples;
+            
+            if (minors[i] != show_line) {
+                gpio_bitmap_edges(line, plane, hdr->plane_bytes, NULL, 0);
+                continue;
+            }
+            
+            n = gpio_bitmap_edges(line, plane, hdr->plane_bytes, edges, GPIO_BITMAP_MAX_SAMPLES);
+            for (e = 0; e < n; e++) {
+                k = edges[e] - base;
+                printf("%14.3f us  line %d %s\n", edges[e] * sample_us, minors[i],
+                       ((plane[k / 8] >> (k % 8)) & 1) ? "HIGH (1)" : "LOW (0)");
+            }
         }
-        
-        if (curr_value != prev_value) {
-            printf("GPIO value changed: %s\n", curr_value ? "HIGH (1)" : "LOW (0)");
-            prev_value = curr_value;
+    }
+    
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    
+    for (i = 0; i < nlines; i++) {
+        line = &lines[i];
+        printf("Line %d: %llu samples, %.2f%% high, %llu rising, %llu falling\n", minors[i],
+               (unsigned long long)line->samples,
+               line->samples ? 100.0 * line->high_samples / line->samples : 0.0,
+               (unsigned long long)line->rising, (unsigned long long)line->falling);
+        if (line->high_pulses != 0) {
+            printf("  high pulses: %llu, %.3f / %.3f / %.3f us (min/avg/max)\n",
+                   (unsigned long long)line->high_pulses, line->high_min * sample_us,
+                   (double)line->high_sum / line->high_pulses * sample_us,
+                   line->high_max * sample_us);
+        }
+        if (line->low_pulses != 0) {
+            printf("  low pulses:  %llu, %.3f / %.3f / %.3f us (min/avg/max)\n",
+                   (unsigned long long)line->low_pulses, line->low_min * sample_us,
+                   (double)line->low_sum / line->low_pulses * sample_us,
+                   line->low_max * sample_us);
         }
-        
-        usleep(100000);  /* 100ms polling interval */
     }
     
-    printf("Monitoring stopped\n");
+    printf("Decoded %.1f MB in %.3f s (%.2f GB/s, %s kernel)\n",
+           hdr->blocks * nlines * hdr->plane_bytes / 1e6, seconds,
+           seconds > 0 ? hdr->blocks * nlines * hdr->plane_bytes / seconds / 1e9 : 0.0,
+           gpio_bitmap_kernel());
+    
+    munmap(map, st.st_size);
     return 0;
 }
 
@@ -202,6 +1334,129 @@ int cmd_show_status(int fd)
     return 0;
 }
 
+/*
+ * Run the GPIO daemon
+ */
+int cmd_daemon(int fd, const char *socket_path)
+{
+    return gpiod_serve(fd, socket_path, &keep_running);
+}
+
+/*
+ * Send one request to a running daemon (does not open the device)
+ */
+int cmd_remote(const char *socket_path, const char *command, const char *arg)
+{
+    struct gpiod_msg event;
+    int32_t result = 0;
+    int sock;
+    int ret = 0;
+    
+    sock = gpiod_connect(socket_path);
+    if (sock < 0) {
+        return -1;
+    }
+    
+    if (strcmp(command, "read") == 0) {
+        ret = gpiod_request(sock, GPIOD_OP_READ, 0, &result);
+        if (ret == 0) {
+            printf("GPIO Value: %s\n", result ? "HIGH (1)" : "LOW (0)");
+        }
+    }
+    else if (strcmp(command, "write") == 0 && arg != NULL) {
+        ret = gpiod_request(sock, GPIOD_OP_WRITE, atoi(arg), &result);
+    }
+    else if (strcmp(command, "setdir") == 0 && arg != NULL) {
+        ret = gpiod_request(sock, GPIOD_OP_SET_DIRECTION, atoi(arg), &result);
+    }
+    else if (strcmp(command, "getdir") == 0) {
+        ret = gpiod_request(sock, GPIOD_OP_GET_DIRECTION, 0, &result);
+        if (ret == 0) {
+            printf("Current GPIO direction: %s\n", result ? "OUTPUT" : "INPUT");
+        }
+    }
+    else if (strcmp(command, "subscribe") == 0) {
+        ret = gpiod_request(sock, GPIOD_OP_SUBSCRIBE, 0, &result);
+        while (ret == 0 && keep_running) {
+            if (gpiod_next_event(sock, &event) != 0) {
+                break;
+            }
+            printf("[%llu ns] GPIO value changed: %s\n",
+                   (unsigned long long)event.timestamp_ns,
+                   event.arg ? "HIGH (1)" : "LOW (0)");
+        }
+    }
+    else {
+        fprintf(stderr, "ERROR: Unknown or incomplete remote command: '%s'\n", command);
+        close(sock);
+        return -1;
+    }
+    
+    if (ret != 0) {
+        fprintf(stderr, "ERROR: Remote %s failed: %s\n", command, strerror(errno));
+    }
+    
+    close(sock);
+    return ret;
+}
+
+/*
+ * Consume edge events from a shared-memory ring (does not open the device)
+ */
+int cmd_shm_monitor(const char *name, int duration)
+{
+    struct gpio_ring ring;
+    struct gpio_ring_cursor cursor;
+    struct gpio_ring_event event;
+    struct timespec deadline;
+    struct timespec now;
+    int timeout_ms;
+    int ret;
+    
+    if (gpio_ring_attach(&ring, name) != 0) {
+        return -1;
+    }
+    
+    gpio_ring_cursor_init(&ring, &cursor);
+    gpio_rt_deadline_init(&deadline);
+    gpio_rt_deadline_add(&deadline, (int64_t)duration * 1000000000LL);
+    
+    printf("Consuming events from %s (press Ctrl+C to stop)...\n", name);
+    
+    while (keep_running) {
+        timeout_ms = -1;
+        if (duration > 0) {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            timeout_ms = (int)((deadline.tv_sec - now.tv_sec) * 1000 +
+                               (deadline.tv_nsec - now.tv_nsec) / 1000000);
+            if (timeout_ms <= 0) {
+                printf("Monitoring time elapsed\n");
+                break;
+            }
+        }
+        
+        ret = gpio_ring_read(&ring, &cursor, &event, timeout_ms);
+        if (ret < 0) {
+            break;
+        }
+        if (ret == 0) {
+            continue;
+        }
+        
+        if (event.lost != 0) {
+            printf("WARNING: %llu events lost (consumer overrun)\n",
+                   (unsigned long long)event.lost);
+        }
+        printf("[%llu ns] GPIO value changed: %s\n",
+               (unsigned long long)event.timestamp_ns,
+               event.value ? "HIGH (1)" : "LOW (0)");
+    }
+    
+    printf("Monitoring stopped (%llu events lost)\n", (unsigned long long)cursor.lost);
+    gpio_ring_close(&ring);
+    return 0;
+}
+
 /*
  * Interactive mode menu
  */
@@ -295,32 +1550,111 @@ int interactive_mode(int fd)
  */
 int main(int argc, char *argv[])
 {
+    const char *program_name = argv[0];
+    struct sigaction sa;
     int fd;
     int ret = 0;
+    int argi;
+    
+    /* Parse leading --options; the command then starts at argv[1] */
+    for (argi = 1; argi < argc && strncmp(argv[argi], "--", 2) == 0; argi++) {
+        if (strcmp(argv[argi], "--rt") == 0) {
+            rt_config.enabled = 1;
+        } else if (strncmp(argv[argi], "--rt=", 5) == 0) {
+            rt_config.enabled = 1;
+            rt_config.priority = atoi(argv[argi] + 5);
+        } else if (strncmp(argv[argi], "--cpu=", 6) == 0) {
+            rt_config.cpu = atoi(argv[argi] + 6);
+        } else if (strncmp(argv[argi], "--line=", 7) == 0) {
+            gpio_line = atoi(argv[argi] + 7);
+        } else if (strcmp(argv[argi], "--shm") == 0) {
+            shm_name = GPIO_RING_DEFAULT_NAME;
+        } else if (strncmp(argv[argi], "--shm=", 6) == 0) {
+            shm_name = argv[argi] + 6;
+        } else {
+            fprintf(stderr, "Unknown option: '%s'\n", argv[argi]);
+            print_help(program_name);
+            return 1;
+        }
+    }
+    argc -= argi - 1;
+    argv += argi - 1;
+    
+    gpio_rt_stats_init(&rt_stats);
+    
+    /* Set up signal handlers (no SA_RESTART, so blocking waits return) */
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = signal_handler;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    
+    /* Trace builds dump library call latencies on SIGUSR1 and at exit */
+    gpio_trace_dump_on_signal(SIGUSR1);
+    
+    /* Remote commands talk to the daemon, which owns the device */
+    if (argc >= 2 && strcmp(argv[1], "remote") == 0) {
+        if (argc < 4) {
+            fprintf(stderr, "ERROR: remote command requires SOCKET and CMD arguments\n");
+            return 1;
+        }
+        return (cmd_remote(argv[2], argv[3], argc >= 5 ? argv[4] : NULL) == 0) ? 0 : 1;
+    }
+    
+    if (argc >= 2 && strcmp(argv[1], "dump") == 0) {
+        if (argc < 3) {
+            fprintf(stderr, "ERROR: dump command requires a FILE argument\n");
+            return 1;
+        }
+        return (cmd_dump_edgelog(argv[2], argc >= 4 ? atof(argv[3]) : 0.0,
+                                 argc >= 5 ? atof(argv[4]) : -1.0) == 0) ? 0 : 1;
+    }
     
-    /* Set up signal handlers */
-    signal(SIGINT, signal_handler);
-    signal(SIGTERM, signal_handler);
+    if (argc >= 2 && strcmp(argv[1], "decode") == 0) {
+        if (argc < 3) {
+            fprintf(stderr, "ERROR: decode command requires a FILE argument\n");
+            return 1;
+        }
+        return (cmd_decode_bitmap(argv[2], argc >= 4 ? atoi(argv[3]) : -1,
+                                  argc >= 5 ? argv[4] : NULL) == 0) ? 0 : 1;
+    }
+    
+    if (argc >= 2 && strcmp(argv[1], "shm-monitor") == 0) {
+        return (cmd_shm_monitor(argc >= 3 ? argv[2] : GPIO_RING_DEFAULT_NAME,
+                                argc >= 4 ? atoi(argv[3]) : 0) == 0) ? 0 : 1;
+    }
     
     printf("GPIO Device Driver User Application v1.0\n");
     printf("=========================================\n\n");
     
     /* Open GPIO device */
-    fd = gpio_open_device();
+    fd = gpio_open_line(gpio_line);
     if (fd < 0) {
         fprintf(stderr, "FATAL: Cannot open GPIO device\n");
         return 1;
     }
     
+    if (shm_name != NULL &&
+        gpio_ring_create(&shm_ring, shm_name, GPIO_RING_DEFAULT_CAPACITY) != 0) {
+        fprintf(stderr, "FATAL: Cannot create shared-memory event ring\n");
+        gpio_close_device(fd);
+        return 1;
+    }
+    
+    if (gpio_rt_setup(&rt_config) != 0) {
+        fprintf(stderr, "FATAL: Cannot enter real-time mode\n");
+        gpio_close_device(fd);
+        return 1;
+    }
+    
     /* Parse command line arguments */
     if (argc < 2) {
-        print_help(argv[0]);
+        print_help(program_name);
         gpio_close_device(fd);
         return 0;
     }
     
     if (strcmp(argv[1], "help") == 0) {
-        print_help(argv[0]);
+        print_help(program_name);
     }
     else if (strcmp(argv[1], "read") == 0) {
         ret = cmd_read_value(fd);
@@ -347,6 +1681,72 @@ int main(int argc, char *argv[])
         }
         ret = cmd_monitor_gpio(fd, duration);
     }
+    else if (strcmp(argv[1], "events") == 0) {
+        ret = cmd_events(fd, argc >= 3 ? atoi(argv[2]) : 10,
+                         argc >= 4 ? (uint32_t)strtoul(argv[3], NULL, 0) : 0,
+                         argc >= 5 ? argv[4] : NULL, argc >= 6 ? argv[5] : NULL);
+    }
+    else if (strcmp(argv[1], "counter") == 0) {
+        ret = cmd_counter_gpio(fd, argc >= 3 ? atoi(argv[2]) : 10);
+    }
+    else if (strcmp(argv[1], "record") == 0) {
+        if (argc < 3) {
+            fprintf(stderr, "ERROR: record command requires a FILE argument\n");
+            ret = -1;
+        } else {
+            ret = cmd_record_gpio(fd, argv[2], argc >= 4 ? atoi(argv[3]) : 10);
+        }
+    }
+    else if (strcmp(argv[1], "archive") == 0) {
+        if (argc < 3) {
+            fprintf(stderr, "ERROR: archive command requires a FILE argument\n");
+            ret = -1;
+        } else {
+            ret = cmd_archive_events(fd, argv[2], argc >= 4 ? atoi(argv[3]) : 10,
+                                     argc >= 5 ? (uint32_t)strtoul(argv[4], NULL, 0) : 0,
+                                     argc >= 6 ? argv[5] : NULL);
+        }
+    }
+    else if (strcmp(argv[1], "capture") == 0) {
+        if (argc < 3) {
+            fprintf(stderr, "ERROR: capture command requires a FILE argument\n");
+            ret = -1;
+        } else {
+            ret = cmd_capture_bitmap(fd, argv[2],
+                                     argc >= 4 ? strtoull(argv[3], NULL, 0) : 1000000,
+                                     argc >= 5 ? (uint32_t)strtoul(argv[4], NULL, 0)
+                                               : (1u << gpio_line));
+        }
+    }
+    else if (strcmp(argv[1], "replay") == 0) {
+        if (argc < 3) {
+            fprintf(stderr, "ERROR: replay command requires a FILE argument\n");
+            ret = -1;
+        } else {
+            ret = cmd_replay_edgelog(fd, argv[2], argc >= 4 ? atof(argv[3]) : 0.0,
+                                     argc >= 5 ? atof(argv[4]) : -1.0);
+        }
+    }
+    else if (strcmp(argv[1], "ops") == 0) {
+        ret = cmd_run_ops(fd, argc - 2, argv + 2);
+    }
+    else if (strcmp(argv[1], "reflex") == 0) {
+        ret = cmd_reflex(fd, argc - 2, argv + 2);
+    }
+    else if (strcmp(argv[1], "gesture") == 0) {
+        ret = cmd_gesture(fd, argc - 2, argv + 2);
+    }
+    else if (strcmp(argv[1], "notify") == 0) {
+        ret = cmd_notify(fd, argc >= 3 ? atoi(argv[2]) : 10, argc >= 4 ? argv[3] : NULL);
+    }
+    else if (strcmp(argv[1], "schedule") == 0) {
+        if (argc < 5) {
+            fprintf(stderr, "ERROR: schedule command requires AT, STEP_US and a VALUE\n");
+            ret = -1;
+        } else {
+            ret = cmd_schedule(fd, argv[2], strtoul(argv[3], NULL, 0), argc - 4, &argv[4]);
+        }
+    }
     else if (strcmp(argv[1], "setdir") == 0) {
         if (argc < 3) {
             fprintf(stderr, "ERROR: setdir command requires direction argument\n");
@@ -364,15 +1764,26 @@ int main(int argc, char *argv[])
     else if (strcmp(argv[1], "interactive") == 0) {
         ret = interactive_mode(fd);
     }
+    else if (strcmp(argv[1], "daemon") == 0) {
+        ret = cmd_daemon(fd, argc >= 3 ? argv[2] : GPIOD_SOCKET_PATH);
+    }
     else {
         fprintf(stderr, "Unknown command: '%s'\n", argv[1]);
-        print_help(argv[0]);
+        print_help(program_name);
         ret = 1;
     }
     
+    if (rt_config.enabled) {
+        gpio_rt_stats_print(&rt_stats, stdout);
+    }
+    
+    gpio_ring_close(&shm_ring);
+    
     /* Close GPIO device */
     gpio_close_device(fd);
     
+    gpio_trace_dump(STDERR_FILENO);
+    
     printf("\nApplication terminated (exit code: %d)\n", ret);
     
     return (ret == 0) ? 0 : 1;